@@ -114,9 +114,19 @@ static uint8_t DAP_Info(uint8_t id, uint8_t *info) {
       break;
     case DAP_ID_CAPABILITIES:
       info[0] = ((DAP_SWD  != 0) ? (1 << 0) : 0) |
-                ((DAP_JTAG != 0) ? (1 << 1) : 0);
+                ((DAP_JTAG != 0) ? (1 << 1) : 0) |
+                ((TIMESTAMP_CLOCK != 0) ? (1 << 5) : 0);
       length = 1;
       break;
+    case DAP_ID_TIMESTAMP_CLOCK:
+#if (TIMESTAMP_CLOCK != 0)
+      info[0] = (uint8_t)(TIMESTAMP_CLOCK >>  0);
+      info[1] = (uint8_t)(TIMESTAMP_CLOCK >>  8);
+      info[2] = (uint8_t)(TIMESTAMP_CLOCK >> 16);
+      info[3] = (uint8_t)(TIMESTAMP_CLOCK >> 24);
+      length = 4;
+#endif
+      break;
     case DAP_ID_PACKET_SIZE:
       info[0] = (uint8_t)(DAP_PACKET_SIZE >> 0);
       info[1] = (uint8_t)(DAP_PACKET_SIZE >> 8);
@@ -247,6 +257,9 @@ static uint32_t DAP_Connect(uint8_t *request, uint8_t *response) {
 //   return:   number of bytes in response
 static uint32_t DAP_Disconnect(uint8_t *response) {
 
+  // Finish a vendor flash session while the port is still up
+  DAP_VendorFlashEnd();
+
   DAP_Data.debug_port = DAP_PORT_DISABLED;
   PORT_OFF();
 
@@ -621,6 +634,9 @@ static uint32_t DAP_SWD_Transfer(uint8_t *request, uint8_t *response) {
   uint32_t  match_retry;
   uint32_t  retry;
   uint32_t  data;
+#if (TIMESTAMP_CLOCK != 0)
+  uint32_t  timestamp;
+#endif
 
   response_count = 0;
   response_value = 0;
@@ -660,6 +676,18 @@ static uint32_t DAP_SWD_Transfer(uint8_t *request, uint8_t *response) {
         *response++ = (uint8_t)(data >>  8);
         *response++ = (uint8_t)(data >> 16);
         *response++ = (uint8_t)(data >> 24);
+#if (TIMESTAMP_CLOCK != 0)
+        if (post_read) {
+          // Store Timestamp of next AP read
+          if (request_value & DAP_TRANSFER_TIMESTAMP) {
+            timestamp = DAP_Data.timestamp;
+            *response++ = (uint8_t) timestamp;
+            *response++ = (uint8_t)(timestamp >>  8);
+            *response++ = (uint8_t)(timestamp >> 16);
+            *response++ = (uint8_t)(timestamp >> 24);
+          }
+        }
+#endif
       }
       if (request_value & DAP_TRANSFER_MATCH_VALUE) {
         // Read with value match
@@ -689,6 +717,16 @@ static uint32_t DAP_SWD_Transfer(uint8_t *request, uint8_t *response) {
           response_value |= DAP_TRANSFER_MISMATCH;
         }
         if (response_value != DAP_TRANSFER_OK) break;
+#if (TIMESTAMP_CLOCK != 0)
+        // Store Timestamp
+        if (request_value & DAP_TRANSFER_TIMESTAMP) {
+          timestamp = DAP_Data.timestamp;
+          *response++ = (uint8_t) timestamp;
+          *response++ = (uint8_t)(timestamp >>  8);
+          *response++ = (uint8_t)(timestamp >> 16);
+          *response++ = (uint8_t)(timestamp >> 24);
+        }
+#endif
       } else {
         // Normal read
         retry = DAP_Data.transfer.retry_count;
@@ -700,6 +738,16 @@ static uint32_t DAP_SWD_Transfer(uint8_t *request, uint8_t *response) {
               response_value = SWD_Transfer(request_value, NULL);
             } while ((response_value == DAP_TRANSFER_WAIT) && retry-- && !DAP_TransferAbort);
             if (response_value != DAP_TRANSFER_OK) break;
+#if (TIMESTAMP_CLOCK != 0)
+            // Store Timestamp
+            if (request_value & DAP_TRANSFER_TIMESTAMP) {
+              timestamp = DAP_Data.timestamp;
+              *response++ = (uint8_t) timestamp;
+              *response++ = (uint8_t)(timestamp >>  8);
+              *response++ = (uint8_t)(timestamp >> 16);
+              *response++ = (uint8_t)(timestamp >> 24);
+            }
+#endif
             post_read = 1;
           }
         } else {
@@ -708,6 +756,16 @@ static uint32_t DAP_SWD_Transfer(uint8_t *request, uint8_t *response) {
             response_value = SWD_Transfer(request_value, &data);
           } while ((response_value == DAP_TRANSFER_WAIT) && retry-- && !DAP_TransferAbort);
           if (response_value != DAP_TRANSFER_OK) break;
+#if (TIMESTAMP_CLOCK != 0)
+          // Store Timestamp
+          if (request_value & DAP_TRANSFER_TIMESTAMP) {
+            timestamp = DAP_Data.timestamp;
+            *response++ = (uint8_t) timestamp;
+            *response++ = (uint8_t)(timestamp >>  8);
+            *response++ = (uint8_t)(timestamp >> 16);
+            *response++ = (uint8_t)(timestamp >> 24);
+          }
+#endif
           // Store data
           *response++ = (uint8_t) data;
           *response++ = (uint8_t)(data >>  8);
@@ -749,6 +807,16 @@ static uint32_t DAP_SWD_Transfer(uint8_t *request, uint8_t *response) {
           response_value = SWD_Transfer(request_value, &data);
         } while ((response_value == DAP_TRANSFER_WAIT) && retry-- && !DAP_TransferAbort);
         if (response_value != DAP_TRANSFER_OK) break;
+#if (TIMESTAMP_CLOCK != 0)
+        // Store Timestamp
+        if (request_value & DAP_TRANSFER_TIMESTAMP) {
+          timestamp = DAP_Data.timestamp;
+          *response++ = (uint8_t) timestamp;
+          *response++ = (uint8_t)(timestamp >>  8);
+          *response++ = (uint8_t)(timestamp >> 16);
+          *response++ = (uint8_t)(timestamp >> 24);
+        }
+#endif
         check_write = 1;
       }
     }
@@ -805,6 +873,9 @@ static uint32_t DAP_JTAG_Transfer(uint8_t *request, uint8_t *response) {
   uint32_t  retry;
   uint32_t  data;
   uint32_t  ir;
+#if (TIMESTAMP_CLOCK != 0)
+  uint32_t  timestamp;
+#endif
 
   response_count = 0;
   response_value = 0;
@@ -852,6 +923,18 @@ static uint32_t DAP_JTAG_Transfer(uint8_t *request, uint8_t *response) {
         *response++ = (uint8_t)(data >>  8);
         *response++ = (uint8_t)(data >> 16);
         *response++ = (uint8_t)(data >> 24);
+#if (TIMESTAMP_CLOCK != 0)
+        if (post_read) {
+          // Store Timestamp of next AP read
+          if (request_value & DAP_TRANSFER_TIMESTAMP) {
+            timestamp = DAP_Data.timestamp;
+            *response++ = (uint8_t) timestamp;
+            *response++ = (uint8_t)(timestamp >>  8);
+            *response++ = (uint8_t)(timestamp >> 16);
+            *response++ = (uint8_t)(timestamp >> 24);
+          }
+        }
+#endif
       }
       if (request_value & DAP_TRANSFER_MATCH_VALUE) {
         // Read with value match
@@ -884,6 +967,16 @@ static uint32_t DAP_JTAG_Transfer(uint8_t *request, uint8_t *response) {
           response_value |= DAP_TRANSFER_MISMATCH;
         }
         if (response_value != DAP_TRANSFER_OK) break;
+#if (TIMESTAMP_CLOCK != 0)
+        // Store Timestamp
+        if (request_value & DAP_TRANSFER_TIMESTAMP) {
+          timestamp = DAP_Data.timestamp;
+          *response++ = (uint8_t) timestamp;
+          *response++ = (uint8_t)(timestamp >>  8);
+          *response++ = (uint8_t)(timestamp >> 16);
+          *response++ = (uint8_t)(timestamp >> 24);
+        }
+#endif
       } else {
         // Normal read
         if (post_read == 0) {
@@ -898,6 +991,16 @@ static uint32_t DAP_JTAG_Transfer(uint8_t *request, uint8_t *response) {
             response_value = JTAG_Transfer(request_value, NULL);
           } while ((response_value == DAP_TRANSFER_WAIT) && retry-- && !DAP_TransferAbort);
           if (response_value != DAP_TRANSFER_OK) break;
+#if (TIMESTAMP_CLOCK != 0)
+          // Store Timestamp
+          if (request_value & DAP_TRANSFER_TIMESTAMP) {
+            timestamp = DAP_Data.timestamp;
+            *response++ = (uint8_t) timestamp;
+            *response++ = (uint8_t)(timestamp >>  8);
+            *response++ = (uint8_t)(timestamp >> 16);
+            *response++ = (uint8_t)(timestamp >> 24);
+          }
+#endif
           post_read = 1;
         }
       }
@@ -944,6 +1047,16 @@ static uint32_t DAP_JTAG_Transfer(uint8_t *request, uint8_t *response) {
           response_value = JTAG_Transfer(request_value, &data);
         } while ((response_value == DAP_TRANSFER_WAIT) && retry-- && !DAP_TransferAbort);
         if (response_value != DAP_TRANSFER_OK) break;
+#if (TIMESTAMP_CLOCK != 0)
+        // Store Timestamp
+        if (request_value & DAP_TRANSFER_TIMESTAMP) {
+          timestamp = DAP_Data.timestamp;
+          *response++ = (uint8_t) timestamp;
+          *response++ = (uint8_t)(timestamp >>  8);
+          *response++ = (uint8_t)(timestamp >> 16);
+          *response++ = (uint8_t)(timestamp >> 24);
+        }
+#endif
       }
     }
     response_count++;
@@ -1189,11 +1302,11 @@ __weak uint32_t DAP_ProcessVendorCommand(uint8_t *request, uint8_t *response) {
 }
 
 
-// Process DAP command and prepare response
+// Execute DAP command and prepare response
 //   request:  pointer to request data
 //   response: pointer to response data
 //   return:   number of bytes in response
-uint32_t DAP_ProcessCommand(uint8_t *request, uint8_t *response) {
+static uint32_t DAP_ExecuteCommand(uint8_t *request, uint8_t *response) {
   uint32_t num;
 
   if ((*request >= ID_DAP_Vendor0) && (*request <= ID_DAP_Vendor31)) {
@@ -1339,6 +1452,22 @@ uint32_t DAP_ProcessCommand(uint8_t *request, uint8_t *response) {
 }
 
 
+// Process DAP command and prepare response
+//   request:  pointer to request data
+//   response: pointer to response data
+//   return:   number of bytes in response
+uint32_t DAP_ProcessCommand(uint8_t *request, uint8_t *response) {
+  uint32_t start;
+  uint32_t num;
+
+  start = perf_get_cycles();
+  num = DAP_ExecuteCommand(request, response);
+  perf_timer_record(PERF_TIMER_DAP_COMMAND, start);
+
+  return (num);
+}
+
+
 // Setup DAP
 void DAP_Setup(void) {
 
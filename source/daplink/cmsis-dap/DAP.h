@@ -93,6 +93,7 @@ extern "C" {
 #define DAP_ID_FW_VER                   4
 #define DAP_ID_DEVICE_VENDOR            5
 #define DAP_ID_DEVICE_NAME              6
+#define DAP_ID_TIMESTAMP_CLOCK          8
 #define DAP_ID_CAPABILITIES             0xF0
 #define DAP_ID_PACKET_COUNT             0xFE
 #define DAP_ID_PACKET_SIZE              0xFF
@@ -122,6 +123,7 @@ extern "C" {
 #define DAP_TRANSFER_A3                 (1<<3)
 #define DAP_TRANSFER_MATCH_VALUE        (1<<4)
 #define DAP_TRANSFER_MATCH_MASK         (1<<5)
+#define DAP_TRANSFER_TIMESTAMP          (1<<7)
 
 // DAP Transfer Response
 #define DAP_TRANSFER_OK                 (1<<0)
@@ -155,12 +157,14 @@ extern "C" {
 
 #include "stddef.h"
 #include "stdint.h"
+#include "perf_counter.h"
 
 // DAP Data structure
 typedef struct {
   uint8_t     debug_port;                       // Debug Port
   uint8_t     fast_clock;                       // Fast Clock Flag
   uint32_t   clock_delay;                       // Clock Delay
+  uint32_t   timestamp;                         // Last captured Timestamp
   struct {                                      // Transfer Configuration
     uint8_t   idle_cycles;                      // Idle cycles after transfer
     uint16_t  retry_count;                      // Number of retries after WAIT response
@@ -195,6 +199,7 @@ extern void     SWJ_Sequence    (uint32_t count, uint8_t *data);
 extern void     JTAG_Sequence   (uint32_t info,  uint8_t *tdi, uint8_t *tdo);
 extern void     JTAG_IR         (uint32_t ir);
 extern uint32_t JTAG_ReadIDCode (void);
+extern uint32_t JTAG_DetectChain(uint32_t *idcode, uint32_t max);
 extern void     JTAG_WriteAbort (uint32_t data);
 extern uint8_t  JTAG_Transfer   (uint32_t request, uint32_t *data);
 extern uint8_t  SWD_Transfer    (uint32_t request, uint32_t *data);
@@ -202,6 +207,8 @@ extern uint8_t  SWD_Transfer    (uint32_t request, uint32_t *data);
 extern void     Delayms         (uint32_t delay);
 
 extern uint32_t DAP_ProcessVendorCommand (uint8_t *request, uint8_t *response);
+extern uint16_t DAP_VendorIdleTicks      (void);
+extern void     DAP_VendorFlashEnd       (void);
 
 extern uint32_t DAP_ProcessCommand (uint8_t *request, uint8_t *response);
 extern void     DAP_Setup (void);
@@ -233,6 +240,14 @@ static __forceinline void PIN_DELAY_FAST (void) {
 #endif
 }
 
+// Timestamp clock for transfer timestamps (Test Domain Timer)
+#ifndef TIMESTAMP_CLOCK
+#define TIMESTAMP_CLOCK         CPU_CLOCK
+#endif
+static __forceinline uint32_t TIMESTAMP_GET (void) {
+  return perf_get_cycles();
+}
+
 #ifdef __cplusplus
 }
 #endif
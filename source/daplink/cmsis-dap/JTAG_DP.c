@@ -222,6 +222,114 @@ uint8_t JTAG_Transfer##speed (uint32_t request, uint32_t *data) {
     }                                                                           \
   }                                                                             \
                                                                                 \
+  /* Capture Timestamp */                                                       \
+  if (request & DAP_TRANSFER_TIMESTAMP) {                                       \
+    DAP_Data.timestamp = TIMESTAMP_GET();                                       \
+  }                                                                             \
+                                                                                \
+exit:                                                                           \
+  JTAG_CYCLE_TCK();                         /* Update-DR */                     \
+  PIN_TMS_CLR();                                                                \
+  JTAG_CYCLE_TCK();                         /* Idle */                          \
+  PIN_TDI_OUT(1);                                                               \
+                                                                                \
+  /* Idle cycles */                                                             \
+  n = DAP_Data.transfer.idle_cycles;                                            \
+  while (n--) {                                                                 \
+    JTAG_CYCLE_TCK();                       /* Idle */                          \
+  }                                                                             \
+                                                                                \
+  return (ack);                                                                 \
+}
+
+
+// JTAG Set IR for a chain with a single device (no bypass bits)
+//   ir:     IR value
+//   return: none
+#define JTAG_IR_SingleFunction(speed) /**/                                      \
+void JTAG_IR_Single##speed (uint32_t ir) {                                      \
+  uint32_t n;                                                                   \
+                                                                                \
+  PIN_TMS_SET();                                                                \
+  JTAG_CYCLE_TCK();                         /* Select-DR-Scan */                \
+  JTAG_CYCLE_TCK();                         /* Select-IR-Scan */                \
+  PIN_TMS_CLR();                                                                \
+  JTAG_CYCLE_TCK();                         /* Capture-IR */                    \
+  JTAG_CYCLE_TCK();                         /* Shift-IR */                      \
+                                                                                \
+  for (n = DAP_Data.jtag_dev.ir_length[0] - 1; n; n--) {                        \
+    JTAG_CYCLE_TDI(ir);                     /* Set IR bits (except last) */     \
+    ir >>= 1;                                                                   \
+  }                                                                             \
+  PIN_TMS_SET();                                                                \
+  JTAG_CYCLE_TDI(ir);                       /* Set last IR bit & Exit1-IR */    \
+                                                                                \
+  JTAG_CYCLE_TCK();                         /* Update-IR */                     \
+  PIN_TMS_CLR();                                                                \
+  JTAG_CYCLE_TCK();                         /* Idle */                          \
+  PIN_TDI_OUT(1);                                                               \
+}
+
+
+// JTAG Transfer I/O for a chain with a single device (no bypass bits)
+//   request: A[3:2] RnW APnDP
+//   data:    DATA[31:0]
+//   return:  ACK[2:0]
+#define JTAG_TransferSingleFunction(speed)  /**/                                \
+uint8_t JTAG_TransferSingle##speed (uint32_t request, uint32_t *data) {         \
+  uint32_t ack;                                                                 \
+  uint32_t bit;                                                                 \
+  uint32_t val;                                                                 \
+  uint32_t n;                                                                   \
+                                                                                \
+  PIN_TMS_SET();                                                                \
+  JTAG_CYCLE_TCK();                         /* Select-DR-Scan */                \
+  PIN_TMS_CLR();                                                                \
+  JTAG_CYCLE_TCK();                         /* Capture-DR */                    \
+  JTAG_CYCLE_TCK();                         /* Shift-DR */                      \
+                                                                                \
+  JTAG_CYCLE_TDIO(request >> 1, bit);       /* Set RnW, Get ACK.0 */            \
+  ack  = bit << 1;                                                              \
+  JTAG_CYCLE_TDIO(request >> 2, bit);       /* Set A2,  Get ACK.1 */            \
+  ack |= bit << 0;                                                              \
+  JTAG_CYCLE_TDIO(request >> 3, bit);       /* Set A3,  Get ACK.2 */            \
+  ack |= bit << 2;                                                              \
+                                                                                \
+  if (ack != DAP_TRANSFER_OK) {                                                 \
+    /* Exit on error */                                                         \
+    PIN_TMS_SET();                                                              \
+    JTAG_CYCLE_TCK();                       /* Exit1-DR */                      \
+    goto exit;                                                                  \
+  }                                                                             \
+                                                                                \
+  if (request & DAP_TRANSFER_RnW) {                                             \
+    /* Read Transfer */                                                         \
+    val = 0;                                                                    \
+    for (n = 31; n; n--) {                                                      \
+      JTAG_CYCLE_TDO(bit);                  /* Get D0..D30 */                   \
+      val  |= bit << 31;                                                        \
+      val >>= 1;                                                                \
+    }                                                                           \
+    PIN_TMS_SET();                                                              \
+    JTAG_CYCLE_TDO(bit);                    /* Get D31 & Exit1-DR */            \
+    val |= bit << 31;                                                           \
+    if (data) *data = val;                                                      \
+  } else {                                                                      \
+    /* Write Transfer */                                                        \
+    val = *data;                                                                \
+    for (n = 31; n; n--) {                                                      \
+      JTAG_CYCLE_TDI(val);                  /* Set D0..D30 */                   \
+      val >>= 1;                                                                \
+    }                                                                           \
+    PIN_TMS_SET();                                                              \
+    JTAG_CYCLE_TDI(val);                    /* Set D31 & Exit1-DR */            \
+  }                                                                             \
+                                                                                \
+  /* Capture Timestamp */                                                       \
+  if (request & DAP_TRANSFER_TIMESTAMP) {                                       \
+    DAP_Data.timestamp = TIMESTAMP_GET();                                       \
+  }                                                                             \
+                                                                                \
 exit:                                                                           \
   JTAG_CYCLE_TCK();                         /* Update-DR */                     \
   PIN_TMS_CLR();                                                                \
@@ -242,11 +350,15 @@ exit:
 #define PIN_DELAY() PIN_DELAY_FAST()
 JTAG_IR_Function(Fast);
 JTAG_TransferFunction(Fast);
+JTAG_IR_SingleFunction(Fast);
+JTAG_TransferSingleFunction(Fast);
 
 #undef  PIN_DELAY
 #define PIN_DELAY() PIN_DELAY_SLOW(DAP_Data.clock_delay)
 JTAG_IR_Function(Slow);
 JTAG_TransferFunction(Slow);
+JTAG_IR_SingleFunction(Slow);
+JTAG_TransferSingleFunction(Slow);
 
 
 // JTAG Read IDCODE register
@@ -333,10 +445,18 @@ void JTAG_WriteAbort (uint32_t data) {
 //   ir:     IR value
 //   return: none
 void JTAG_IR (uint32_t ir) {
-  if (DAP_Data.fast_clock) {
-    JTAG_IR_Fast(ir);
+  if (DAP_Data.jtag_dev.count == 1) {
+    if (DAP_Data.fast_clock) {
+      JTAG_IR_SingleFast(ir);
+    } else {
+      JTAG_IR_SingleSlow(ir);
+    }
   } else {
-    JTAG_IR_Slow(ir);
+    if (DAP_Data.fast_clock) {
+      JTAG_IR_Fast(ir);
+    } else {
+      JTAG_IR_Slow(ir);
+    }
   }
 }
 
@@ -346,6 +466,13 @@ void JTAG_IR (uint32_t ir) {
 //   data:    DATA[31:0]
 //   return:  ACK[2:0]
 uint8_t  JTAG_Transfer(uint32_t request, uint32_t *data) {
+  if (DAP_Data.jtag_dev.count == 1) {
+    if (DAP_Data.fast_clock) {
+      return JTAG_TransferSingleFast(request, data);
+    } else {
+      return JTAG_TransferSingleSlow(request, data);
+    }
+  }
   if (DAP_Data.fast_clock) {
     return JTAG_TransferFast(request, data);
   } else {
@@ -354,4 +481,131 @@ uint8_t  JTAG_Transfer(uint32_t request, uint32_t *data) {
 }
 
 
+// Maximum total IR length supported by the scan chain detection
+#define JTAG_DETECT_IR_BITS     256
+
+// Move all TAPs to Test-Logic-Reset and then to Run-Test/Idle.
+// This loads IDCODE (or BYPASS) into every instruction register.
+static void JTAG_TestLogicReset (void) {
+  uint32_t n;
+
+  PIN_TMS_SET();
+  for (n = 6; n; n--) {
+    JTAG_CYCLE_TCK();                       /* Test-Logic-Reset */
+  }
+  PIN_TMS_CLR();
+  JTAG_CYCLE_TCK();                         /* Idle */
+}
+
+// Detect the devices on the JTAG scan chain and configure it
+//   idcode: pointer to IDCODE array, 0 is stored for devices without IDCODE
+//   max:    maximum number of devices to detect
+//   return: number of devices, 0 if no device was found or if the
+//           IR lengths could not be determined unambiguously
+uint32_t JTAG_DetectChain (uint32_t *idcode, uint32_t max) {
+  static uint8_t capture[JTAG_DETECT_IR_BITS / 8];
+  uint8_t  ir_start[DAP_JTAG_DEV_CNT];
+  uint32_t count;
+  uint32_t length;
+  uint32_t starts;
+  uint32_t bits;
+  uint32_t bit;
+  uint32_t val;
+  uint32_t n;
+
+  if (max > DAP_JTAG_DEV_CNT) max = DAP_JTAG_DEV_CNT;
+
+  // Scan the IDCODE/BYPASS data registers selected by the reset
+  JTAG_TestLogicReset();
+  PIN_TMS_SET();
+  JTAG_CYCLE_TCK();                         /* Select-DR-Scan */
+  PIN_TMS_CLR();
+  JTAG_CYCLE_TCK();                         /* Capture-DR */
+  JTAG_CYCLE_TCK();                         /* Shift-DR */
+  PIN_TDI_OUT(1);
+
+  count = 0;
+  while (count < max) {
+    JTAG_CYCLE_TDO(bit);
+    if (bit == 0) {
+      // BYPASS register, device has no IDCODE
+      idcode[count++] = 0;
+      continue;
+    }
+    val = 1;
+    for (n = 1; n < 32; n++) {
+      JTAG_CYCLE_TDO(bit);
+      val |= bit << n;
+    }
+    // The ones shifted in from TDI mark the end of the chain
+    if (val == 0xFFFFFFFF) break;
+    idcode[count++] = val;
+  }
+  if (count == 0) {
+    JTAG_TestLogicReset();
+    return (0);
+  }
+
+  // Capture the IR values: every IR captures ...01 with the LSB first
+  JTAG_TestLogicReset();
+  PIN_TMS_SET();
+  JTAG_CYCLE_TCK();                         /* Select-DR-Scan */
+  JTAG_CYCLE_TCK();                         /* Select-IR-Scan */
+  PIN_TMS_CLR();
+  JTAG_CYCLE_TCK();                         /* Capture-IR */
+  JTAG_CYCLE_TCK();                         /* Shift-IR */
+
+  PIN_TDI_OUT(1);
+  for (n = 0; n < JTAG_DETECT_IR_BITS; n++) {
+    JTAG_CYCLE_TDO(bit);
+    if (bit) {
+      capture[n >> 3] |=  (1 << (n & 7));
+    } else {
+      capture[n >> 3] &= ~(1 << (n & 7));
+    }
+  }
+
+  // The chain is now filled with ones, count the clocks
+  // until the first zero appears to get the total IR length
+  PIN_TDI_OUT(0);
+  for (bits = 0; bits < JTAG_DETECT_IR_BITS; bits++) {
+    JTAG_CYCLE_TDO(bit);
+    if (bit == 0) break;
+  }
+
+  // Refill with ones (BYPASS) before leaving through Update-IR
+  PIN_TDI_OUT(1);
+  for (n = bits; n; n--) {
+    JTAG_CYCLE_TCK();
+  }
+  PIN_TMS_SET();
+  JTAG_CYCLE_TCK();                         /* Exit1-IR */
+  JTAG_CYCLE_TCK();                         /* Update-IR */
+  JTAG_TestLogicReset();
+
+  // Every device starts with a one in the captured value
+  starts = 0;
+  for (n = 0; n < bits; n++) {
+    if (capture[n >> 3] & (1 << (n & 7))) {
+      if (starts == count) return (0);
+      ir_start[starts++] = n;
+    }
+  }
+  if ((bits == JTAG_DETECT_IR_BITS) || (starts != count) || (ir_start[0] != 0)) {
+    return (0);
+  }
+
+  // Configure the chain the same way as DAP_JTAG_Configure
+  DAP_Data.jtag_dev.count = count;
+  for (n = 0; n < count; n++) {
+    length = ((n + 1 < count) ? ir_start[n + 1] : bits) - ir_start[n];
+    DAP_Data.jtag_dev.ir_length[n] = length;
+    DAP_Data.jtag_dev.ir_before[n] = ir_start[n];
+    DAP_Data.jtag_dev.ir_after[n]  = bits - ir_start[n] - length;
+  }
+
+  return (count);
+}
+
+
 #endif  /* (DAP_JTAG != 0) */
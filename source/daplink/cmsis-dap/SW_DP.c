@@ -60,6 +60,8 @@ void SWJ_Sequence (uint32_t count, uint8_t *data) {
   uint32_t val;
   uint32_t n;
 
+  perf_count_n(PERF_EVENT_SWJ_CLOCKS, count);
+
   val = 0;
   n = 0;
   while (count--) {
@@ -167,6 +169,10 @@ uint8_t SWD_Transfer##speed (uint32_t request, uint32_t *data) {
       }                                                                         \
       SW_WRITE_BIT(parity);             /* Write Parity Bit */                  \
     }                                                                           \
+    /* Capture Timestamp */                                                     \
+    if (request & DAP_TRANSFER_TIMESTAMP) {                                     \
+      DAP_Data.timestamp = TIMESTAMP_GET();                                     \
+    }                                                                           \
     /* Idle cycles */                                                           \
     n = DAP_Data.transfer.idle_cycles;                                          \
     if (n) {                                                                    \
@@ -225,11 +231,31 @@ SWD_TransferFunction(Slow);
 //   data:    DATA[31:0]
 //   return:  ACK[2:0]
 uint8_t  SWD_Transfer(uint32_t request, uint32_t *data) {
+  uint8_t ack;
+  uint32_t clocks;
+
   if (DAP_Data.fast_clock) {
-    return SWD_TransferFast(request, data);
+    ack = SWD_TransferFast(request, data);
+  } else {
+    ack = SWD_TransferSlow(request, data);
+  }
+
+  /* Request, turnaround and acknowledge are always clocked */
+  clocks = 8 + DAP_Data.swd_conf.turnaround + 3;
+
+  perf_count(PERF_EVENT_SWD_TRANSFER);
+  if (ack == DAP_TRANSFER_OK) {
+    clocks += 32 + 1 + DAP_Data.swd_conf.turnaround + DAP_Data.transfer.idle_cycles;
+  } else if ((ack == DAP_TRANSFER_WAIT) || (ack == DAP_TRANSFER_FAULT)) {
+    clocks += DAP_Data.swd_conf.turnaround + (DAP_Data.swd_conf.data_phase ? 32 + 1 : 0);
+    perf_count((ack == DAP_TRANSFER_WAIT) ? PERF_EVENT_SWD_WAIT : PERF_EVENT_SWD_FAULT);
   } else {
-    return SWD_TransferSlow(request, data);
+    clocks += DAP_Data.swd_conf.turnaround + 32 + 1;
+    perf_count(PERF_EVENT_SWD_ERROR);
   }
+  perf_count_n(PERF_EVENT_SWJ_CLOCKS, clocks);
+
+  return (ack);
 }
 
 
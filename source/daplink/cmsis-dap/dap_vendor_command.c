@@ -23,6 +23,7 @@
 #include "string.h"
 
 #include "RTL.h"
+#include "RTX_Config.h"
 #include "rl_usb.h"
 #include "info.h"
 #include "DAP_config.h"
@@ -30,10 +31,509 @@
 #include "DAP.h"
 #include "main.h"
 #include "target_config.h"
+#include "target_ids.h"
 #include "read_uid.h"
+#include "swd_host.h"
+#include "flash_intf.h"
+#include "target_flash.h"
+#include "crc.h"
+#include "macro.h"
+#include "util.h"
+#include "perf_counter.h"
+#include "tasks.h"
+
+// Header bytes in a memory read/write response: command, status, count
+#define MEM_RESPONSE_HEADER_SIZE    3
+// Header bytes in a memory write request: command, address, length, count
+#define MEM_WRITE_REQUEST_HEADER_SIZE 10
+
+// Target memory stream shared by the memory read and write commands.
+// A request with a non-zero length (re)starts the stream at the given
+// address, a request with zero length continues where the last one ended.
+typedef struct {
+    uint32_t address;
+    uint32_t remaining;
+} mem_stream_t;
+
+static mem_stream_t mem_read_stream;
+static mem_stream_t mem_write_stream;
+
+// Size of the page buffer used to coalesce streamed flash data. Must be
+// a multiple of the target's minimum program size.
+#define FLASH_PAGE_SIZE             256
+#define FLASH_PAGE_INVALID          0xFFFFFFFF
+
+// Time without any DAP command after which an open flash session is
+// ended, so a host that went away does not keep the target locked
+#ifndef VENDOR_FLASH_IDLE_MS
+#define VENDOR_FLASH_IDLE_MS        5000
+#endif
+
+// Performance counter selectors, values below PERF_TIMER_COUNT select a timer
+#define PERF_SELECT_EVENTS          0x80
+#define PERF_SELECT_RESET           0xFF
+
+#if (DAP_VENDOR_FLASH != 0)
+// Target flash programming session driven through the vendor commands
+typedef struct {
+    bool open;
+    bool page_dirty;
+    uint32_t page_addr;
+    // Run of pages programmed since they were last erased.  Programming
+    // one of them again is rejected instead of writing the page twice.
+    uint32_t programmed_start;
+    uint32_t programmed_end;
+    mem_stream_t stream;
+} flash_session_t;
+
+// Target programming expects buffer
+// passed in to be 4 byte aligned
+__attribute__((aligned(4)))
+static uint8_t flash_page[FLASH_PAGE_SIZE];
+static flash_session_t flash_session;
+#endif
 
 void main_identification_led(uint16_t time);
 
+static uint32_t get_uint32(const uint8_t *buf)
+{
+    return ((uint32_t)buf[0] << 0) | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+// Process memory read command and prepare response
+//   request:  address (U32), length (U32), zero length continues the stream
+//   response: status (U8), count (U8), data (count bytes)
+//   return:   number of bytes in response
+static uint32_t vendor_memory_read(uint8_t *request, uint8_t *response)
+{
+    uint32_t length = get_uint32(request + 5);
+    uint32_t count;
+
+    if (length != 0) {
+        mem_read_stream.address = get_uint32(request + 1);
+        mem_read_stream.remaining = length;
+    }
+
+    count = mem_read_stream.remaining;
+    if (count > DAP_PACKET_SIZE - MEM_RESPONSE_HEADER_SIZE) {
+        count = DAP_PACKET_SIZE - MEM_RESPONSE_HEADER_SIZE;
+    }
+
+    response[1] = DAP_OK;
+    if ((count > 0) && !swd_read_memory(mem_read_stream.address, response + MEM_RESPONSE_HEADER_SIZE, count)) {
+        // Abort the stream so the host has to restart it explicitly
+        mem_read_stream.remaining = 0;
+        response[1] = DAP_ERROR;
+        count = 0;
+    }
+
+    mem_read_stream.address += count;
+    mem_read_stream.remaining -= count;
+    response[2] = count;
+    return MEM_RESPONSE_HEADER_SIZE + count;
+}
+
+// Process memory write command and prepare response
+//   request:  address (U32), length (U32), zero length continues the stream,
+//             count (U8), data (count bytes)
+//   response: status (U8), count (U8) of bytes written
+//   return:   number of bytes in response
+static uint32_t vendor_memory_write(uint8_t *request, uint8_t *response)
+{
+    uint32_t length = get_uint32(request + 5);
+    uint32_t count = request[9];
+
+    if (length != 0) {
+        mem_write_stream.address = get_uint32(request + 1);
+        mem_write_stream.remaining = length;
+    }
+
+    response[1] = DAP_OK;
+    if ((count > DAP_PACKET_SIZE - MEM_WRITE_REQUEST_HEADER_SIZE) || (count > mem_write_stream.remaining)) {
+        response[1] = DAP_ERROR;
+        count = 0;
+    } else if ((count > 0) && !swd_write_memory(mem_write_stream.address, request + MEM_WRITE_REQUEST_HEADER_SIZE, count)) {
+        mem_write_stream.remaining = 0;
+        response[1] = DAP_ERROR;
+        count = 0;
+    }
+
+    mem_write_stream.address += count;
+    mem_write_stream.remaining -= count;
+    response[2] = count;
+    return MEM_RESPONSE_HEADER_SIZE;
+}
+
+#if (DAP_VENDOR_FLASH != 0)
+static bool flash_range_valid(uint32_t addr, uint32_t size)
+{
+    const target_cfg_t *const cfg = &target_device[targetID];
+    return (addr >= cfg->flash_start) && (addr < cfg->flash_end) &&
+           (size <= cfg->flash_end - addr);
+}
+
+static bool flash_page_programmed(uint32_t addr)
+{
+    return (addr >= flash_session.programmed_start) && (addr < flash_session.programmed_end);
+}
+
+static error_t flash_page_flush(void)
+{
+    error_t status = ERROR_SUCCESS;
+
+    if (flash_session.page_dirty) {
+        status = flash_intf_target->program_page(flash_session.page_addr, flash_page, FLASH_PAGE_SIZE);
+        flash_session.page_dirty = false;
+
+        if (flash_session.page_addr != flash_session.programmed_end) {
+            flash_session.programmed_start = flash_session.page_addr;
+        }
+        flash_session.programmed_end = flash_session.page_addr + FLASH_PAGE_SIZE;
+        flash_session.page_addr = FLASH_PAGE_INVALID;
+    }
+
+    return status;
+}
+
+// Write out the buffered page and release the target
+static error_t flash_session_end(void)
+{
+    error_t write_status;
+    error_t uninit_status;
+
+    // Close the flash interface even if the last page failed
+    write_status = flash_page_flush();
+    uninit_status = flash_intf_target->uninit();
+    flash_session.open = false;
+    flash_session.stream.remaining = 0;
+
+    return (ERROR_SUCCESS != write_status) ? write_status : uninit_status;
+}
+
+// Process flash init command and prepare response
+//   request:  none
+//   response: status (error_t)
+//   return:   number of bytes in response
+static uint32_t vendor_flash_init(uint8_t *request, uint8_t *response)
+{
+    error_t status;
+
+    // A new session replaces one left open by a host that went away
+    if (flash_session.open) {
+        flash_session_end();
+    }
+
+    // Own the target before detecting it so a running transfer is not
+    // disturbed.  Init keeps its own hold on the lock until uninit.
+    if (!target_flash_lock(0)) {
+        response[1] = ERROR_TARGET_BUSY;
+        return 2;
+    }
+
+    if (targetID == Target_UNKNOWN) {
+        targetID = swd_init_get_target();
+    }
+
+    status = flash_intf_target->init();
+    target_flash_unlock();
+    if (ERROR_SUCCESS == status) {
+        util_assert(flash_intf_target->program_page_min_size(target_device[targetID].flash_start) <= FLASH_PAGE_SIZE);
+        flash_session.open = true;
+        flash_session.page_dirty = false;
+        flash_session.page_addr = FLASH_PAGE_INVALID;
+        flash_session.programmed_start = 0;
+        flash_session.programmed_end = 0;
+        flash_session.stream.remaining = 0;
+    }
+
+    response[1] = status;
+    return 2;
+}
+
+// Process flash erase command and prepare response
+//   request:  address (U32), length (U32)
+//   response: status (error_t)
+//   return:   number of bytes in response
+static uint32_t vendor_flash_erase(uint8_t *request, uint8_t *response)
+{
+    const target_cfg_t *const cfg = &target_device[targetID];
+    uint32_t addr = get_uint32(request + 1);
+    uint32_t start;
+    uint32_t end = addr + get_uint32(request + 5);
+    uint32_t sector;
+    error_t status = ERROR_SUCCESS;
+
+    if (!flash_session.open) {
+        status = ERROR_INTERNAL;
+    } else if (!flash_range_valid(addr, end - addr)) {
+        status = ERROR_TARGET_OUT_OF_BOUNDS;
+    }
+
+    // Erase every sector touched by the range
+    start = (ERROR_SUCCESS == status) ? cfg->get_sector_address(cfg->get_sector_number(addr)) : addr;
+    while ((ERROR_SUCCESS == status) && (addr < end)) {
+        sector = cfg->get_sector_number(addr);
+        status = flash_intf_target->erase_sector(sector);
+        addr = cfg->get_sector_address(sector) + cfg->get_sector_length(sector);
+    }
+
+    // Erased pages may be programmed again.  If the erase splits the
+    // programmed run only the part below it is kept.
+    if ((start < flash_session.programmed_end) && (addr > flash_session.programmed_start)) {
+        if (start > flash_session.programmed_start) {
+            flash_session.programmed_end = start;
+        } else if (addr < flash_session.programmed_end) {
+            flash_session.programmed_start = addr;
+        } else {
+            flash_session.programmed_start = 0;
+            flash_session.programmed_end = 0;
+        }
+    }
+
+    response[1] = status;
+    return 2;
+}
+
+// Process flash program command and prepare response
+//   request:  address (U32), length (U32), zero length continues the stream,
+//             count (U8), data (count bytes)
+//   response: status (error_t), count (U8) of bytes accepted
+//   return:   number of bytes in response
+static uint32_t vendor_flash_program(uint8_t *request, uint8_t *response)
+{
+    mem_stream_t *const stream = &flash_session.stream;
+    uint32_t length = get_uint32(request + 5);
+    uint32_t count = request[9];
+    const uint8_t *data = request + MEM_WRITE_REQUEST_HEADER_SIZE;
+    uint32_t copy_size;
+    uint32_t pos;
+    error_t status = ERROR_SUCCESS;
+
+    if (!flash_session.open) {
+        status = ERROR_INTERNAL;
+    } else if (length != 0) {
+        if (flash_range_valid(get_uint32(request + 1), length)) {
+            stream->address = get_uint32(request + 1);
+            stream->remaining = length;
+        } else {
+            status = ERROR_TARGET_OUT_OF_BOUNDS;
+        }
+    }
+
+    if ((ERROR_SUCCESS == status) &&
+            ((count > DAP_PACKET_SIZE - MEM_WRITE_REQUEST_HEADER_SIZE) || (count > stream->remaining))) {
+        status = ERROR_INTERNAL;
+    }
+
+    response[2] = 0;
+    while ((ERROR_SUCCESS == status) && (count > 0)) {
+        // Move to the page containing the next byte
+        if (ROUND_DOWN(stream->address, FLASH_PAGE_SIZE) != flash_session.page_addr) {
+            status = flash_page_flush();
+            if (ERROR_SUCCESS != status) {
+                break;
+            }
+            flash_session.page_addr = ROUND_DOWN(stream->address, FLASH_PAGE_SIZE);
+            if (flash_page_programmed(flash_session.page_addr)) {
+                flash_session.page_addr = FLASH_PAGE_INVALID;
+                status = ERROR_FLASH_ORDER;
+                break;
+            }
+            memset(flash_page, 0xFF, sizeof(flash_page));
+        }
+
+        pos = stream->address - flash_session.page_addr;
+        copy_size = MIN(count, FLASH_PAGE_SIZE - pos);
+        memcpy(flash_page + pos, data, copy_size);
+        flash_session.page_dirty = true;
+        stream->address += copy_size;
+        stream->remaining -= copy_size;
+        data += copy_size;
+        count -= copy_size;
+        response[2] += copy_size;
+
+        // A partial page stays buffered so a following stream can complete
+        // it, it is written out when the session moves on or ends
+        if (FLASH_PAGE_SIZE == pos + copy_size) {
+            status = flash_page_flush();
+        }
+    }
+
+    if (ERROR_SUCCESS != status) {
+        stream->remaining = 0;
+    }
+
+    response[1] = status;
+    return 3;
+}
+
+// Process flash verify command and prepare response
+//   request:  address (U32), length (U32), expected CRC32 (U32)
+//   response: status (error_t), CRC32 (U32) of the target flash contents
+//   return:   number of bytes in response
+static uint32_t vendor_flash_verify(uint8_t *request, uint8_t *response)
+{
+    uint32_t addr = get_uint32(request + 1);
+    uint32_t size = get_uint32(request + 5);
+    uint32_t crc = 0;
+    uint32_t read_size;
+    error_t status = ERROR_SUCCESS;
+
+    if (!flash_session.open) {
+        status = ERROR_INTERNAL;
+    } else if (!flash_range_valid(addr, size)) {
+        status = ERROR_TARGET_OUT_OF_BOUNDS;
+    } else {
+        // Pending data must reach the target before it is read back, the
+        // page buffer is then reused as the read buffer
+        status = flash_page_flush();
+    }
+
+    while ((ERROR_SUCCESS == status) && (size > 0)) {
+        read_size = MIN(size, sizeof(flash_page));
+        if (!swd_read_memory(addr, flash_page, read_size)) {
+            status = ERROR_ALGO_DATA_SEQ;
+            break;
+        }
+        crc = crc32_continue(crc, flash_page, read_size);
+        addr += read_size;
+        size -= read_size;
+    }
+
+    if ((ERROR_SUCCESS == status) && (crc != get_uint32(request + 9))) {
+        status = ERROR_WRITE;
+    }
+
+    response[1] = status;
+    response[2] = (crc >> 0) & 0xFF;
+    response[3] = (crc >> 8) & 0xFF;
+    response[4] = (crc >> 16) & 0xFF;
+    response[5] = (crc >> 24) & 0xFF;
+    return 6;
+}
+
+// Process flash uninit command and prepare response
+//   request:  none
+//   response: status (error_t)
+//   return:   number of bytes in response
+static uint32_t vendor_flash_uninit(uint8_t *request, uint8_t *response)
+{
+    if (!flash_session.open) {
+        response[1] = ERROR_INTERNAL;
+        return 2;
+    }
+
+    response[1] = flash_session_end();
+    return 2;
+}
+#endif
+
+// True while a vendor flash session owns the target
+static bool vendor_flash_open(void)
+{
+#if (DAP_VENDOR_FLASH != 0)
+    return flash_session.open;
+#else
+    return false;
+#endif
+}
+
+uint16_t DAP_VendorIdleTicks(void)
+{
+    return vendor_flash_open() ? (VENDOR_FLASH_IDLE_MS * 1000 / os_clockrate) : 0xFFFF;
+}
+
+void DAP_VendorFlashEnd(void)
+{
+#if (DAP_VENDOR_FLASH != 0)
+    if (flash_session.open) {
+        flash_session_end();
+    }
+#endif
+}
+
+static uint32_t put_uint32(uint8_t *buf, uint32_t value)
+{
+    buf[0] = (value >> 0) & 0xFF;
+    buf[1] = (value >> 8) & 0xFF;
+    buf[2] = (value >> 16) & 0xFF;
+    buf[3] = (value >> 24) & 0xFF;
+    return 4;
+}
+
+// Process performance counter command and prepare response
+//   request:  selector (U8), a timer, PERF_SELECT_EVENTS or PERF_SELECT_RESET
+//   response: status (U8), then for a timer count, min, max (U32) and
+//             total (U64) in cycles, for events the cycle clock (U32),
+//             event count (U8) and the counters (U32 each)
+//   return:   number of bytes in response
+static uint32_t vendor_perf_counters(uint8_t *request, uint8_t *response)
+{
+    uint8_t select = request[1];
+    uint32_t idx = 2;
+    uint32_t i;
+
+    response[1] = DAP_OK;
+
+    if (select < PERF_TIMER_COUNT) {
+        const perf_stat_t *stat = perf_get_stat((perf_timer_t)select);
+        idx += put_uint32(response + idx, stat->count);
+        idx += put_uint32(response + idx, stat->count ? stat->min : 0);
+        idx += put_uint32(response + idx, stat->max);
+        idx += put_uint32(response + idx, (uint32_t)(stat->total >> 0));
+        idx += put_uint32(response + idx, (uint32_t)(stat->total >> 32));
+    } else if (PERF_SELECT_EVENTS == select) {
+        idx += put_uint32(response + idx, perf_get_clock());
+        response[idx++] = PERF_EVENT_COUNT;
+        for (i = 0; i < PERF_EVENT_COUNT; i++) {
+            idx += put_uint32(response + idx, perf_events[i]);
+        }
+    } else if (PERF_SELECT_RESET == select) {
+        perf_reset();
+    } else {
+        response[1] = DAP_ERROR;
+    }
+
+    return idx;
+}
+
+#if (DAP_JTAG != 0)
+// Process JTAG scan chain detection command and prepare response
+// The detected chain replaces any configuration set by DAP_JTAG_Configure
+//   request:  none
+//   response: status (U8), device count (U8), then for each device
+//             IR length (U8) and IDCODE (U32, 0 for BYPASS only devices)
+//   return:   number of bytes in response
+static uint32_t vendor_jtag_detect(uint8_t *request, uint8_t *response)
+{
+    uint32_t idcode[DAP_JTAG_DEV_CNT];
+    uint32_t count;
+    uint32_t idx = 3;
+    uint32_t i;
+
+    response[1] = DAP_ERROR;
+    response[2] = 0;
+
+    if (DAP_PORT_JTAG != DAP_Data.debug_port) {
+        return idx;
+    }
+
+    count = JTAG_DetectChain(idcode, DAP_JTAG_DEV_CNT);
+    if (0 == count) {
+        return idx;
+    }
+
+    response[1] = DAP_OK;
+    response[2] = count;
+    for (i = 0; i < count; i++) {
+        response[idx++] = DAP_Data.jtag_dev.ir_length[i];
+        idx += put_uint32(response + idx, idcode[i]);
+    }
+
+    return idx;
+}
+#endif
+
 // Process DAP Vendor command and prepare response
 // Default function (can be overridden)
 //   request:  pointer to request data
@@ -63,10 +563,16 @@ uint32_t DAP_ProcessVendorCommand(uint8_t *request, uint8_t *response)
     }
     // get CPU type command
     else if (*request == ID_DAP_Vendor1) {
-        uint8_t targetID = swd_init_get_target();
+        uint8_t id = targetID;
+
+        // Detection resets the target so report the known one while it is in use
+        if (!vendor_flash_open() && target_flash_lock(0)) {
+            id = swd_init_get_target();
+            target_flash_unlock();
+        }
 
         *response = ID_DAP_Vendor1;
-        *(response + 1) = targetID;
+        *(response + 1) = id;
         return 2;
     }
     else if (*request == ID_DAP_Vendor2) {
@@ -77,7 +583,52 @@ uint32_t DAP_ProcessVendorCommand(uint8_t *request, uint8_t *response)
         *(response + 1) = 16;
         memcpy(response + 2, (uint8_t *)fullUniqueId, 16);
         return (16 + 2);
-    }    
+    }
+    // read target memory command
+    else if (*request == ID_DAP_Vendor3) {
+        *response = ID_DAP_Vendor3;
+        return vendor_memory_read(request, response);
+    }
+    // write target memory command
+    else if (*request == ID_DAP_Vendor4) {
+        *response = ID_DAP_Vendor4;
+        return vendor_memory_write(request, response);
+    }
+#if (DAP_VENDOR_FLASH != 0)
+    // target flash programming commands
+    else if (*request == ID_DAP_Vendor5) {
+        *response = ID_DAP_Vendor5;
+        return vendor_flash_init(request, response);
+    }
+    else if (*request == ID_DAP_Vendor6) {
+        *response = ID_DAP_Vendor6;
+        return vendor_flash_erase(request, response);
+    }
+    else if (*request == ID_DAP_Vendor7) {
+        *response = ID_DAP_Vendor7;
+        return vendor_flash_program(request, response);
+    }
+    else if (*request == ID_DAP_Vendor9) {
+        *response = ID_DAP_Vendor9;
+        return vendor_flash_verify(request, response);
+    }
+    else if (*request == ID_DAP_Vendor10) {
+        *response = ID_DAP_Vendor10;
+        return vendor_flash_uninit(request, response);
+    }
+#endif
+    // performance counter command
+    else if (*request == ID_DAP_Vendor11) {
+        *response = ID_DAP_Vendor11;
+        return vendor_perf_counters(request, response);
+    }
+#if (DAP_JTAG != 0)
+    // JTAG scan chain detection command
+    else if (*request == ID_DAP_Vendor12) {
+        *response = ID_DAP_Vendor12;
+        return vendor_jtag_detect(request, response);
+    }
+#endif
     else if (*request == ID_DAP_Vendor31) {
         uint16_t time = request[1]  | (request[2] << 8) ;
         main_identification_led(time);
@@ -20,6 +20,7 @@
  */
 
 #include "string.h"
+#include "stdbool.h"
 #include "RTL.h"
 #include "rl_usb.h"
 #include "usb.h"
@@ -54,7 +55,8 @@ static OS_MUT hid_mutex;
 // Only used by HID out thread
 static uint32_t recv_idx;
 
-// Only used by hid_process
+// Only used by hid_process, and by the HID out thread
+// while nothing is queued
 static uint32_t proc_idx;
 
 // Used by hid_process and HID out thread
@@ -62,6 +64,48 @@ static uint32_t proc_idx;
 static uint32_t send_idx;
 static volatile uint8_t  USB_ResponseIdle;
 
+// Commands that complete in bounded time without touching the debug
+// port.  These are executed directly by the HID out thread when no other
+// request is queued, skipping the round trip through hid_process.
+static bool dap_command_is_fast(const uint8_t *request)
+{
+    switch (request[0]) {
+        case ID_DAP_Info:
+        case ID_DAP_HostStatus:
+        case ID_DAP_TransferConfigure:
+        case ID_DAP_SWJ_Clock:
+        case ID_DAP_SWD_Configure:
+        case ID_DAP_JTAG_Configure:
+        case ID_DAP_Vendor0:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Execute a fast command in place of the HID out thread.  Must be called
+// with the HID lock held and a free buffer taken from free_sem.
+static void hid_process_fast(uint8_t *request)
+{
+    DAP_ProcessCommand(request, USB_Request[recv_idx]);
+    recv_idx = (recv_idx + 1) % DAP_PACKET_COUNT;
+    proc_idx = (proc_idx + 1) % DAP_PACKET_COUNT;
+    os_sem_send(&send_sem);
+
+    // Arm the input report right away if USB is idle, otherwise
+    // usbd_hid_get_report sends it when the current report completes
+    if (USB_ResponseIdle) {
+        os_sem_wait(&send_sem, 0);
+        usbd_hid_get_report_trigger(0, USB_Request[send_idx], DAP_PACKET_SIZE);
+        send_idx = (send_idx + 1) % DAP_PACKET_COUNT;
+        os_sem_send(&free_sem);
+        USB_ResponseIdle = 0;
+    }
+
+    main_blink_hid_led(MAIN_LED_FLASH);
+}
+
 // USB HID Callback: when system initializes
 void usbd_hid_init(void)
 {
@@ -128,6 +172,20 @@ void usbd_hid_set_report(U8 rtype, U8 rid, U8 *buf, int len, U8 req)
             // Store data into request packet buffer
             // If there are no free buffers discard the data
             if (os_sem_wait(&free_sem, 0) == OS_R_OK) {
+                if (dap_command_is_fast(buf)) {
+                    os_mut_wait(&hid_mutex, 0xFFFF);
+
+                    // Responses must stay in order so only take the fast
+                    // path when every buffer is free (nothing is queued)
+                    if (recv_idx == send_idx) {
+                        hid_process_fast(buf);
+                        os_mut_release(&hid_mutex);
+                        break;
+                    }
+
+                    os_mut_release(&hid_mutex);
+                }
+
                 memcpy(USB_Request[recv_idx], buf, len);
                 recv_idx = (recv_idx + 1) % DAP_PACKET_COUNT;
                 os_sem_send(&proc_sem);
@@ -162,8 +220,13 @@ void hid_send_packet(void)
 __task void hid_process(void *argv)
 {
     while (1) {
-        // Process DAP Command
-        os_sem_wait(&proc_sem, 0xFFFF);
+        // Process DAP Command.  While a vendor flash session holds the
+        // target it is ended if the host sends nothing for a while.
+        if (os_sem_wait(&proc_sem, DAP_VendorIdleTicks()) == OS_R_TMO) {
+            DAP_VendorFlashEnd();
+            continue;
+        }
+
         DAP_ProcessCommand(USB_Request[proc_idx], temp_buf);
         memcpy(USB_Request[proc_idx], temp_buf, DAP_PACKET_SIZE);
         proc_idx = (proc_idx + 1) % DAP_PACKET_COUNT;
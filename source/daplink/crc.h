@@ -31,6 +31,11 @@ uint16_t crc16(const void *data, int nBytes);
 uint32_t crc32(const void *data, int nBytes);
 uint32_t crc32_continue(uint32_t prev_crc, const void *data, int nBytes);
 
+// Incremental CRC32, crc32_final(crc32_update(crc32_init(), d, n)) == crc32(d, n)
+uint32_t crc32_init(void);
+uint32_t crc32_update(uint32_t remainder, const void *data, uint32_t nBytes);
+uint32_t crc32_final(uint32_t remainder);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,68 @@
+/**
+ * @file    delay.c
+ * @brief   Implementation of delay.h
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RTL.h"
+#include "RTX_Config.h"
+#include "delay.h"
+#include "perf_counter.h"
+#include "util.h"
+
+// Length of an RTX tick in microseconds
+extern U32 const os_clockrate;
+
+// Convert microseconds to cycles of perf_get_cycles
+static uint32_t us_to_cycles(uint32_t us)
+{
+    util_assert(us <= DELAY_MAX_US);
+    return (uint32_t)(((uint64_t)perf_get_clock() * us + 999999) / 1000000);
+}
+
+void delay_us(uint32_t us)
+{
+    uint32_t start = perf_get_cycles();
+    uint32_t cycles = us_to_cycles(us);
+
+    while (perf_get_cycles() - start < cycles);
+}
+
+void delay_sleep_us(uint32_t us)
+{
+    uint32_t start = perf_get_cycles();
+    uint32_t cycles = us_to_cycles(us);
+    uint32_t ticks = us / os_clockrate;
+
+    // The first tick may be short so the rest is spun
+    if (ticks > 0) {
+        os_dly_wait(ticks);
+    }
+
+    while (perf_get_cycles() - start < cycles);
+}
+
+uint32_t delay_timeout_start(void)
+{
+    return perf_get_cycles();
+}
+
+bool delay_timeout_expired(uint32_t start, uint32_t us)
+{
+    return perf_get_cycles() - start >= us_to_cycles(us);
+}
@@ -0,0 +1,56 @@
+/**
+ * @file    delay.h
+ * @brief   Calibrated microsecond delays and timeouts
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DELAY_H
+#define DELAY_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Delays are measured with perf_get_cycles so they do not depend on the
+// compiler or the RTX tick.  On Cortex-M0 the cycle count is extended by
+// the RTX tick count so with interrupts disabled they must stay below a tick.
+
+// Longest delay or timeout supported
+#define DELAY_MAX_US    (10UL * 1000 * 1000)
+
+// Busy wait for at least us microseconds
+void delay_us(uint32_t us);
+
+// Wait for at least us microseconds, sleeping for the whole RTX ticks in
+// it so other tasks can run.  Must be called from a task.
+void delay_sleep_us(uint32_t us);
+
+// Start a timeout, pass the returned value to delay_timeout_expired
+uint32_t delay_timeout_start(void);
+
+// Return true once us microseconds have passed since start
+bool delay_timeout_expired(uint32_t start, uint32_t us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,10 +26,13 @@
 #include "validation.h"
 #include "macro.h"
 #include "intelhex.h"
+#include "srec.h"
 #include "flash_decoder.h"
 #include "error.h"
 #include "RTL.h"
 #include "compiler.h"
+#include "target_config.h"
+#include "target_ids.h"
 
 
 typedef enum {
@@ -62,9 +65,55 @@ typedef struct {
     uint8_t bin_buffer[256];
 } hex_state_t;
 
+// Largest UF2 block count for which the end of the file is detected.
+// Bigger files end when the host stops writing like other file types.
+#define UF2_BLOCK_MAP_BITS          2048
+
+typedef struct {
+    uint32_t num_blocks;            // Total number of blocks in the file
+    uint32_t blocks_seen;           // Number of distinct blocks processed
+    uint32_t family_id;             // Family of the target, 0 to accept any
+    uint32_t block_map[UF2_BLOCK_MAP_BITS / 32];    // Blocks processed
+} uf2_state_t;
+
+typedef struct {
+    bool parsing_complete;
+    uint8_t bin_buffer[256];
+} srec_state_t;
+
+// Largest number of loadable segments an ELF file can have
+#define ELF_MAX_SEGMENTS            8
+// Size of an ELF32 file header, the largest header that is collected
+#define ELF_HEADER_SIZE             52
+
+typedef struct {
+    uint32_t offset;                // Offset of the segment data in the file
+    uint32_t size;                  // Number of bytes of the segment in the file
+    uint32_t addr;                  // Physical address the segment is programmed to
+} elf_segment_t;
+
+typedef struct {
+    uint32_t file_offset;           // Offset in the file of the next byte written
+    uint32_t collect_offset;        // File offset of the header being collected
+    uint32_t collect_size;          // Size of the header being collected
+    uint32_t collect_pos;           // Number of header bytes collected so far
+    uint32_t ph_offset;             // File offset of the program header table
+    uint16_t ph_entry_size;         // Size of a program header
+    uint16_t ph_count;              // Number of program headers
+    uint16_t ph_index;              // Program header being collected
+    uint8_t segment_count;          // Number of entries in segments
+    bool headers_complete;          // All program headers have been decoded
+    uint32_t end_offset;            // File offset after the last segment
+    elf_segment_t segments[ELF_MAX_SEGMENTS];
+    uint8_t header[ELF_HEADER_SIZE];
+} elf_state_t;
+
 typedef union {
     bin_state_t bin;
     hex_state_t hex;
+    uf2_state_t uf2;
+    srec_state_t srec;
+    elf_state_t elf;
 } shared_state_t;
 
 static bool detect_bin(const uint8_t *data, uint32_t size);
@@ -77,9 +126,27 @@ static error_t open_hex(void *state);
 static error_t write_hex(void *state, const uint8_t *data, uint32_t size);
 static error_t close_hex(void *state);
 
+static bool detect_uf2(const uint8_t *data, uint32_t size);
+static error_t open_uf2(void *state);
+static error_t write_uf2(void *state, const uint8_t *data, uint32_t size);
+static error_t close_uf2(void *state);
+
+static bool detect_srec(const uint8_t *data, uint32_t size);
+static error_t open_srec(void *state);
+static error_t write_srec(void *state, const uint8_t *data, uint32_t size);
+static error_t close_srec(void *state);
+
+static bool detect_elf(const uint8_t *data, uint32_t size);
+static error_t open_elf(void *state);
+static error_t write_elf(void *state, const uint8_t *data, uint32_t size);
+static error_t close_elf(void *state);
+
 stream_t stream[] = {
     {detect_bin, open_bin, write_bin, close_bin},   // STREAM_TYPE_BIN
     {detect_hex, open_hex, write_hex, close_hex},   // STREAM_TYPE_HEX
+    {detect_uf2, open_uf2, write_uf2, close_uf2},   // STREAM_TYPE_UF2
+    {detect_srec, open_srec, write_srec, close_srec},   // STREAM_TYPE_SREC
+    {detect_elf, open_elf, write_elf, close_elf},   // STREAM_TYPE_ELF
 };
 COMPILER_ASSERT(ELEMENTS_IN_ARRAY(stream) == STREAM_TYPE_COUNT);
 // STREAM_TYPE_NONE must not be included in count
@@ -121,6 +188,13 @@ stream_type_t stream_type_from_name(const vfs_filename_t filename)
         return STREAM_TYPE_BIN;
     } else if (0 == strncmp("HEX", &filename[8], 3)) {
         return STREAM_TYPE_HEX;
+    } else if (0 == strncmp("UF2", &filename[8], 3)) {
+        return STREAM_TYPE_UF2;
+    } else if ((0 == strncmp("SRE", &filename[8], 3)) || (0 == strncmp("S19", &filename[8], 3)) ||
+               (0 == strncmp("S28", &filename[8], 3)) || (0 == strncmp("S37", &filename[8], 3))) {
+        return STREAM_TYPE_SREC;
+    } else if ((0 == strncmp("ELF", &filename[8], 3)) || (0 == strncmp("AXF", &filename[8], 3))) {
+        return STREAM_TYPE_ELF;
     } else {
         return STREAM_TYPE_NONE;
     }
@@ -350,17 +424,469 @@ static error_t write_hex(void *state, const uint8_t *data, uint32_t size)
         } else if (HEX_PARSE_CKSUM_FAIL == parse_status) {
             status = ERROR_HEX_CKSUM;
             break;
-        } else if ((HEX_PARSE_UNINIT == parse_status) || (HEX_PARSE_FAILURE == parse_status)) {
+        } else if ((HEX_PARSE_UNINIT == parse_status) || (HEX_PARSE_FAILURE == parse_status) ||
+                   (HEX_PARSE_LINE_OVERRUN == parse_status)) {
             util_assert(HEX_PARSE_UNINIT != parse_status);
             status = ERROR_HEX_PARSER;
             break;
         }
     }
 
+    // Nothing is left to program after the end or an error
+    if (ERROR_SUCCESS != status) {
+        hex_state->parsing_complete = true;
+    }
+
     return status;
 }
 
 static error_t close_hex(void *state)
+{
+    error_t status = ERROR_SUCCESS;
+    error_t close_status;
+    hex_state_t *hex_state = (hex_state_t *)state;
+    uint32_t bin_start_address;
+    uint32_t bin_buf_written;
+
+    // Program the records still collected in the buffer
+    if (!hex_state->parsing_complete) {
+        flush_hex_parser(&bin_start_address, &bin_buf_written);
+
+        if (bin_buf_written > 0) {
+            status = flash_decoder_write(bin_start_address, hex_state->bin_buffer, bin_buf_written);
+        }
+    }
+
+    close_status = flash_decoder_close();
+    return (ERROR_SUCCESS != close_status) ? close_status : status;
+}
+
+/* UF2 file processing */
+
+// Every UF2 block fills exactly one 512 byte sector
+#define UF2_BLOCK_SIZE              512
+#define UF2_MAGIC_START0            0x0A324655  // "UF2\n"
+#define UF2_MAGIC_START1            0x9E5D5157
+#define UF2_MAGIC_END               0x0AB16F30
+#define UF2_FLAG_NOT_MAIN_FLASH     0x00000001
+#define UF2_FLAG_FILE_CONTAINER     0x00001000
+#define UF2_FLAG_FAMILY_ID          0x00002000
+#define UF2_MAX_PAYLOAD             476
+
+typedef struct {
+    uint32_t magic_start0;
+    uint32_t magic_start1;
+    uint32_t flags;
+    uint32_t target_addr;
+    uint32_t payload_size;
+    uint32_t block_no;
+    uint32_t num_blocks;
+    uint32_t family_id;             // File size when UF2_FLAG_FILE_CONTAINER is set
+    uint8_t data[UF2_MAX_PAYLOAD];
+    uint32_t magic_end;
+} uf2_block_t;
+COMPILER_ASSERT(sizeof(uf2_block_t) == UF2_BLOCK_SIZE);
+
+static bool uf2_block_valid(const uf2_block_t *block)
+{
+    return (UF2_MAGIC_START0 == block->magic_start0) &&
+           (UF2_MAGIC_START1 == block->magic_start1) &&
+           (UF2_MAGIC_END == block->magic_end);
+}
+
+static bool detect_uf2(const uint8_t *data, uint32_t size)
+{
+    if (size < UF2_BLOCK_SIZE) {
+        return false;
+    }
+
+    return uf2_block_valid((const uf2_block_t *)data);
+}
+
+static error_t open_uf2(void *state)
+{
+    error_t status;
+    uf2_state_t *uf2_state = (uf2_state_t *)state;
+    memset(uf2_state, 0, sizeof(*uf2_state));
+
+    if (targetID != Target_UNKNOWN) {
+        uf2_state->family_id = target_device[targetID].uf2_family_id;
+    }
+
+    status = flash_decoder_open();
+    return status;
+}
+
+static error_t write_uf2(void *state, const uint8_t *data, uint32_t size)
+{
+    error_t status;
+    uf2_state_t *uf2_state = (uf2_state_t *)state;
+    const uf2_block_t *block;
+    uint32_t bit;
+
+    // Blocks are sector aligned so data never arrives with a partial block
+    if (size % UF2_BLOCK_SIZE != 0) {
+        return ERROR_UF2_BLOCK;
+    }
+
+    for (; size > 0; data += UF2_BLOCK_SIZE, size -= UF2_BLOCK_SIZE) {
+        block = (const uf2_block_t *)data;
+
+        if (!uf2_block_valid(block) || (0 == block->num_blocks) ||
+                (block->block_no >= block->num_blocks) ||
+                (block->payload_size > UF2_MAX_PAYLOAD)) {
+            return ERROR_UF2_BLOCK;
+        }
+
+        // All blocks of a file must agree on the block count
+        if (0 == uf2_state->num_blocks) {
+            uf2_state->num_blocks = block->num_blocks;
+        } else if (block->num_blocks != uf2_state->num_blocks) {
+            return ERROR_UF2_BLOCK;
+        }
+
+        // A block sent again is passed on again, the flash manager skips
+        // it if it matches what was programmed, and is only counted once
+        if (block->block_no < UF2_BLOCK_MAP_BITS) {
+            bit = 1UL << (block->block_no % 32);
+            if (!(uf2_state->block_map[block->block_no / 32] & bit)) {
+                uf2_state->block_map[block->block_no / 32] |= bit;
+                uf2_state->blocks_seen++;
+            }
+        }
+
+        // Blocks meant for other memories, holding files or for another
+        // device family in a file combining several are skipped
+        if (!(block->flags & (UF2_FLAG_NOT_MAIN_FLASH | UF2_FLAG_FILE_CONTAINER)) &&
+                !((block->flags & UF2_FLAG_FAMILY_ID) && (0 != uf2_state->family_id) &&
+                  (block->family_id != uf2_state->family_id))) {
+            status = flash_decoder_write(block->target_addr, block->data, block->payload_size);
+
+            if (ERROR_SUCCESS_DONE == status) {
+                return ERROR_SUCCESS_DONE;
+            } else if (ERROR_SUCCESS != status) {
+                return status;
+            }
+        }
+
+        // The block count tells when the file is complete
+        if ((uf2_state->num_blocks <= UF2_BLOCK_MAP_BITS) &&
+                (uf2_state->blocks_seen >= uf2_state->num_blocks)) {
+            return ERROR_SUCCESS_DONE;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+static error_t close_uf2(void *state)
+{
+    error_t status;
+    status = flash_decoder_close();
+    return status;
+}
+
+/* Motorola S-record file processing */
+
+static bool srec_is_hex_digit(uint8_t c)
+{
+    return ((c >= '0') && (c <= '9')) || ((c >= 'A') && (c <= 'F')) || ((c >= 'a') && (c <= 'f'));
+}
+
+static bool detect_srec(const uint8_t *data, uint32_t size)
+{
+    // Files start with a header (S0) or data record. S4 is reserved.
+    if (size < 4) {
+        return false;
+    }
+
+    return ('S' == data[0]) && (data[1] >= '0') && (data[1] <= '9') && (data[1] != '4') &&
+           srec_is_hex_digit(data[2]) && srec_is_hex_digit(data[3]);
+}
+
+static error_t open_srec(void *state)
+{
+    error_t status;
+    srec_state_t *srec_state = (srec_state_t *)state;
+    memset(srec_state, 0, sizeof(*srec_state));
+    reset_srec_parser();
+    srec_state->parsing_complete = false;
+    status = flash_decoder_open();
+    return status;
+}
+
+static error_t write_srec(void *state, const uint8_t *data, uint32_t size)
+{
+    error_t status = ERROR_SUCCESS;
+    srec_state_t *srec_state = (srec_state_t *)state;
+    srecfile_parse_status_t parse_status;
+    uint32_t bin_start_address = 0; // Decoded from the file, the binary buffer data starts at this address
+    uint32_t bin_buf_written = 0;   // The amount of data in the binary buffer starting at address above
+    uint32_t block_amt_parsed = 0;  // amount of data parsed in the block on the last call
+
+    while (1) {
+        parse_status = parse_srec_blob(data, size, &block_amt_parsed, srec_state->bin_buffer, sizeof(srec_state->bin_buffer), &bin_start_address, &bin_buf_written);
+
+        if (SREC_PARSE_OK == parse_status) {
+            break;
+        } else if (SREC_PARSE_UNALIGNED == parse_status) {
+            if (bin_buf_written > 0) {
+                status = flash_decoder_write(bin_start_address, srec_state->bin_buffer, bin_buf_written);
+
+                if (ERROR_SUCCESS != status) {
+                    break;
+                }
+            }
+
+            size -= block_amt_parsed;
+            data += block_amt_parsed;
+        } else if (SREC_PARSE_EOF == parse_status) {
+            if (bin_buf_written > 0) {
+                status = flash_decoder_write(bin_start_address, srec_state->bin_buffer, bin_buf_written);
+            }
+
+            if (ERROR_SUCCESS == status) {
+                status = ERROR_SUCCESS_DONE;
+            }
+
+            break;
+        } else if (SREC_PARSE_CKSUM_FAIL == parse_status) {
+            status = ERROR_SREC_CKSUM;
+            break;
+        } else {
+            status = ERROR_SREC_PARSER;
+            break;
+        }
+    }
+
+    // Nothing is left to program after the end or an error
+    if (ERROR_SUCCESS != status) {
+        srec_state->parsing_complete = true;
+    }
+
+    return status;
+}
+
+static error_t close_srec(void *state)
+{
+    error_t status = ERROR_SUCCESS;
+    error_t close_status;
+    srec_state_t *srec_state = (srec_state_t *)state;
+    uint32_t bin_start_address;
+    uint32_t bin_buf_written;
+
+    // Program the records still collected in the buffer for files
+    // without a termination record
+    if (!srec_state->parsing_complete) {
+        flush_srec_parser(&bin_start_address, &bin_buf_written);
+
+        if (bin_buf_written > 0) {
+            status = flash_decoder_write(bin_start_address, srec_state->bin_buffer, bin_buf_written);
+        }
+    }
+
+    close_status = flash_decoder_close();
+    return (ERROR_SUCCESS != close_status) ? close_status : status;
+}
+
+/* ELF file processing */
+
+#define ELF_CLASS_32                1
+#define ELF_DATA_LSB                1
+#define ELF_PT_LOAD                 1
+
+typedef struct {
+    uint8_t ident[16];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint32_t entry;
+    uint32_t ph_offset;
+    uint32_t sh_offset;
+    uint32_t flags;
+    uint16_t header_size;
+    uint16_t ph_entry_size;
+    uint16_t ph_count;
+    uint16_t sh_entry_size;
+    uint16_t sh_count;
+    uint16_t sh_string_index;
+} elf32_header_t;
+COMPILER_ASSERT(sizeof(elf32_header_t) == ELF_HEADER_SIZE);
+
+typedef struct {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t file_size;
+    uint32_t mem_size;
+    uint32_t flags;
+    uint32_t align;
+} elf32_program_header_t;
+
+static bool detect_elf(const uint8_t *data, uint32_t size)
+{
+    if (size < ELF_HEADER_SIZE) {
+        return false;
+    }
+
+    return (0x7F == data[0]) && ('E' == data[1]) && ('L' == data[2]) && ('F' == data[3]) &&
+           (ELF_CLASS_32 == data[4]) && (ELF_DATA_LSB == data[5]);
+}
+
+static error_t open_elf(void *state)
+{
+    error_t status;
+    elf_state_t *elf_state = (elf_state_t *)state;
+    memset(elf_state, 0, sizeof(*elf_state));
+    // Start by collecting the file header
+    elf_state->collect_offset = 0;
+    elf_state->collect_size = ELF_HEADER_SIZE;
+    status = flash_decoder_open();
+    return status;
+}
+
+// Set up collection of the next program header
+static void elf_collect_next_ph(elf_state_t *elf_state)
+{
+    elf_state->collect_offset = elf_state->ph_offset + elf_state->ph_index * elf_state->ph_entry_size;
+    elf_state->collect_size = sizeof(elf32_program_header_t);
+    elf_state->collect_pos = 0;
+}
+
+// Decode the header in elf_state->header once it has been collected
+static error_t elf_header_collected(elf_state_t *elf_state)
+{
+    elf32_header_t file_header;
+    elf32_program_header_t ph;
+    elf_segment_t *segment;
+    uint32_t i;
+
+    if (0 == elf_state->ph_count) {
+        memcpy(&file_header, elf_state->header, sizeof(file_header));
+
+        if (!detect_elf(elf_state->header, ELF_HEADER_SIZE) || (0 == file_header.ph_count) ||
+                (file_header.ph_entry_size < sizeof(elf32_program_header_t))) {
+            return ERROR_ELF_HEADER;
+        }
+
+        elf_state->ph_offset = file_header.ph_offset;
+        elf_state->ph_entry_size = file_header.ph_entry_size;
+        elf_state->ph_count = file_header.ph_count;
+        elf_state->ph_index = 0;
+        elf_collect_next_ph(elf_state);
+        return ERROR_SUCCESS;
+    }
+
+    memcpy(&ph, elf_state->header, sizeof(ph));
+
+    // Only the file contents of loadable segments are programmed. Zero
+    // filled memory and sections outside of segments are skipped.
+    if ((ELF_PT_LOAD == ph.type) && (ph.file_size > 0)) {
+        if (elf_state->segment_count >= ELF_MAX_SEGMENTS) {
+            return ERROR_ELF_HEADER;
+        }
+
+        segment = &elf_state->segments[elf_state->segment_count++];
+        segment->offset = ph.offset;
+        segment->size = ph.file_size;
+        segment->addr = ph.paddr;
+        elf_state->end_offset = MAX(elf_state->end_offset, ph.offset + ph.file_size);
+    }
+
+    elf_state->ph_index++;
+
+    if (elf_state->ph_index < elf_state->ph_count) {
+        elf_collect_next_ph(elf_state);
+        return ERROR_SUCCESS;
+    }
+
+    if (0 == elf_state->segment_count) {
+        return ERROR_ELF_HEADER;
+    }
+
+    // Data is only seen once so every segment must come after the
+    // program headers
+    for (i = 0; i < elf_state->segment_count; i++) {
+        if (elf_state->segments[i].offset < elf_state->file_offset) {
+            return ERROR_ELF_SEGMENT_ORDER;
+        }
+    }
+
+    elf_state->headers_complete = true;
+    return ERROR_SUCCESS;
+}
+
+static error_t write_elf(void *state, const uint8_t *data, uint32_t size)
+{
+    error_t status;
+    elf_state_t *elf_state = (elf_state_t *)state;
+    const elf_segment_t *segment;
+    uint32_t data_end;
+    uint32_t start;
+    uint32_t end;
+    uint32_t copy_size;
+    uint32_t i;
+
+    // Collect the file and program headers
+    while (!elf_state->headers_complete && (size > 0)) {
+        start = elf_state->collect_offset + elf_state->collect_pos;
+
+        if (elf_state->file_offset < start) {
+            // Skip data up to the next header
+            copy_size = MIN(size, start - elf_state->file_offset);
+        } else if (elf_state->file_offset == start) {
+            copy_size = MIN(size, elf_state->collect_size - elf_state->collect_pos);
+            memcpy(&elf_state->header[elf_state->collect_pos], data, copy_size);
+            elf_state->collect_pos += copy_size;
+        } else {
+            // The program header table overlaps data already seen
+            return ERROR_ELF_HEADER;
+        }
+
+        data += copy_size;
+        size -= copy_size;
+        elf_state->file_offset += copy_size;
+
+        if (elf_state->collect_pos == elf_state->collect_size) {
+            status = elf_header_collected(elf_state);
+
+            if (ERROR_SUCCESS != status) {
+                return status;
+            }
+        }
+    }
+
+    // Program the parts of segments contained in the data
+    data_end = elf_state->file_offset + size;
+
+    for (i = 0; (i < elf_state->segment_count) && (size > 0); i++) {
+        segment = &elf_state->segments[i];
+        start = MAX(segment->offset, elf_state->file_offset);
+        end = MIN(segment->offset + segment->size, data_end);
+
+        if (start >= end) {
+            continue;
+        }
+
+        status = flash_decoder_write(segment->addr + (start - segment->offset),
+                                     data + (start - elf_state->file_offset), end - start);
+
+        if (ERROR_SUCCESS != status) {
+            return status;
+        }
+    }
+
+    elf_state->file_offset = data_end;
+
+    if (elf_state->headers_complete && (elf_state->file_offset >= elf_state->end_offset)) {
+        return ERROR_SUCCESS_DONE;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+static error_t close_elf(void *state)
 {
     error_t status;
     status = flash_decoder_close();
@@ -36,6 +36,9 @@ typedef enum {
 
     STREAM_TYPE_BIN = STREAM_TYPE_START,
     STREAM_TYPE_HEX,
+    STREAM_TYPE_UF2,
+    STREAM_TYPE_SREC,
+    STREAM_TYPE_ELF,
 
     // Add new stream types here
 
@@ -53,6 +53,8 @@ static flash_decoder_type_t flash_type;
 static uint32_t flash_buf_pos;
 static uint32_t initial_addr;
 static uint32_t current_addr;
+static uint32_t next_addr;
+static bool data_in_order;
 static bool flash_initialized;
 static bool initial_addr_set;
 
@@ -179,6 +181,8 @@ error_t flash_decoder_open(void)
     flash_buf_pos = 0;
     initial_addr = 0;
     current_addr = 0;
+    next_addr = 0;
+    data_in_order = true;
     flash_initialized = false;
     initial_addr_set = false;
     return ERROR_SUCCESS;
@@ -202,6 +206,14 @@ error_t flash_decoder_write(uint32_t addr, const uint8_t *data, uint32_t size)
         initial_addr_set = true;
     }
 
+    // Data reaching the end of flash only ends the transfer if it
+    // has arrived in address order
+    if (addr < next_addr) {
+        data_in_order = false;
+    }
+
+    next_addr = MAX(next_addr, addr + size);
+
     if (!flash_initialized) {
         uint32_t copy_size;
         bool flash_type_known = false;
@@ -287,7 +299,7 @@ error_t flash_decoder_write(uint32_t addr, const uint8_t *data, uint32_t size)
     }
 
     // Check if this is the end of data
-    if (flash_decoder_is_at_end(addr, data, size)) {
+    if (data_in_order && flash_decoder_is_at_end(addr, data, size)) {
         flash_decoder_printf("    End of transfer detected - addr 0x%08x, size 0x%08x\r\n",
                              addr, size);
         state = DECODER_STATE_DONE;
@@ -43,23 +43,62 @@ typedef enum {
     STATE_ERROR
 } state_t;
 
+// Number of write blocks which can be filled at the same time.  Data
+// arriving out of address order is collected in these until a block is
+// complete, the slot is needed for another block or the manager is closed.
+#define BLOCK_SLOT_COUNT        2
+#define BLOCK_SLOT_SIZE         512
+#define BLOCK_ADDR_INVALID      0xFFFFFFFF
+
+// Number of separate address ranges of programmed blocks which are
+// remembered.  Flash pages must only be programmed once between erases so
+// data arriving later for a programmed block is compared with the flash
+// instead.  Data which is the same is skipped, anything else fails the
+// transfer.
+#define PROGRAMMED_RANGE_COUNT  8
+
+// Size of the reads comparing data with a programmed block
+#define COMPARE_SIZE            32
+
+// Sectors tracked when page erase is enabled
+#define SECTOR_MAP_BITS         256
+
+typedef struct {
+    uint32_t addr;                  // Address of the block or BLOCK_ADDR_INVALID if free
+    uint32_t size;                  // Size of the block
+    uint32_t filled;                // Number of different bytes written into the block
+    uint32_t last_use;              // Value of use_count when the slot was last written
+    uint32_t written[BLOCK_SLOT_SIZE / 32]; // Bit set for each byte written
+} block_slot_t;
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+} addr_range_t;
+
 // Target programming expects buffer
 // passed in to be 4 byte aligned
 __attribute__((aligned(4)))
-static uint8_t buf[1024];
-static bool buf_empty;
-static bool current_sector_valid;
+static uint8_t buf[BLOCK_SLOT_COUNT][BLOCK_SLOT_SIZE];
+static block_slot_t slots[BLOCK_SLOT_COUNT];
+static uint32_t use_count;
+static addr_range_t programmed[PROGRAMMED_RANGE_COUNT];
+static uint32_t programmed_count;
 static bool page_erase_enabled = false;
-static uint32_t current_write_block_addr;
-static uint32_t current_write_block_size;
-static uint32_t current_sector_addr;
-static uint32_t current_sector_size;
-static uint32_t last_addr;
+static uint32_t sector_map_base;
+static uint32_t sector_map[SECTOR_MAP_BITS / 32];
 static const flash_intf_t *intf;
 static state_t state = STATE_CLOSED;
 
 static bool flash_intf_valid(const flash_intf_t *flash_intf);
-static error_t setup_next_sector(uint32_t addr);
+static void reset_variables(void);
+static error_t get_block_slot(uint32_t addr, uint32_t *slot_idx);
+static error_t flush_block_slot(uint32_t slot_idx);
+static uint32_t mark_written(block_slot_t *slot, uint32_t pos, uint32_t size);
+static const addr_range_t *find_programmed(uint32_t addr);
+static error_t add_programmed(uint32_t addr, uint32_t size);
+static error_t compare_programmed(uint32_t addr, const uint8_t *data, uint32_t size);
+static error_t erase_sector_once(uint32_t sector_addr, uint32_t sector_size);
 
 error_t flash_manager_init(const flash_intf_t *flash_intf)
 {
@@ -79,14 +118,7 @@ error_t flash_manager_init(const flash_intf_t *flash_intf)
     }
 
     // Initialize variables
-    memset(buf, 0xFF, sizeof(buf));
-    buf_empty = true;
-    current_sector_valid = false;
-    current_write_block_addr = 0;
-    current_write_block_size = 0;
-    current_sector_addr = 0;
-    current_sector_size = 0;
-    last_addr = 0;
+    reset_variables();
     intf = flash_intf;
     // Initialize flash
     status = intf->init();
@@ -113,9 +145,11 @@ error_t flash_manager_init(const flash_intf_t *flash_intf)
 
 error_t flash_manager_data(uint32_t addr, const uint8_t *data, uint32_t size)
 {
-    uint32_t size_left;
+    uint32_t slot_idx;
     uint32_t copy_size;
     uint32_t pos;
+    block_slot_t *slot;
+    const addr_range_t *range;
     error_t status = ERROR_SUCCESS;
     flash_manager_printf("flash_manager_data(addr=0x%x size=0x%x)\r\n", addr, size);
 
@@ -124,72 +158,57 @@ error_t flash_manager_data(uint32_t addr, const uint8_t *data, uint32_t size)
         return ERROR_INTERNAL;
     }
 
-    // Enforce that addresses are sequential.  Currently flash manager
-    // only supports sequential addresses.  In the future flash manager
-    // could be updated to support this.
-    if (addr < last_addr) {
-        util_assert(0);
-        state = STATE_ERROR;
-        return ERROR_INTERNAL;
-    }
+    // Addresses do not need to be sequential.  Each block is
+    // programmed once it is complete or its slot is needed.
+    while (size > 0) {
+        // Data sent again for blocks already programmed
+        range = find_programmed(addr);
 
-    // Setup the current sector if it is not setup already
-    if (!current_sector_valid) {
-        status = setup_next_sector(addr);
-
-        if (ERROR_SUCCESS != status) {
-            state = STATE_ERROR;
-            return status;
-        }
-        current_sector_valid = true;
-    }
-
-    while (true) {
-        // flush if necessary
-        if (addr >= current_write_block_addr + current_write_block_size) {
-            // Write out current buffer
-            status = intf->program_page(current_write_block_addr, buf, current_write_block_size);
-            flash_manager_printf("    intf->program_page(addr=0x%x, size=0x%x) ret=%i\r\n", current_write_block_addr, current_write_block_size, status);
+        if (range != 0) {
+            copy_size = MIN(size, range->end - addr);
+            status = compare_programmed(addr, data, copy_size);
 
             if (ERROR_SUCCESS != status) {
                 state = STATE_ERROR;
                 return status;
             }
 
-            // Setup for next page
-            memset(buf, 0xFF, current_write_block_size);
-            buf_empty = true;
-            current_write_block_addr += current_write_block_size;
-        }
-
-        // Check for end
-        if (size <= 0) {
-            break;
+            addr += copy_size;
+            data += copy_size;
+            size -= copy_size;
+            continue;
         }
 
-        // Change sector if necessary
-        if (addr >= current_sector_addr + current_sector_size) {
-            status = setup_next_sector(addr);
+        status = get_block_slot(addr, &slot_idx);
 
-            if (ERROR_SUCCESS != status) {
-                state = STATE_ERROR;
-                return status;
-            }
+        if (ERROR_SUCCESS != status) {
+            state = STATE_ERROR;
+            return status;
         }
 
         // write buffer
-        pos = addr - current_write_block_addr;
-        size_left = current_write_block_size - pos;
-        copy_size = MIN(size, size_left);
-        memcpy(buf + pos, data, copy_size);
-        buf_empty = copy_size == 0;
+        slot = &slots[slot_idx];
+        pos = addr - slot->addr;
+        copy_size = MIN(size, slot->size - pos);
+        memcpy(&buf[slot_idx][pos], data, copy_size);
+        slot->filled += mark_written(slot, pos, copy_size);
+        slot->last_use = ++use_count;
         // Update variables
         addr += copy_size;
         data += copy_size;
         size -= copy_size;
+
+        // Program the block as soon as all of it has been written
+        if (slot->filled >= slot->size) {
+            status = flush_block_slot(slot_idx);
+
+            if (ERROR_SUCCESS != status) {
+                state = STATE_ERROR;
+                return status;
+            }
+        }
     }
 
-    last_addr = addr;
     return status;
 }
 
@@ -197,6 +216,7 @@ error_t flash_manager_uninit(void)
 {
     error_t flash_uninit_error;
     error_t flash_write_error = ERROR_SUCCESS;
+    uint32_t i;
     flash_manager_printf("flash_manager_uninit()\r\n");
 
     if (STATE_CLOSED == state) {
@@ -204,25 +224,22 @@ error_t flash_manager_uninit(void)
         return ERROR_INTERNAL;
     }
 
-    // Write out current page
-    if ((STATE_OPEN == state) && (!buf_empty)) {
-        flash_write_error = intf->program_page(current_write_block_addr, buf, current_write_block_size);
-        flash_manager_printf("    intf->program_page(addr=0x%x, size=0x%x) ret=%i\r\n",
-                             current_write_block_addr, current_write_block_size, flash_write_error);
+    // Write out the blocks which are partially filled
+    for (i = 0; (STATE_OPEN == state) && (i < BLOCK_SLOT_COUNT); i++) {
+        if (BLOCK_ADDR_INVALID != slots[i].addr) {
+            flash_write_error = flush_block_slot(i);
+
+            if (ERROR_SUCCESS != flash_write_error) {
+                break;
+            }
+        }
     }
 
     // Close flash interface (even if there was an error during program_page)
     flash_uninit_error = intf->uninit();
     flash_manager_printf("    intf->uninit() ret=%i\r\n", flash_uninit_error);
     // Reset variables to catch accidental use
-    memset(buf, 0xFF, sizeof(buf));
-    buf_empty = true;
-    current_sector_valid = false;
-    current_write_block_addr = 0;
-    current_write_block_size = 0;
-    current_sector_addr = 0;
-    current_sector_size = 0;
-    last_addr = 0;
+    reset_variables();
     state = STATE_CLOSED;
 
     // Make sure an error from a page write or from an
@@ -277,11 +294,46 @@ static bool flash_intf_valid(const flash_intf_t *flash_intf)
     return true;
 }
 
-static error_t setup_next_sector(uint32_t addr)
+static void reset_variables(void)
+{
+    uint32_t i;
+    memset(buf, 0xFF, sizeof(buf));
+
+    for (i = 0; i < BLOCK_SLOT_COUNT; i++) {
+        slots[i].addr = BLOCK_ADDR_INVALID;
+        slots[i].size = 0;
+        slots[i].filled = 0;
+        slots[i].last_use = 0;
+        memset(slots[i].written, 0, sizeof(slots[i].written));
+    }
+
+    use_count = 0;
+    programmed_count = 0;
+    sector_map_base = BLOCK_ADDR_INVALID;
+    memset(sector_map, 0, sizeof(sector_map));
+}
+
+// Find the slot holding the block containing addr.  If the block is
+// not buffered yet set it up in a free slot, flushing the least
+// recently used block if necessary.
+static error_t get_block_slot(uint32_t addr, uint32_t *slot_idx)
 {
     uint32_t min_prog_size;
     uint32_t sector_size;
+    uint32_t block_size;
+    uint32_t block_addr;
+    uint32_t i;
+    uint32_t idx;
     error_t status;
+
+    for (i = 0; i < BLOCK_SLOT_COUNT; i++) {
+        if ((BLOCK_ADDR_INVALID != slots[i].addr) &&
+                (addr >= slots[i].addr) && (addr - slots[i].addr < slots[i].size)) {
+            *slot_idx = i;
+            return ERROR_SUCCESS;
+        }
+    }
+
     min_prog_size = intf->program_page_min_size(addr);
     sector_size = intf->erase_sector_size(addr);
 
@@ -292,31 +344,204 @@ static error_t setup_next_sector(uint32_t addr)
     }
 
     // Assert required size and alignment
-    util_assert(sizeof(buf) >= min_prog_size);
-    util_assert(sizeof(buf) % min_prog_size == 0);
+    util_assert(BLOCK_SLOT_SIZE >= min_prog_size);
+    util_assert(BLOCK_SLOT_SIZE % min_prog_size == 0);
     util_assert(sector_size >= min_prog_size);
     util_assert(sector_size % min_prog_size == 0);
-    // Setup global variables
-    current_sector_addr = ROUND_DOWN(addr, sector_size);
-    current_sector_size = sector_size;
-    current_write_block_addr = current_sector_addr;
-    current_write_block_size = MIN(sector_size, sizeof(buf));
-
-    if(page_erase_enabled) {
-        // Erase the current sector
-        status = intf->erase_sector(current_sector_addr);
-        flash_manager_printf("    intf->erase_sector(addr=0x%x) ret=%i\r\n", current_sector_addr);
+    block_size = MIN(sector_size, BLOCK_SLOT_SIZE);
+    block_addr = ROUND_DOWN(addr, block_size);
+
+    if (page_erase_enabled) {
+        status = erase_sector_once(ROUND_DOWN(addr, sector_size), sector_size);
+
+        if (ERROR_SUCCESS != status) {
+            return status;
+        }
+    }
+
+    // Use a free slot or else the one used least recently
+    idx = 0;
+
+    for (i = 0; i < BLOCK_SLOT_COUNT; i++) {
+        if (BLOCK_ADDR_INVALID == slots[i].addr) {
+            idx = i;
+            break;
+        }
+
+        if (slots[i].last_use < slots[idx].last_use) {
+            idx = i;
+        }
+    }
+
+    if (BLOCK_ADDR_INVALID != slots[idx].addr) {
+        status = flush_block_slot(idx);
+
+        if (ERROR_SUCCESS != status) {
+            return status;
+        }
+    }
+
+    slots[idx].addr = block_addr;
+    slots[idx].size = block_size;
+    slots[idx].filled = 0;
+    flash_manager_printf("    get_block_slot(addr=0x%x) slot=%i, block_addr=0x%x, block_size=0x%x\r\n",
+                         addr, idx, block_addr, block_size);
+    *slot_idx = idx;
+    return ERROR_SUCCESS;
+}
+
+// Program a block and free its slot.  A block which is only partially
+// filled is padded with 0xFF.  The block is remembered so that it is
+// never programmed twice.
+static error_t flush_block_slot(uint32_t slot_idx)
+{
+    error_t status;
+    block_slot_t *slot = &slots[slot_idx];
+    status = add_programmed(slot->addr, slot->size);
+
+    if (ERROR_SUCCESS == status) {
+        status = intf->program_page(slot->addr, buf[slot_idx], slot->size);
+        flash_manager_printf("    intf->program_page(addr=0x%x, size=0x%x) ret=%i\r\n", slot->addr, slot->size, status);
+    }
+
+    memset(buf[slot_idx], 0xFF, sizeof(buf[slot_idx]));
+    memset(slot->written, 0, sizeof(slot->written));
+    slot->addr = BLOCK_ADDR_INVALID;
+    slot->filled = 0;
+    return status;
+}
+
+// Mark size bytes from pos as written and return how many were not before
+static uint32_t mark_written(block_slot_t *slot, uint32_t pos, uint32_t size)
+{
+    uint32_t new_bytes = 0;
+    uint32_t bit;
+
+    for (; size > 0; pos++, size--) {
+        bit = 1UL << (pos % 32);
+
+        if (!(slot->written[pos / 32] & bit)) {
+            slot->written[pos / 32] |= bit;
+            new_bytes++;
+        }
+    }
+
+    return new_bytes;
+}
+
+// Return the range of programmed blocks containing addr or 0 if there is none
+static const addr_range_t *find_programmed(uint32_t addr)
+{
+    uint32_t i;
+
+    for (i = 0; i < programmed_count; i++) {
+        if ((addr >= programmed[i].start) && (addr < programmed[i].end)) {
+            return &programmed[i];
+        }
+    }
+
+    return 0;
+}
+
+// Add a block to the programmed ranges.  Blocks are mostly programmed in
+// address order so they usually extend a range.
+static error_t add_programmed(uint32_t addr, uint32_t size)
+{
+    uint32_t end = addr + size;
+    uint32_t i;
+    uint32_t j;
+
+    for (i = 0; i < programmed_count; i++) {
+        if (programmed[i].end == addr) {
+            programmed[i].end = end;
+            break;
+        }
+
+        if (programmed[i].start == end) {
+            programmed[i].start = addr;
+            break;
+        }
+    }
+
+    if (i == programmed_count) {
+        if (programmed_count >= PROGRAMMED_RANGE_COUNT) {
+            return ERROR_FLASH_ORDER;
+        }
+
+        programmed[programmed_count].start = addr;
+        programmed[programmed_count].end = end;
+        programmed_count++;
+        return ERROR_SUCCESS;
+    }
+
+    // The block may have closed the gap to another range
+    for (j = 0; j < programmed_count; j++) {
+        if ((j != i) && ((programmed[j].start == programmed[i].end) || (programmed[j].end == programmed[i].start))) {
+            programmed[i].start = MIN(programmed[i].start, programmed[j].start);
+            programmed[i].end = MAX(programmed[i].end, programmed[j].end);
+            programmed[j] = programmed[--programmed_count];
+            break;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+// Check that data for a block which has been programmed matches the flash
+static error_t compare_programmed(uint32_t addr, const uint8_t *data, uint32_t size)
+{
+    uint8_t flash[COMPARE_SIZE];
+    uint32_t read_size;
+    error_t status;
+
+    if (0 == intf->read) {
+        return ERROR_FLASH_ORDER;
+    }
+
+    while (size > 0) {
+        read_size = MIN(size, sizeof(flash));
+        status = intf->read(addr, flash, read_size);
+
         if (ERROR_SUCCESS != status) {
-            intf->uninit();
             return status;
-        }         
+        }
+
+        if (0 != memcmp(flash, data, read_size)) {
+            flash_manager_printf("    data for programmed block differs at 0x%x\r\n", addr);
+            return ERROR_FLASH_ORDER;
+        }
+
+        addr += read_size;
+        data += read_size;
+        size -= read_size;
     }
 
-    // Clear out buffer in case block size changed
-    memset(buf, 0xFF, current_write_block_size);
-    flash_manager_printf("    setup_next_sector(addr=0x%x) sect_addr=0x%x, write_addr=0x%x,\r\n",
-                         addr, current_sector_addr, current_write_block_addr);
-    flash_manager_printf("        actual_write_size=0x%x, sector_size=0x%x, min_write=0x%x\r\n",
-                         current_write_block_size, current_sector_size, min_prog_size);
     return ERROR_SUCCESS;
 }
+
+// Erase a sector unless it has been erased since the manager was opened.
+// Sectors are tracked relative to the first one erased.  Sectors outside
+// of the map are erased each time a block in them is set up.
+static error_t erase_sector_once(uint32_t sector_addr, uint32_t sector_size)
+{
+    error_t status;
+    uint32_t sector;
+
+    if (BLOCK_ADDR_INVALID == sector_map_base) {
+        sector_map_base = sector_addr;
+    }
+
+    sector = (sector_addr - sector_map_base) / sector_size;
+
+    if ((sector_addr >= sector_map_base) && (sector < SECTOR_MAP_BITS)) {
+        if (sector_map[sector / 32] & (1UL << (sector % 32))) {
+            return ERROR_SUCCESS;
+        }
+
+        sector_map[sector / 32] |= 1UL << (sector % 32);
+    }
+
+    status = intf->erase_sector(sector_addr);
+    flash_manager_printf("    intf->erase_sector(addr=0x%x) ret=%i\r\n", sector_addr, status);
+    return status;
+}
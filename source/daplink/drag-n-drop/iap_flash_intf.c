@@ -72,6 +72,7 @@ static const flash_intf_t flash_intf = {
     erase_chip,
     program_page_min_size,
     erase_sector_size,
+    0,
 };
 
 const flash_intf_t *const flash_intf_iap_protected = &flash_intf;
@@ -237,7 +238,7 @@ static error_t program_page(uint32_t addr, const uint8_t *buf, uint32_t size)
 
     if (addr + size >= updt_end) {
         // Something has been updated so recompute the crc
-        info_crc_compute();
+        info_crc_invalidate(DAPLINK_ROM_UPDATE_START, DAPLINK_ROM_UPDATE_SIZE);
         update_complete = true;
     }
 
@@ -424,7 +425,7 @@ static error_t intercept_page_write(uint32_t addr, const uint8_t *buf, uint32_t
         }
 
         // The bootloader has been updated so recompute the crc
-        info_crc_compute();
+        info_crc_invalidate(DAPLINK_ROM_UPDATE_START, DAPLINK_ROM_UPDATE_SIZE);
         update_complete = true;
         return status;
     }
@@ -20,8 +20,10 @@
  */
 
 #include "string.h"
+#include "stdbool.h"
 
 #include "intelhex.h"
+#include "macro.h"
 
 typedef enum hex_record_t hex_record_t;
 enum hex_record_t {
@@ -33,198 +35,258 @@ enum hex_record_t {
     START_LINEAR_ADDR_RECORD = 5
 };
 
-typedef union hex_line_t hex_line_t;
-union __attribute__((packed)) hex_line_t {
-    uint8_t buf[0x25];
-    struct __attribute__((packed)) {
-        uint8_t  byte_count;
-        uint16_t address;
-        uint8_t  record_type;
-        uint8_t  data[0x25 - 0x5];
-        uint8_t  checksum;
-    };
+// Offsets of the fields in a decoded record
+#define RECORD_BYTE_COUNT       0
+#define RECORD_ADDRESS_HI       1
+#define RECORD_ADDRESS_LO       2
+#define RECORD_TYPE             3
+#define RECORD_DATA             4
+
+// Set in hex_digit for valid characters
+#define HEX_DIGIT_VALID         0x10
+
+#define HEX_DIGIT(c, v)         [c] = HEX_DIGIT_VALID | (v)
+
+// Value of every ascii character used as a hex digit
+static const uint8_t hex_digit[256] = {
+    HEX_DIGIT('0', 0x0), HEX_DIGIT('1', 0x1), HEX_DIGIT('2', 0x2), HEX_DIGIT('3', 0x3),
+    HEX_DIGIT('4', 0x4), HEX_DIGIT('5', 0x5), HEX_DIGIT('6', 0x6), HEX_DIGIT('7', 0x7),
+    HEX_DIGIT('8', 0x8), HEX_DIGIT('9', 0x9), HEX_DIGIT('A', 0xA), HEX_DIGIT('B', 0xB),
+    HEX_DIGIT('C', 0xC), HEX_DIGIT('D', 0xD), HEX_DIGIT('E', 0xE), HEX_DIGIT('F', 0xF),
+    HEX_DIGIT('a', 0xA), HEX_DIGIT('b', 0xB), HEX_DIGIT('c', 0xC), HEX_DIGIT('d', 0xD),
+    HEX_DIGIT('e', 0xE), HEX_DIGIT('f', 0xF),
 };
 
-/** Swap 16bit value - let compiler figure out the best way
- *  @param val a variable of size uint16_t to be swapped
- *  @return the swapped value
- */
-static uint16_t swap16(uint16_t a)
+// Parser state kept between calls since records can be split across blobs
+static struct {
+    bool in_record;             // A ':' has been found and the record is being decoded
+    uint8_t pending_char;       // First digit of a byte split across blobs or 0
+    uint8_t checksum;           // Sum of the record bytes decoded so far
+    uint8_t byte_count;         // Number of data bytes in the record
+    uint8_t record_type;
+    uint8_t ext_data[2];        // Data of an extended address record
+    uint32_t pos;               // Number of record bytes decoded
+    uint32_t record_addr;       // Address of the next data byte of the record
+    uint32_t ext_addr;          // Base address from the extended address records
+    uint32_t bin_addr;          // Address of the first byte in the output buffer
+    uint32_t bin_cnt;           // Number of bytes in the output buffer
+} parser;
+
+void reset_hex_parser(void)
 {
-    return ((a & 0x00ff) << 8) | ((a & 0xff00) >> 8);
+    memset(&parser, 0, sizeof(parser));
 }
 
-/** Converts a character representation of a hex to real value.
- *   @param c is the hex value in char format
- *   @return the value of the hex
- */
-static uint8_t ctoh(char c)
+void flush_hex_parser(uint32_t *bin_buf_address, uint32_t *bin_buf_cnt)
 {
-    return (c & 0x10) ? /*0-9*/ c & 0xf : /*A-F, a-f*/ (c & 0xf) + 9;
+    *bin_buf_address = parser.bin_addr;
+    *bin_buf_cnt = parser.bin_cnt;
+    parser.bin_cnt = 0;
 }
 
-/** Calculate checksum on a hex record
- *   @param data is the line of hex record
- *   @param size is the length of the data array
- *   @return 1 if the data provided is a valid hex record otherwise 0
+/** Handle a byte of the record header or trailer
+ *   @param byte the decoded byte
+ *   @param bin_buf_size max size of the output buffer
+ *   @param bin_buf_address set to the address of the data to program
+ *   @param bin_buf_cnt set to the amount of data to program
+ *   @return HEX_PARSE_OK to continue decoding, any other value is returned to the caller
  */
-static uint8_t validate_checksum(hex_line_t *record)
+static hexfile_parse_status_t record_byte(uint8_t byte, uint32_t bin_buf_size, uint32_t *bin_buf_address, uint32_t *bin_buf_cnt)
 {
-    uint8_t result = 0, i = 0;
+    uint32_t pos = parser.pos++;
 
-    for (; i < (record->byte_count + 5); i++) {
-        result += record->buf[i];
+    if (pos < RECORD_DATA) {
+        switch (pos) {
+            case RECORD_BYTE_COUNT:
+                parser.byte_count = byte;
+                break;
+
+            case RECORD_ADDRESS_HI:
+                parser.record_addr = byte << 8;
+                break;
+
+            case RECORD_ADDRESS_LO:
+                parser.record_addr |= byte;
+                break;
+
+            case RECORD_TYPE:
+                parser.record_type = byte;
+
+                if (DATA_RECORD != byte) {
+                    break;
+                }
+
+                if (parser.byte_count > bin_buf_size) {
+                    return HEX_PARSE_LINE_OVERRUN;
+                }
+
+                parser.record_addr += parser.ext_addr;
+
+                if (0 == parser.bin_cnt) {
+                    parser.bin_addr = parser.record_addr;
+                } else if ((parser.bin_addr + parser.bin_cnt != parser.record_addr) ||
+                           (parser.bin_cnt + parser.byte_count > bin_buf_size)) {
+                    // The record does not continue the buffered data so that
+                    // has to be programmed before decoding goes on
+                    flush_hex_parser(bin_buf_address, bin_buf_cnt);
+                    parser.bin_addr = parser.record_addr;
+                    return HEX_PARSE_UNALIGNED;
+                }
+
+                break;
+        }
+
+        return HEX_PARSE_OK;
     }
 
-    return (result == 0);
-}
+    if (pos < RECORD_DATA + parser.byte_count) {
+        // Data of records other than data records
+        if (pos - RECORD_DATA < sizeof(parser.ext_data)) {
+            parser.ext_data[pos - RECORD_DATA] = byte;
+        }
 
-static hex_line_t line = {0}, shadow_line = {0};
-static uint32_t next_address_to_write = 0;
-static uint8_t low_nibble = 0, idx = 0, record_processed = 0, load_unaligned_record = 0;
+        return HEX_PARSE_OK;
+    }
 
-void reset_hex_parser(void)
-{
-    memset(line.buf, 0, sizeof(hex_line_t));
-    memset(shadow_line.buf, 0, sizeof(hex_line_t));
-    next_address_to_write = 0;
-    low_nibble = 0;
-    idx = 0;
-    record_processed = 0;
-    load_unaligned_record = 0;
+    // Checksum byte, the sum of all record bytes must be zero
+    parser.in_record = false;
+
+    if (0 != parser.checksum) {
+        return HEX_PARSE_CKSUM_FAIL;
+    }
+
+    switch (parser.record_type) {
+        case EOF_RECORD:
+            flush_hex_parser(bin_buf_address, bin_buf_cnt);
+            return HEX_PARSE_EOF;
+
+        case EXT_SEG_ADDR_RECORD:
+            parser.ext_addr = ((parser.ext_data[0] << 8) | parser.ext_data[1]) << 4;
+            break;
+
+        case EXT_LINEAR_ADDR_RECORD:
+            parser.ext_addr = ((parser.ext_data[0] << 8) | parser.ext_data[1]) << 16;
+            break;
+
+        default:
+            break;
+    }
+
+    return HEX_PARSE_OK;
 }
 
 hexfile_parse_status_t parse_hex_blob(const uint8_t *hex_blob, const uint32_t hex_blob_size, uint32_t *hex_parse_cnt, uint8_t *bin_buf, const uint32_t bin_buf_size, uint32_t *bin_buf_address, uint32_t *bin_buf_cnt)
 {
-    uint8_t *end = (uint8_t *)hex_blob + hex_blob_size;
-    hexfile_parse_status_t status = HEX_PARSE_UNINIT;
-    // reset the amount of data that is being return'd
-    *bin_buf_cnt = (uint32_t)0;
-
-    // we had an exit state where the address was unaligned to the previous record and data count.
-    //  Need to pop the last record into the buffer before decoding anthing else since it was
-    //  already decoded.
-    if (load_unaligned_record) {
-        // need some help...
-        load_unaligned_record = 0;
-        // move from line buffer back to input buffer
-        memcpy((uint8_t *)bin_buf, (uint8_t *)line.data, line.byte_count);
-        bin_buf += line.byte_count;
-        *bin_buf_cnt = (uint32_t)(*bin_buf_cnt) + line.byte_count;
-        // Store next address to write
-        next_address_to_write = ((next_address_to_write & 0xffff0000) | line.address) + line.byte_count;
-    }
+    const uint8_t *pos = hex_blob;
+    const uint8_t *end = hex_blob + hex_blob_size;
+    hexfile_parse_status_t status = HEX_PARSE_OK;
+    uint32_t data_left;
+    uint32_t n;
+    uint8_t *out;
+    uint8_t sum;
+    uint8_t hi;
+    uint8_t lo;
+    uint8_t byte;
+    // Nothing is returned unless a block is complete
+    *bin_buf_address = parser.bin_addr;
+    *bin_buf_cnt = 0;
+
+    while (pos < end) {
+        if (!parser.in_record) {
+            // Skip line endings and anything else between records
+            if (':' == *pos++) {
+                parser.in_record = true;
+                parser.pending_char = 0;
+                parser.checksum = 0;
+                parser.pos = 0;
+            }
+
+            continue;
+        }
+
+        // Fast path for the data of a data record.  Two digits are
+        // decoded per step straight into the output buffer.
+        if ((DATA_RECORD == parser.record_type) && (parser.pos >= RECORD_DATA) &&
+                (0 == parser.pending_char)) {
+            data_left = RECORD_DATA + parser.byte_count - parser.pos;
+            n = MIN(data_left, (uint32_t)(end - pos) / 2);
+            out = bin_buf + parser.bin_cnt;
+            sum = parser.checksum;
+            parser.pos += n;
+            parser.bin_cnt += n;
+
+            while (n--) {
+                hi = hex_digit[pos[0]];
+                lo = hex_digit[pos[1]];
+                pos += 2;
 
-    while (hex_blob != end) {
-        switch ((uint8_t)(*hex_blob)) {
-            // we've hit the end of an ascii line
-            // junk we dont care about could also just run the validate_checksum on &line
-            case '\r':
-            case '\n':
-                if (0 == validate_checksum(&line)) {
-                    status = HEX_PARSE_CKSUM_FAIL;
+                if (!(hi & lo & HEX_DIGIT_VALID)) {
+                    status = HEX_PARSE_FAILURE;
                     goto hex_parser_exit;
-                } else {
-                    if (!record_processed) {
-                        record_processed = 1;
-                        // address byteswap...
-                        line.address = swap16(line.address);
-
-                        switch (line.record_type) {
-                            case DATA_RECORD:
-                                // keeping a record of the last hex record
-                                memcpy(shadow_line.buf, line.buf, sizeof(hex_line_t));
-
-                                // verify this is a continous block of memory or need to exit and dump
-                                if (((next_address_to_write & 0xffff0000) | line.address) != next_address_to_write) {
-                                    load_unaligned_record = 1;
-                                    status = HEX_PARSE_UNALIGNED;
-                                    goto hex_parser_exit;
-                                }
-
-                                // move from line buffer back to input buffer
-                                memcpy(bin_buf, line.data, line.byte_count);
-                                bin_buf += line.byte_count;
-                                *bin_buf_cnt = (uint32_t)(*bin_buf_cnt) + line.byte_count;
-                                // Save next address to write
-                                next_address_to_write = ((next_address_to_write & 0xffff0000) | line.address) + line.byte_count;
-                                break;
-
-                            case EOF_RECORD:
-                                // pad rest of the buffer with 0xff
-                                //memset(bin_buf, 0xff, (bin_buf_size - (uint32_t)(*bin_buf_cnt)));
-                                //*bin_buf_cnt = bin_buf_size;
-                                status = HEX_PARSE_EOF;
-                                goto hex_parser_exit;
-
-                            case EXT_SEG_ADDR_RECORD:
-                                // Could have had data in the buffer so must exit and try to program
-                                //  before updating bin_buf_address with next_address_to_write
-                                memset(bin_buf, 0xff, (bin_buf_size - (uint32_t)(*bin_buf_cnt)));
-                                // figure the start address for the buffer before returning
-                                *bin_buf_address = next_address_to_write - (uint32_t)(*bin_buf_cnt);
-                                *hex_parse_cnt = (uint32_t)(hex_blob_size - (end - hex_blob));
-                                // update the address msb's
-                                next_address_to_write = (next_address_to_write & 0x00000000) | ((line.data[0] << 12) | (line.data[1] << 4));
-                                // Need to exit and program if buffer has been filled
-                                status = HEX_PARSE_UNALIGNED;
-                                return status;
-
-                            case EXT_LINEAR_ADDR_RECORD:
-                                // Could have had data in the buffer so must exit and try to program
-                                //  before updating bin_buf_address with next_address_to_write
-                                //  Good catch Gaute!!
-                                memset(bin_buf, 0xff, (bin_buf_size - (uint32_t)(*bin_buf_cnt)));
-                                // figure the start address for the buffer before returning
-                                *bin_buf_address = next_address_to_write - (uint32_t)(*bin_buf_cnt);
-                                *hex_parse_cnt = (uint32_t)(hex_blob_size - (end - hex_blob));
-                                // update the address msb's
-                                next_address_to_write = (next_address_to_write & 0x00000000) | ((line.data[0] << 24) | (line.data[1] << 16));
-                                // Need to exit and program if buffer has been filled
-                                status = HEX_PARSE_UNALIGNED;
-                                return status;
-
-                            default:
-                                break;
-                        }
-                    }
                 }
 
-                break;
+                byte = (uint8_t)((hi << 4) | (lo & 0xF));
+                *out++ = byte;
+                sum += byte;
+            }
 
-            // found start of a new record. reset state variables
-            case ':':
-                memset(line.buf, 0, sizeof(hex_line_t));
-                low_nibble = 0;
-                idx = 0;
-                record_processed = 0;
-                break;
+            parser.checksum = sum;
 
-            // decoding lines
-            default:
-                if (low_nibble) {
-                    line.buf[idx] |= ctoh((uint8_t)(*hex_blob)) & 0xf;
-                    idx++;
-                } else {
-                    if (idx < sizeof(hex_line_t)) {
-                        line.buf[idx] = ctoh((uint8_t)(*hex_blob)) << 4;
-                    }
+            if ((parser.pos < RECORD_DATA + parser.byte_count) && (pos + 1 >= end)) {
+                // Record continues in the next blob, keep a split digit
+                if (pos < end) {
+                    parser.pending_char = *pos++;
                 }
 
-                low_nibble = !low_nibble;
+                continue;
+            }
+
+            if (pos == end) {
                 break;
+            }
+        }
+
+        // Decode one byte of the header or trailer.  The first digit
+        // may have been left over from the previous blob.
+        if (parser.pending_char) {
+            hi = hex_digit[parser.pending_char];
+            parser.pending_char = 0;
+        } else {
+            if (pos + 1 >= end) {
+                parser.pending_char = *pos++;
+                continue;
+            }
+
+            hi = hex_digit[*pos++];
+        }
+
+        lo = hex_digit[*pos++];
+
+        if (!(hi & lo & HEX_DIGIT_VALID)) {
+            status = HEX_PARSE_FAILURE;
+            break;
         }
 
-        hex_blob++;
+        byte = (uint8_t)((hi << 4) | (lo & 0xF));
+
+        if ((DATA_RECORD == parser.record_type) && (parser.pos >= RECORD_DATA) &&
+                (parser.pos < RECORD_DATA + parser.byte_count)) {
+            // Data byte completed from a digit split across blobs
+            bin_buf[parser.bin_cnt++] = byte;
+            parser.checksum += byte;
+            parser.pos++;
+            continue;
+        }
+
+        parser.checksum += byte;
+        status = record_byte(byte, bin_buf_size, bin_buf_address, bin_buf_cnt);
+
+        if (HEX_PARSE_OK != status) {
+            break;
+        }
     }
 
-    // decoded an entire hex block - verify (cant do this hex_parse_cnt is figured below)
-    //status = (hex_blob_size == (uint32_t)(*hex_parse_cnt)) ? HEX_PARSE_OK : HEX_PARSE_FAILURE;
-    status = HEX_PARSE_OK;
 hex_parser_exit:
-    memset(bin_buf, 0xff, (bin_buf_size - (uint32_t)(*bin_buf_cnt)));
-    // figure the start address for the buffer before returning
-    *bin_buf_address = next_address_to_write - (uint32_t)(*bin_buf_cnt);
-    *hex_parse_cnt = (uint32_t)(hex_blob_size - (end - hex_blob));
+    *hex_parse_cnt = (uint32_t)(pos - hex_blob);
     return status;
 }
@@ -38,7 +38,7 @@ extern "C" {
 typedef enum {
     HEX_PARSE_OK = 0,       /*!< The input buffer was complete parsed and converted into the output buffer */
     HEX_PARSE_EOF,          /*!< EOF line found in the hex file */
-    HEX_PARSE_UNALIGNED,    /*!< The address of decoded data isnt consecutive. Need to program what was returned and continue to parse the input buffer */
+    HEX_PARSE_UNALIGNED,    /*!< Decoded data is ready. Need to program what was returned and continue to parse the input buffer */
     HEX_PARSE_LINE_OVERRUN, /*!< Error state when the record length is longer than the record structure */
     HEX_PARSE_CKSUM_FAIL,   /*!< Error state when the record checksum doesnt properly compute */
     HEX_PARSE_UNINIT,       /*!< Default state. Return of this type is unrecoverable logic error */
@@ -51,7 +51,17 @@ typedef enum {
  */
 void reset_hex_parser(void);
 
+/** Return the decoded data still held in the bin_buf passed to parse_hex_blob
+ *  @param bin_buf_address The start address for data in the bin_buf
+ *  @param bin_buf_cnt The amount of data in the bin_buf
+ *  @return none
+ */
+void flush_hex_parser(uint32_t *bin_buf_address, uint32_t *bin_buf_cnt);
+
 /** Convert a blob of hex data into its binary equivelant
+ *  Contiguous records are collected in bin_buf across calls, so the same
+ *  buffer must be passed every time.  Data is only returned once the
+ *  buffer is full, the next record is not contiguous or EOF is reached.
  *  @param hex_blob A block of ascii encoded hexfile data
  *  @param hex_blob_size The amount of valid data in the hex_blob
  *  @param hex_parse_cnt The amount of hex_blob data from the call that was parsed
@@ -0,0 +1,281 @@
+/**
+ * @file    srec.c
+ * @brief   Implementation of srec.h
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "string.h"
+#include "stdbool.h"
+
+#include "srec.h"
+#include "macro.h"
+
+// Offset of the address in a decoded record, the count comes first
+#define RECORD_ADDRESS          1
+
+// Set in hex_digit for valid characters
+#define HEX_DIGIT_VALID         0x10
+
+#define HEX_DIGIT(c, v)         [c] = HEX_DIGIT_VALID | (v)
+
+// Value of every ascii character used as a hex digit
+static const uint8_t hex_digit[256] = {
+    HEX_DIGIT('0', 0x0), HEX_DIGIT('1', 0x1), HEX_DIGIT('2', 0x2), HEX_DIGIT('3', 0x3),
+    HEX_DIGIT('4', 0x4), HEX_DIGIT('5', 0x5), HEX_DIGIT('6', 0x6), HEX_DIGIT('7', 0x7),
+    HEX_DIGIT('8', 0x8), HEX_DIGIT('9', 0x9), HEX_DIGIT('A', 0xA), HEX_DIGIT('B', 0xB),
+    HEX_DIGIT('C', 0xC), HEX_DIGIT('D', 0xD), HEX_DIGIT('E', 0xE), HEX_DIGIT('F', 0xF),
+    HEX_DIGIT('a', 0xA), HEX_DIGIT('b', 0xB), HEX_DIGIT('c', 0xC), HEX_DIGIT('d', 0xD),
+    HEX_DIGIT('e', 0xE), HEX_DIGIT('f', 0xF),
+};
+
+// Parser state kept between calls since records can be split across blobs
+static struct {
+    bool in_record;             // An 'S' has been found and the record is being decoded
+    bool type_known;            // The record type digit has been read
+    uint8_t pending_char;       // First digit of a byte split across blobs or 0
+    uint8_t checksum;           // Sum of the record bytes decoded so far
+    uint8_t record_type;        // Record type 0-9
+    uint8_t addr_len;           // Number of address bytes for the record type
+    uint8_t count;              // Number of bytes following the count byte
+    uint32_t pos;               // Number of record bytes decoded
+    uint32_t record_addr;       // Address of the record
+    uint32_t bin_addr;          // Address of the first byte in the output buffer
+    uint32_t bin_cnt;           // Number of bytes in the output buffer
+} parser;
+
+void reset_srec_parser(void)
+{
+    memset(&parser, 0, sizeof(parser));
+}
+
+void flush_srec_parser(uint32_t *bin_buf_address, uint32_t *bin_buf_cnt)
+{
+    *bin_buf_address = parser.bin_addr;
+    *bin_buf_cnt = parser.bin_cnt;
+    parser.bin_cnt = 0;
+}
+
+static bool is_data_record(void)
+{
+    return (parser.record_type >= 1) && (parser.record_type <= 3);
+}
+
+// Number of address bytes for each record type, S4 is reserved
+static const uint8_t record_addr_len[10] = {2, 2, 3, 4, 0, 2, 3, 4, 3, 2};
+
+/** Handle a byte of the record header or trailer
+ *   @param byte the decoded byte
+ *   @param bin_buf_size max size of the output buffer
+ *   @param bin_buf_address set to the address of the data to program
+ *   @param bin_buf_cnt set to the amount of data to program
+ *   @return SREC_PARSE_OK to continue decoding, any other value is returned to the caller
+ */
+static srecfile_parse_status_t record_byte(uint8_t byte, uint32_t bin_buf_size, uint32_t *bin_buf_address, uint32_t *bin_buf_cnt)
+{
+    uint32_t pos = parser.pos++;
+    uint32_t data_size;
+
+    if (0 == pos) {
+        parser.count = byte;
+
+        // The count covers the address, the data and the checksum
+        if ((0 == parser.addr_len) || (byte < parser.addr_len + 1)) {
+            return SREC_PARSE_FAILURE;
+        }
+
+        parser.record_addr = 0;
+        return SREC_PARSE_OK;
+    }
+
+    if (pos < RECORD_ADDRESS + parser.addr_len) {
+        parser.record_addr = (parser.record_addr << 8) | byte;
+
+        // Check that the data of the record can be collected once the
+        // address is complete
+        if ((pos == parser.addr_len) && is_data_record()) {
+            data_size = parser.count - parser.addr_len - 1;
+
+            if (data_size > bin_buf_size) {
+                return SREC_PARSE_LINE_OVERRUN;
+            }
+
+            if (0 == parser.bin_cnt) {
+                parser.bin_addr = parser.record_addr;
+            } else if ((parser.bin_addr + parser.bin_cnt != parser.record_addr) ||
+                       (parser.bin_cnt + data_size > bin_buf_size)) {
+                // The record does not continue the buffered data so that
+                // has to be programmed before decoding goes on
+                flush_srec_parser(bin_buf_address, bin_buf_cnt);
+                parser.bin_addr = parser.record_addr;
+                return SREC_PARSE_UNALIGNED;
+            }
+        }
+
+        return SREC_PARSE_OK;
+    }
+
+    if (pos < 1 + parser.count - 1) {
+        // Data of records other than data records is not needed
+        return SREC_PARSE_OK;
+    }
+
+    // Checksum byte, the ones complement of the sum of the other bytes
+    parser.in_record = false;
+
+    if (0xFF != parser.checksum) {
+        return SREC_PARSE_CKSUM_FAIL;
+    }
+
+    if (parser.record_type >= 7) {
+        flush_srec_parser(bin_buf_address, bin_buf_cnt);
+        return SREC_PARSE_EOF;
+    }
+
+    return SREC_PARSE_OK;
+}
+
+srecfile_parse_status_t parse_srec_blob(const uint8_t *srec_blob, const uint32_t srec_blob_size, uint32_t *srec_parse_cnt, uint8_t *bin_buf, const uint32_t bin_buf_size, uint32_t *bin_buf_address, uint32_t *bin_buf_cnt)
+{
+    const uint8_t *pos = srec_blob;
+    const uint8_t *end = srec_blob + srec_blob_size;
+    srecfile_parse_status_t status = SREC_PARSE_OK;
+    uint32_t data_start;
+    uint32_t data_left;
+    uint32_t n;
+    uint8_t *out;
+    uint8_t sum;
+    uint8_t hi;
+    uint8_t lo;
+    uint8_t byte;
+    // Nothing is returned unless a block is complete
+    *bin_buf_address = parser.bin_addr;
+    *bin_buf_cnt = 0;
+
+    while (pos < end) {
+        if (!parser.in_record) {
+            // Skip line endings and anything else between records
+            if ('S' == *pos++) {
+                parser.in_record = true;
+                parser.type_known = false;
+                parser.pending_char = 0;
+                parser.checksum = 0;
+                parser.pos = 0;
+            }
+
+            continue;
+        }
+
+        if (!parser.type_known) {
+            if ((*pos < '0') || (*pos > '9')) {
+                status = SREC_PARSE_FAILURE;
+                break;
+            }
+
+            parser.record_type = *pos++ - '0';
+            parser.addr_len = record_addr_len[parser.record_type];
+            parser.type_known = true;
+            continue;
+        }
+
+        // Fast path for the data of a data record.  Two digits are
+        // decoded per step straight into the output buffer.
+        data_start = RECORD_ADDRESS + parser.addr_len;
+
+        if (is_data_record() && (parser.pos >= data_start) && (0 == parser.pending_char)) {
+            data_left = parser.count - parser.addr_len - 1 - (parser.pos - data_start);
+            n = MIN(data_left, (uint32_t)(end - pos) / 2);
+            out = bin_buf + parser.bin_cnt;
+            sum = parser.checksum;
+            parser.pos += n;
+            parser.bin_cnt += n;
+            data_left -= n;
+
+            while (n--) {
+                hi = hex_digit[pos[0]];
+                lo = hex_digit[pos[1]];
+                pos += 2;
+
+                if (!(hi & lo & HEX_DIGIT_VALID)) {
+                    status = SREC_PARSE_FAILURE;
+                    goto srec_parser_exit;
+                }
+
+                byte = (uint8_t)((hi << 4) | (lo & 0xF));
+                *out++ = byte;
+                sum += byte;
+            }
+
+            parser.checksum = sum;
+
+            if ((data_left > 0) && (pos + 1 >= end)) {
+                // Record continues in the next blob, keep a split digit
+                if (pos < end) {
+                    parser.pending_char = *pos++;
+                }
+
+                continue;
+            }
+
+            if (pos == end) {
+                break;
+            }
+        }
+
+        // Decode one byte of the header or trailer.  The first digit
+        // may have been left over from the previous blob.
+        if (parser.pending_char) {
+            hi = hex_digit[parser.pending_char];
+            parser.pending_char = 0;
+        } else {
+            if (pos + 1 >= end) {
+                parser.pending_char = *pos++;
+                continue;
+            }
+
+            hi = hex_digit[*pos++];
+        }
+
+        lo = hex_digit[*pos++];
+
+        if (!(hi & lo & HEX_DIGIT_VALID)) {
+            status = SREC_PARSE_FAILURE;
+            break;
+        }
+
+        byte = (uint8_t)((hi << 4) | (lo & 0xF));
+
+        if (is_data_record() && (parser.pos >= data_start) && (parser.pos < parser.count)) {
+            // Data byte completed from a digit split across blobs
+            bin_buf[parser.bin_cnt++] = byte;
+            parser.checksum += byte;
+            parser.pos++;
+            continue;
+        }
+
+        parser.checksum += byte;
+        status = record_byte(byte, bin_buf_size, bin_buf_address, bin_buf_cnt);
+
+        if (SREC_PARSE_OK != status) {
+            break;
+        }
+    }
+
+srec_parser_exit:
+    *srec_parse_cnt = (uint32_t)(pos - srec_blob);
+    return status;
+}
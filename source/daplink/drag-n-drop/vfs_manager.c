@@ -21,6 +21,7 @@
 
 #include "stdbool.h"
 #include "ctype.h"
+#include "string.h"
 
 #include "main.h"
 #include "RTL.h"
@@ -41,6 +42,8 @@
 
 #include "target_ids.h"
 #include "target_config.h"
+#include "target_flash.h"
+#include "tasks.h"
 
 // Set to 1 to enable debugging
 #define DEBUG_VFS_MANAGER     0
@@ -56,6 +59,9 @@
 
 #define CONNECT_DELAY_MS 0
 #define RECONNECT_DELAY_MS 2500    // Must be above 1s for windows (more for linux)
+// Reconnect delay when the host is told about a medium change rather than
+// the drive being removed
+#define REANNOUNCE_DELAY_MS 0
 // TRANSFER_IN_PROGRESS
 #define DISCONNECT_DELAY_TRANSFER_TIMEOUT_MS 20000
 // TRANSFER_CAN_BE_FINISHED
@@ -63,9 +69,38 @@
 // TRANSFER_NOT_STARTED || TRASNFER_FINISHED
 #define DISCONNECT_DELAY_MS 500
 
+// Number of sectors USB collects before they are passed to the filesystem.
+// Larger groups hand the stream bigger chunks at the cost of RAM.
+#ifndef VFS_MSC_BLOCK_GROUP
+#define VFS_MSC_BLOCK_GROUP     1
+#endif
+
+// Set to 0 to run the stream on the USB thread instead of a flashing task.
+// USB then stalls while sectors are programmed but the task stack and the
+// queued sector buffers are saved, see records/hic_hal.
+#ifndef VFS_FLASH_TASK
+#define VFS_FLASH_TASK          1
+#endif
+
+// Number of sector buffers queued to the flashing task. USB stops
+// accepting sectors only when all of them are waiting to be programmed.
+#ifndef FLASH_QUEUE_DEPTH
+#define FLASH_QUEUE_DEPTH       2
+#endif
+
+// Number of sectors which can arrive ahead of the expected one and be
+// held until the gap before them is filled.  With 0 they are discarded.
+#ifndef VFS_REORDER_SLOTS
+#define VFS_REORDER_SLOTS       2
+#endif
+
+// Sectors further ahead than this are not considered part of the file
+#define VFS_REORDER_WINDOW      32
+
 // Make sure none of the delays exceed the max time
 COMPILER_ASSERT(CONNECT_DELAY_MS < MAX_EVENT_TIME_MS);
 COMPILER_ASSERT(RECONNECT_DELAY_MS < MAX_EVENT_TIME_MS);
+COMPILER_ASSERT(REANNOUNCE_DELAY_MS < MAX_EVENT_TIME_MS);
 COMPILER_ASSERT(DISCONNECT_DELAY_TRANSFER_TIMEOUT_MS < MAX_EVENT_TIME_MS);
 COMPILER_ASSERT(DISCONNECT_DELAY_TRANSFER_IDLE_MS < MAX_EVENT_TIME_MS);
 COMPILER_ASSERT(DISCONNECT_DELAY_MS < MAX_EVENT_TIME_MS);
@@ -85,6 +120,7 @@ typedef struct {
     uint32_t size_processed;        // The number of bytes processed by the stream
     uint32_t file_size;             // Size of the file indicated by root dir.  Only allowed to increase
     uint32_t size_transferred;      // The number of bytes transferred
+    uint32_t chain_size;            // Size of the file's cluster chain once the FAT has been written, otherwise 0
     transfer_state_t transfer_state;// Transfer state
     bool stream_open;               // State of the stream
     bool stream_started;            // Stream processing started. This only gets reset remount
@@ -92,9 +128,40 @@ typedef struct {
     bool stream_optional_finish;    // True if the stream processing can be considered done
     bool file_info_optional_finish; // True if the file transfer can be considered done
     bool transfer_timeout;          // Set if the transfer was finished because of a timeout. This only gets reset remount
+    bool host_flushed;              // Set if the host synchronized its cache once the transfer could be finished
     stream_type_t stream;           // Current stream or STREAM_TYPE_NONE is stream is closed.  This only gets reset remount
 } file_transfer_state_t;
 
+typedef enum {
+    FLASH_REQUEST_OPEN,
+    FLASH_REQUEST_WRITE,
+    FLASH_REQUEST_CLOSE,
+} flash_request_t;
+
+// Request queued to the flashing task
+typedef struct {
+    flash_request_t request;
+    uint32_t arg;                   // Stream type for open, file size at the time of the write
+    uint32_t size;                  // Number of valid bytes in data
+    uint32_t data[VFS_SECTOR_SIZE / sizeof(uint32_t)];
+} flash_block_t;
+
+// Stream state owned by the flashing task. Access must be synchronized.
+typedef struct {
+    uint32_t size_processed;        // The number of bytes processed by the stream
+    uint32_t writes_pending;        // Write requests queued but not processed yet
+    error_t status;                 // Status of the last stream operation
+    bool stream_open;               // State of the stream
+    bool stream_finished;           // Stream processing is done
+    bool stream_optional_finish;    // True if the stream processing can be considered done
+} flash_task_state_t;
+
+// Sector received ahead of file_next_sector
+typedef struct {
+    vfs_sector_t sector;            // Sector held or VFS_INVALID_SECTOR if the slot is free
+    uint32_t data[VFS_SECTOR_SIZE / sizeof(uint32_t)];
+} reorder_slot_t;
+
 typedef enum {
     VFS_MNGR_STATE_DISCONNECTED,
     VFS_MNGR_STATE_RECONNECTING,
@@ -109,6 +176,7 @@ static const file_transfer_state_t default_transfer_state = {
     0,
     0,
     0,
+    0,
     TRANSFER_NOT_STARTED,
     false,
     false,
@@ -116,11 +184,13 @@ static const file_transfer_state_t default_transfer_state = {
     false,
     false,
     false,
+    false,
     STREAM_TYPE_NONE,
 };
 
-static uint32_t usb_buffer[VFS_SECTOR_SIZE / sizeof(uint32_t)];
+static uint32_t usb_buffer[VFS_MSC_BLOCK_GROUP * VFS_SECTOR_SIZE / sizeof(uint32_t)];
 static error_t fail_reason = ERROR_SUCCESS;
+static uint8_t last_target = Target_UNKNOWN;
 static file_transfer_state_t file_transfer_state;
 
 // These variables can be access from multiple threads
@@ -135,16 +205,46 @@ static OS_TID sync_thread = 0;
 // the drag&drop file is Bin/Hex format
 static bool   fileIsBinOrHex = false;
 
+#if VFS_FLASH_TASK
+// Flashing task and the queue of sector buffers feeding it
+static OS_TID flash_task_id = 0;
+static U64 stk_flash_task[FLASH_TASK_STACK / sizeof(U64)];
+static _declare_box(flash_pool, sizeof(flash_block_t), FLASH_QUEUE_DEPTH);
+static os_mbx_declare(flash_mailbox, FLASH_QUEUE_DEPTH);
+static OS_SEM flash_free_sem;
+static OS_SEM flash_done_sem;
+#endif
+static flash_task_state_t flash_task_state;
+
+#if VFS_REORDER_SLOTS > 0
+// Sectors of the file being programmed which arrived early
+static reorder_slot_t reorder_slots[VFS_REORDER_SLOTS];
+#endif
+
 // Synchronization functions
 static void sync_init(void);
 static void sync_assert_usb_thread(void);
 static void sync_lock(void);
 static void sync_unlock(void);
 
+// Flashing task functions
+#if VFS_FLASH_TASK
+static __task void flash_task(void);
+static flash_block_t *flash_block_alloc(flash_request_t request);
+static void flash_block_send(flash_block_t *block);
+#endif
+static error_t flash_request_sync(flash_request_t request, uint32_t arg);
+static void flash_process_request(flash_request_t request, uint32_t arg);
+static void flash_process_write(uint32_t file_size, const uint8_t *data, uint32_t size);
+
 static bool changing_state(void);
 static void build_filesystem(void);
 static void file_change_handler(const vfs_filename_t filename, vfs_file_change_t change, vfs_file_t file, vfs_file_t new_file_data);
 static void file_data_handler(uint32_t sector, const uint8_t *buf, uint32_t num_of_sectors);
+static void file_data_in_order(uint32_t sector, const uint8_t *buf, uint32_t num_of_sectors);
+static bool reorder_hold(uint32_t sector, const uint8_t *buf);
+static reorder_slot_t *reorder_find(uint32_t sector);
+static void reorder_reset(void);
 static bool ready_for_state_change(void);
 static void abort_remount(void);
 
@@ -152,6 +252,9 @@ static void transfer_update_file_info(vfs_file_t file, uint32_t start_sector, ui
 static void transfer_reset_file_info(void);
 static void transfer_stream_open(stream_type_t stream, uint32_t start_sector);
 static void transfer_stream_data(uint32_t sector, const uint8_t *data, uint32_t size);
+static void transfer_update_chain(void);
+static bool transfer_stream_poll(void);
+static error_t transfer_stream_close(void);
 static void transfer_update_state(error_t status);
 
 
@@ -216,9 +319,16 @@ void vfs_mngr_periodic(uint32_t elapsed_ms)
     bool change_state;
     vfs_mngr_state_t vfs_state_local;
     vfs_mngr_state_t vfs_state_local_prev;
+    bool flash_busy;
     sync_assert_usb_thread();
+    flash_busy = transfer_stream_poll();
     sync_lock();
 
+    // Sectors still being programmed count as USB activity
+    if (flash_busy) {
+        time_usb_idle = 0;
+    }
+
     // Return immediately if the desired state has been reached
     if (!changing_state()) {
         sync_unlock();
@@ -288,10 +398,15 @@ void vfs_mngr_periodic(uint32_t elapsed_ms)
     switch (vfs_state_local) {
         case VFS_MNGR_STATE_DISCONNECTED:
             USBD_MSC_MediaReady = 0;
+            USBD_MSC_MediaChanged = 0;
             break;
 
         case VFS_MNGR_STATE_RECONNECTING:
             USBD_MSC_MediaReady = 0;
+            // Unless a full remount is configured the drive reports it is
+            // becoming ready and then that the medium changed, instead of
+            // looking removed while the filesystem is rebuilt
+            USBD_MSC_MediaChanged = !config_get_full_remount();
             break;
 
         case VFS_MNGR_STATE_CONNECTED:
@@ -309,6 +424,12 @@ error_t vfs_mngr_get_transfer_status()
     return fail_reason;
 }
 
+uint8_t vfs_mngr_get_last_target()
+{
+    sync_assert_usb_thread();
+    return last_target;
+}
+
 void usbd_msc_init(void)
 {
     sync_init();
@@ -319,16 +440,16 @@ void usbd_msc_init(void)
     USBD_MSC_MediaReady = 0;
 }
 
-void usbd_msc_read_sect(uint32_t sector, uint8_t *buf, uint32_t num_of_sectors)
+BOOL usbd_msc_read_sect(uint32_t sector, uint8_t *buf, uint32_t num_of_sectors)
 {
     sync_assert_usb_thread();
 
     // dont proceed if we're not ready
     if (!USBD_MSC_MediaReady) {
-        return;
+        return __FALSE;
     }
 
-    vfs_read(sector, buf, num_of_sectors);
+    return vfs_read(sector, buf, num_of_sectors) ? __TRUE : __FALSE;
 }
 
 void usbd_msc_write_sect(uint32_t sector, uint8_t *buf, uint32_t num_of_sectors)
@@ -344,6 +465,9 @@ void usbd_msc_write_sect(uint32_t sector, uint8_t *buf, uint32_t num_of_sectors)
     // transfer.
     time_usb_idle = 0;
 
+    // Pick up the progress of the flashing task
+    transfer_stream_poll();
+
     if (TRASNFER_FINISHED == file_transfer_state.transfer_state) {
         return;
     }
@@ -351,16 +475,49 @@ void usbd_msc_write_sect(uint32_t sector, uint8_t *buf, uint32_t num_of_sectors)
     // indicate msc activity
     main_blink_hid_led(MAIN_LED_FLASH);
     vfs_write(sector, buf, num_of_sectors);
+    transfer_update_chain();
     if (TRASNFER_FINISHED == file_transfer_state.transfer_state) {
         return;
     }
     file_data_handler(sector, buf, num_of_sectors);
 }
 
+void usbd_msc_flush(void)
+{
+    sync_assert_usb_thread();
+
+    if (!USBD_MSC_MediaReady) {
+        return;
+    }
+
+    transfer_stream_poll();
+
+    // Everything the host had to write has been written so a transfer
+    // which can be finished does not need to wait for the idle timeout
+    if (TRANSFER_CAN_BE_FINISHED == file_transfer_state.transfer_state) {
+        vfs_mngr_printf("vfs_manager usbd_msc_flush() - finishing transfer\r\n");
+        file_transfer_state.host_flushed = true;
+        transfer_update_state(ERROR_SUCCESS);
+    }
+}
+
 static void sync_init(void)
 {
     sync_thread = os_tsk_self();
     os_mut_init(&sync_mutex);
+
+#if VFS_FLASH_TASK
+    if (0 == flash_task_id) {
+        _init_box(flash_pool, sizeof(flash_pool), sizeof(flash_block_t));
+        os_mbx_init(&flash_mailbox, sizeof(flash_mailbox));
+        os_sem_init(&flash_free_sem, FLASH_QUEUE_DEPTH);
+        os_sem_init(&flash_done_sem, 0);
+        memset(&flash_task_state, 0, sizeof(flash_task_state));
+        flash_task_id = os_tsk_create_user(flash_task, FLASH_TASK_PRIORITY,
+                                           (void *)stk_flash_task, FLASH_TASK_STACK);
+        util_assert(flash_task_id != 0);
+    }
+#endif
 }
 
 static void sync_assert_usb_thread(void)
@@ -378,6 +535,171 @@ static void sync_unlock(void)
     os_mut_release(&sync_mutex);
 }
 
+#if VFS_FLASH_TASK
+// Task performing all stream operations so target programming
+// does not block the thread servicing USB
+static __task void flash_task(void)
+{
+    flash_block_t *block;
+    flash_request_t request;
+
+    while (1) {
+        os_mbx_wait(&flash_mailbox, (void **)&block, 0xFFFF);
+        request = block->request;
+
+        if (FLASH_REQUEST_WRITE == request) {
+            flash_process_write(block->arg, (uint8_t *)block->data, block->size);
+        } else {
+            flash_process_request(request, block->arg);
+        }
+
+        _free_box(flash_pool, block);
+        os_sem_send(&flash_free_sem);
+
+        if (request != FLASH_REQUEST_WRITE) {
+            os_sem_send(&flash_done_sem);
+        }
+    }
+}
+#endif
+
+// Open or close the stream, on the flashing task or the USB thread
+static void flash_process_request(flash_request_t request, uint32_t arg)
+{
+    error_t status;
+
+    switch (request) {
+        case FLASH_REQUEST_OPEN:
+            status = stream_open((stream_type_t)arg);
+            sync_lock();
+            flash_task_state.size_processed = 0;
+            flash_task_state.status = status;
+            flash_task_state.stream_open = (ERROR_SUCCESS == status);
+            flash_task_state.stream_finished = false;
+            flash_task_state.stream_optional_finish = false;
+            sync_unlock();
+            break;
+
+        case FLASH_REQUEST_CLOSE:
+            // Writes queued ahead of the close have been processed by now
+            status = ERROR_SUCCESS;
+
+            if (flash_task_state.stream_open) {
+                status = stream_close();
+            }
+
+            sync_lock();
+            flash_task_state.stream_open = false;
+
+            if (ERROR_SUCCESS == flash_task_state.status) {
+                flash_task_state.status = status;
+            }
+
+            sync_unlock();
+            break;
+
+        default:
+            util_assert(0);
+            break;
+    }
+}
+
+// Write one sector to the stream.  file_size is the size of the file
+// known when the sector arrived.
+static void flash_process_write(uint32_t file_size, const uint8_t *data, uint32_t size)
+{
+    error_t status;
+    bool close;
+    bool finished = false;
+    bool optional_finish;
+
+    // Drop data once the stream is done or has failed
+    if (!flash_task_state.stream_open || flash_task_state.stream_finished ||
+            (ERROR_SUCCESS != flash_task_state.status)) {
+        sync_lock();
+        flash_task_state.writes_pending--;
+        sync_unlock();
+        return;
+    }
+
+    status = stream_write((uint8_t *)data, size);
+    vfs_mngr_printf("    stream_write ret=%i\r\n", status);
+    close = (ERROR_SUCCESS_DONE == status);
+    optional_finish = close;
+
+    if (ERROR_SUCCESS_DONE_OR_CONTINUE == status) {
+        // Compare against the file size known when the sector arrived.
+        // A size of 0 means the directory entry has not been written yet
+        // and data past the size means the host has not updated it yet.
+        close = (flash_task_state.size_processed < file_size) &&
+                (flash_task_state.size_processed + size >= file_size);
+        optional_finish = true;
+        status = ERROR_SUCCESS;
+    }
+
+    if (close) {
+        // Override status so ERROR_SUCCESS_DONE
+        // does not get passed into transfer_update_state
+        status = stream_close();
+        vfs_mngr_printf("    stream_close ret=%i\r\n", status);
+        finished = true;
+    }
+
+    sync_lock();
+    flash_task_state.size_processed += size;
+    flash_task_state.writes_pending--;
+    flash_task_state.status = status;
+    flash_task_state.stream_optional_finish = optional_finish;
+
+    if (finished) {
+        flash_task_state.stream_open = false;
+        flash_task_state.stream_finished = true;
+    }
+
+    sync_unlock();
+}
+
+#if VFS_FLASH_TASK
+// Get a free block, waiting for the flashing task to release one if
+// all of them are queued
+static flash_block_t *flash_block_alloc(flash_request_t request)
+{
+    flash_block_t *block;
+    os_sem_wait(&flash_free_sem, 0xFFFF);
+    block = (flash_block_t *)_alloc_box(flash_pool);
+    util_assert(block != 0);
+    block->request = request;
+    block->arg = 0;
+    block->size = 0;
+    return block;
+}
+
+static void flash_block_send(flash_block_t *block)
+{
+    os_mbx_send(&flash_mailbox, block, 0xFFFF);
+}
+#endif
+
+// Queue a request and wait until the flashing task has handled it
+// along with all the writes queued before it
+static error_t flash_request_sync(flash_request_t request, uint32_t arg)
+{
+    error_t status;
+#if VFS_FLASH_TASK
+    flash_block_t *block;
+    block = flash_block_alloc(request);
+    block->arg = arg;
+    flash_block_send(block);
+    os_sem_wait(&flash_done_sem, 0xFFFF);
+#else
+    flash_process_request(request, arg);
+#endif
+    sync_lock();
+    status = flash_task_state.status;
+    sync_unlock();
+    return status;
+}
+
 static bool changing_state()
 {
     return vfs_state != vfs_state_next;
@@ -390,12 +712,14 @@ static void build_filesystem()
 
     // Update anything that could have changed file system state
     file_transfer_state = default_transfer_state;
+    reorder_reset();
     vfs_user_build_filesystem();
+    vfs_chain_track(VFS_INVALID_SECTOR);
     vfs_set_file_change_callback(file_change_handler);
     // Set mass storage parameters
     USBD_MSC_MemorySize = vfs_get_total_size();
     USBD_MSC_BlockSize  = VFS_SECTOR_SIZE;
-    USBD_MSC_BlockGroup = 1;
+    USBD_MSC_BlockGroup = VFS_MSC_BLOCK_GROUP;
     USBD_MSC_BlockCount = USBD_MSC_MemorySize / USBD_MSC_BlockSize;
     USBD_MSC_BlockBuf   = (uint8_t *)usb_buffer;
 }
@@ -451,13 +775,16 @@ static void file_change_handler(const vfs_filename_t filename, vfs_file_change_t
 static void file_data_handler(uint32_t sector, const uint8_t *buf, uint32_t num_of_sectors)
 {
     stream_type_t stream;
-    uint32_t size;
+    reorder_slot_t *slot;
+    uint32_t i;
 
     // this is the key for starting a file write - we dont care what file types are sent
     //  just look for something unique (NVIC table, hex, srec, etc) until root dir is updated
     if (!file_transfer_state.stream_started && fileIsBinOrHex == true) {
-        if ( targetID == Target_UNKNOWN ) {
+        // Detection resets the target so leave it alone while it is in use
+        if ((targetID == Target_UNKNOWN) && target_flash_lock(0)) {
             targetID = swd_init_get_target();
+            target_flash_unlock();
         }
         // look for file types we can program
         stream = stream_start_identify((uint8_t *)buf, VFS_SECTOR_SIZE * num_of_sectors);
@@ -477,6 +804,14 @@ static void file_data_handler(uint32_t sector, const uint8_t *buf, uint32_t num_
         if (sector != file_transfer_state.file_next_sector) {
             vfs_mngr_printf("vfs_manager file_data_handler sector=%i\r\n", sector);
 
+            // Hold sectors arriving early until the gap before them is filled
+            if ((sector > file_transfer_state.file_next_sector) && (1 == num_of_sectors) &&
+                    reorder_hold(sector, buf)) {
+                vfs_mngr_printf("    holding sector until file_next_sector=%i arrives\r\n",
+                                file_transfer_state.file_next_sector);
+                return;
+            }
+
             if (sector < file_transfer_state.file_next_sector) {
                 vfs_mngr_printf("    sector out of order! lowest ooo = %i\r\n",
                                 file_transfer_state.last_ooo_sector);
@@ -496,22 +831,117 @@ static void file_data_handler(uint32_t sector, const uint8_t *buf, uint32_t num_
             return;
         }
 
-        // This sector could be part of the file so record it
-        size = VFS_SECTOR_SIZE * num_of_sectors;
-        file_transfer_state.size_transferred += size;
-        file_transfer_state.file_next_sector = sector + num_of_sectors;
+        // Copies held of the sectors arriving now are out of date
+        for (i = 0; i < num_of_sectors; i++) {
+            slot = reorder_find(sector + i);
 
-        // If stream processing is done then discard the data
-        if (file_transfer_state.stream_finished) {
-            vfs_mngr_printf("vfs_manager file_data_handler\r\n    sector=%i, size=%i\r\n", sector, size);
-            vfs_mngr_printf("    discarding data - size transferred=0x%x, data=%x,%x,%x,%x,...\r\n",
-                            file_transfer_state.size_transferred, buf[0], buf[1], buf[2], buf[3]);
-            transfer_update_state(ERROR_SUCCESS);
-            return;
+            if (slot != 0) {
+                slot->sector = VFS_INVALID_SECTOR;
+            }
+        }
+
+        file_data_in_order(sector, buf, num_of_sectors);
+
+        // Release the held sectors which are now in order
+        while (TRASNFER_FINISHED != file_transfer_state.transfer_state) {
+            slot = reorder_find(file_transfer_state.file_next_sector);
+
+            if (0 == slot) {
+                break;
+            }
+
+            file_data_in_order(slot->sector, (uint8_t *)slot->data, 1);
+            slot->sector = VFS_INVALID_SECTOR;
+        }
+    }
+}
+
+// Pass the next sectors of the file on to the stream
+static void file_data_in_order(uint32_t sector, const uint8_t *buf, uint32_t num_of_sectors)
+{
+    uint32_t size;
+
+    // This sector could be part of the file so record it
+    size = VFS_SECTOR_SIZE * num_of_sectors;
+    file_transfer_state.size_transferred += size;
+    file_transfer_state.file_next_sector = sector + num_of_sectors;
+
+    // If stream processing is done then discard the data
+    if (file_transfer_state.stream_finished) {
+        vfs_mngr_printf("vfs_manager file_data_handler\r\n    sector=%i, size=%i\r\n", sector, size);
+        vfs_mngr_printf("    discarding data - size transferred=0x%x, data=%x,%x,%x,%x,...\r\n",
+                        file_transfer_state.size_transferred, buf[0], buf[1], buf[2], buf[3]);
+        transfer_update_state(ERROR_SUCCESS);
+        return;
+    }
+
+    transfer_stream_data(sector, buf, size);
+}
+
+// Copy a sector which arrived ahead of file_next_sector into a free slot.
+// Returns false if the sector cannot be part of the file or no slot is
+// free, in which case the caller falls back to discarding it.
+static bool reorder_hold(uint32_t sector, const uint8_t *buf)
+{
+#if VFS_REORDER_SLOTS > 0
+    reorder_slot_t *slot;
+    uint32_t i;
+
+    if (sector - file_transfer_state.file_next_sector > VFS_REORDER_WINDOW) {
+        return false;
+    }
+
+    // Once the size is known sectors past the end are not part of the file
+    if ((file_transfer_state.file_size > 0) &&
+            ((sector - file_transfer_state.start_sector) * VFS_SECTOR_SIZE >= file_transfer_state.file_size)) {
+        return false;
+    }
+
+    // A sector written again replaces the copy already held
+    slot = reorder_find(sector);
+
+    for (i = 0; (0 == slot) && (i < ELEMENTS_IN_ARRAY(reorder_slots)); i++) {
+        if (VFS_INVALID_SECTOR == reorder_slots[i].sector) {
+            slot = &reorder_slots[i];
+        }
+    }
+
+    if (0 == slot) {
+        return false;
+    }
+
+    slot->sector = sector;
+    memcpy(slot->data, buf, VFS_SECTOR_SIZE);
+    return true;
+#else
+    return false;
+#endif
+}
+
+static reorder_slot_t *reorder_find(uint32_t sector)
+{
+#if VFS_REORDER_SLOTS > 0
+    uint32_t i;
+
+    for (i = 0; i < ELEMENTS_IN_ARRAY(reorder_slots); i++) {
+        if (sector == reorder_slots[i].sector) {
+            return &reorder_slots[i];
         }
+    }
+#endif
 
-        transfer_stream_data(sector, buf, size);
+    return 0;
+}
+
+static void reorder_reset(void)
+{
+#if VFS_REORDER_SLOTS > 0
+    uint32_t i;
+
+    for (i = 0; i < ELEMENTS_IN_ARRAY(reorder_slots); i++) {
+        reorder_slots[i].sector = VFS_INVALID_SECTOR;
     }
+#endif
 }
 
 static bool ready_for_state_change(void)
@@ -544,7 +974,7 @@ static bool ready_for_state_change(void)
         timeout_ms = CONNECT_DELAY_MS;
     } else if ((VFS_MNGR_STATE_RECONNECTING == vfs_state) &&
                (VFS_MNGR_STATE_CONNECTED == vfs_state_next)) {
-        timeout_ms = RECONNECT_DELAY_MS;
+        timeout_ms = config_get_full_remount() ? RECONNECT_DELAY_MS : REANNOUNCE_DELAY_MS;
     } else if ((VFS_MNGR_STATE_RECONNECTING == vfs_state) &&
                (VFS_MNGR_STATE_DISCONNECTED == vfs_state_next)) {
         timeout_ms = 0;
@@ -596,6 +1026,7 @@ static void transfer_update_file_info(vfs_file_t file, uint32_t start_sector, ui
 
         if (start_sector != VFS_INVALID_SECTOR) {
             vfs_mngr_printf("    start_sector=%i\r\n", start_sector);
+            vfs_chain_track(start_sector);
         }
     }
 
@@ -644,6 +1075,8 @@ static void transfer_reset_file_info()
         transfer_update_state(ERROR_ERROR_DURING_TRANSFER);
     } else {
         file_transfer_state = default_transfer_state;
+        reorder_reset();
+        vfs_chain_track(VFS_INVALID_SECTOR);
         abort_remount();
     }
 }
@@ -663,6 +1096,7 @@ static void transfer_stream_open(stream_type_t stream, uint32_t start_sector)
 
         if (start_sector != VFS_INVALID_SECTOR) {
             vfs_mngr_printf("    start_sector=%i\r\n", start_sector);
+            vfs_chain_track(start_sector);
         }
     }
 
@@ -690,7 +1124,7 @@ static void transfer_stream_open(stream_type_t stream, uint32_t start_sector)
     }
 
     // Open stream
-    status = stream_open(stream);
+    status = flash_request_sync(FLASH_REQUEST_OPEN, stream);
     vfs_mngr_printf("    stream_open stream=%i ret %i\r\n", stream, status);
 
     if (ERROR_SUCCESS == status) {
@@ -702,10 +1136,13 @@ static void transfer_stream_open(stream_type_t stream, uint32_t start_sector)
     transfer_update_state(status);
 }
 
-// Update the tranfer state with new information
+// Queue data for the flashing task, or write it right away when there is
+// none.  The result is picked up later by transfer_stream_poll.
 static void transfer_stream_data(uint32_t sector, const uint8_t *data, uint32_t size)
 {
-    error_t status;
+#if VFS_FLASH_TASK
+    flash_block_t *block;
+#endif
     vfs_mngr_printf("vfs_manager transfer_stream_data(sector=%i, size=%i)\r\n", sector, size);
     vfs_mngr_printf("    size processed=0x%x, data=%x,%x,%x,%x,...\r\n",
                     file_transfer_state.size_processed, data[0], data[1], data[2], data[3]);
@@ -717,38 +1154,76 @@ static void transfer_stream_data(uint32_t sector, const uint8_t *data, uint32_t
 
     util_assert(size % VFS_SECTOR_SIZE == 0);
     util_assert(file_transfer_state.stream_open);
-    status = stream_write((uint8_t *)data, size);
-    vfs_mngr_printf("    stream_write ret=%i\r\n", status);
-    file_transfer_state.size_processed += size;
 
-    if (ERROR_SUCCESS_DONE == status) {
-        // Override status so ERROR_SUCCESS_DONE
-        // does not get passed into transfer_update_state
-        status = stream_close();
-        vfs_mngr_printf("    stream_close ret=%i\r\n", status);
-        file_transfer_state.stream_open = false;
-        file_transfer_state.stream_finished = true;
-        file_transfer_state.stream_optional_finish = true;
-    } else if (ERROR_SUCCESS_DONE_OR_CONTINUE == status) {
-        if (file_transfer_state.size_processed < file_transfer_state.file_size)
-        {
-            status = ERROR_SUCCESS;
-            file_transfer_state.stream_optional_finish = true;
-        }
-        else
-        {
-            status = stream_close();
-            vfs_mngr_printf("    stream_close ret=%i\r\n", status);
-            file_transfer_state.stream_open = false;
-            file_transfer_state.stream_finished = true;
-            file_transfer_state.stream_optional_finish = true;            
-        }
-    } else {
-        file_transfer_state.stream_optional_finish = false;
+    while (size > 0) {
+#if VFS_FLASH_TASK
+        block = flash_block_alloc(FLASH_REQUEST_WRITE);
+        block->arg = file_transfer_state.file_size;
+        block->size = VFS_SECTOR_SIZE;
+        memcpy(block->data, data, VFS_SECTOR_SIZE);
+        sync_lock();
+        flash_task_state.writes_pending++;
+        sync_unlock();
+        flash_block_send(block);
+#else
+        flash_task_state.writes_pending++;
+        flash_process_write(file_transfer_state.file_size, data, VFS_SECTOR_SIZE);
+#endif
+        data += VFS_SECTOR_SIZE;
+        size -= VFS_SECTOR_SIZE;
     }
+}
 
+// Update the transfer state when the end of the file's cluster chain
+// has been written to the FAT
+static void transfer_update_chain(void)
+{
+    uint32_t chain_size = vfs_chain_get_size();
 
-    transfer_update_state(status);
+    if ((chain_size == file_transfer_state.chain_size) ||
+            (TRASNFER_FINISHED == file_transfer_state.transfer_state)) {
+        return;
+    }
+
+    vfs_mngr_printf("vfs_manager transfer_update_chain(chain_size=%i)\r\n", chain_size);
+    file_transfer_state.chain_size = chain_size;
+    transfer_update_state(ERROR_SUCCESS);
+}
+
+// Update the transfer state with the progress of the flashing task.
+// Returns true if there are writes which have not been processed yet.
+static bool transfer_stream_poll(void)
+{
+    flash_task_state_t state;
+    bool changed;
+    sync_lock();
+    state = flash_task_state;
+    sync_unlock();
+
+    if (!file_transfer_state.stream_open) {
+        return state.writes_pending > 0;
+    }
+
+    changed = (state.size_processed != file_transfer_state.size_processed) ||
+              (state.stream_finished != file_transfer_state.stream_finished) ||
+              (state.stream_optional_finish != file_transfer_state.stream_optional_finish) ||
+              (ERROR_SUCCESS != state.status);
+    file_transfer_state.size_processed = state.size_processed;
+    file_transfer_state.stream_open = state.stream_open;
+    file_transfer_state.stream_finished = state.stream_finished;
+    file_transfer_state.stream_optional_finish = state.stream_optional_finish;
+
+    if (changed && (TRASNFER_FINISHED != file_transfer_state.transfer_state)) {
+        transfer_update_state(state.status);
+    }
+
+    return state.writes_pending > 0;
+}
+
+// Close the stream once all queued data has been processed
+static error_t transfer_stream_close(void)
+{
+    return flash_request_sync(FLASH_REQUEST_CLOSE, 0);
 }
 
 // Check if the current transfer is still in progress, done, or if an error has occurred
@@ -758,6 +1233,7 @@ static void transfer_update_state(error_t status)
     bool transfer_started;
     bool transfer_can_be_finished;
     bool transfer_must_be_finished;
+    bool transfer_end_confirmed;
     bool out_of_order_sector;
     error_t local_status = status;
     util_assert((status != ERROR_SUCCESS_DONE) &&
@@ -774,10 +1250,24 @@ static void transfer_update_state(error_t status)
     // 1. A file has been detected
     // 2. The size of the file indicated in the root dir has been transferred
     // 3. The file size is greater than zero
-    file_transfer_state.file_info_optional_finish =
-        (file_transfer_state.file_to_program != VFS_FILE_INVALID) &&
-        (file_transfer_state.size_transferred >= file_transfer_state.file_size) &&
-        (file_transfer_state.file_size > 0);
+    // If the root dir has not been given a size yet data reaching the last
+    // cluster of the file's chain in the FAT is used instead.
+    if (file_transfer_state.file_size > 0) {
+        file_transfer_state.file_info_optional_finish =
+            (file_transfer_state.file_to_program != VFS_FILE_INVALID) &&
+            (file_transfer_state.size_transferred >= file_transfer_state.file_size);
+    } else {
+        file_transfer_state.file_info_optional_finish =
+            (file_transfer_state.file_to_program != VFS_FILE_INVALID) &&
+            (file_transfer_state.chain_size > 0) &&
+            (file_transfer_state.size_transferred + VFS_CLUSTER_SIZE > file_transfer_state.chain_size);
+    }
+
+    // The end of the file is confirmed once the host has flushed its cache
+    // with all the data written.  The root dir and FAT agreeing on the
+    // size is not enough since some hosts update both after every part
+    // of the file.  Without a flush the transfer ends on the idle timeout.
+    transfer_end_confirmed = file_transfer_state.host_flushed;
     transfer_timeout = file_transfer_state.transfer_timeout;
     transfer_started = (VFS_FILE_INVALID != file_transfer_state.file_to_program) ||
                        (STREAM_TYPE_NONE != file_transfer_state.stream);
@@ -786,9 +1276,11 @@ static void transfer_update_state(error_t status)
     transfer_can_be_finished = file_transfer_state.file_info_optional_finish &&
                                file_transfer_state.stream_optional_finish;
     // The transfer must be fnished if stream processing is for sure complete
-    // and file processing can be considered complete
-    transfer_must_be_finished = file_transfer_state.stream_finished &&
-                                file_transfer_state.file_info_optional_finish;
+    // and file processing can be considered complete, or if both can be
+    // considered complete and the end of the file has been confirmed
+    transfer_must_be_finished = (file_transfer_state.stream_finished &&
+                                 file_transfer_state.file_info_optional_finish) ||
+                                (transfer_can_be_finished && transfer_end_confirmed);
     out_of_order_sector = false;
 
     if (file_transfer_state.last_ooo_sector != VFS_INVALID_SECTOR) {
@@ -838,7 +1330,7 @@ static void transfer_update_state(error_t status)
         // Close the file stream if it is open
         if (file_transfer_state.stream_open) {
             error_t close_status;
-            close_status = stream_close();
+            close_status = transfer_stream_close();
             vfs_mngr_printf("    stream closed ret=%i\r\n", close_status);
             file_transfer_state.stream_open = false;
 
@@ -851,8 +1343,10 @@ static void transfer_update_state(error_t status)
         fail_reason = local_status;
         vfs_mngr_printf("    Transfer finished, status: %i=%s\r\n", fail_reason, error_get_string(fail_reason));
         
-        target_set_state(RESET_RUN);
-        targetID = Target_UNKNOWN;
+        if (targetID != Target_UNKNOWN) {
+            last_target = targetID;
+        }
+        target_flash_session_release();
         
     }
 
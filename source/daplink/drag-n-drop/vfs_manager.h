@@ -64,6 +64,10 @@ void vfs_mngr_periodic(uint32_t elapsed_ms);
 // if none have been performed yet
 error_t vfs_mngr_get_transfer_status(void);
 
+// Return the target detected by the last transfer or Target_UNKNOWN
+// if none have been performed yet
+uint8_t vfs_mngr_get_last_target(void);
+
 
 /* Use functions */
 
@@ -35,11 +35,24 @@
 #include "info.h"
 #include "gpio.h"           // for gpio_get_sw_reset
 #include "flash_intf.h"     // for flash_intf_target
+#include "perf_counter.h"
+#include "compiler.h"
+#include "target_ids.h"
+#include "target_config.h"  // for target_device
 
 // Must be bigger than 4x the flash size of the biggest supported
 // device.  This is to accomodate for hex file programming.
 static const uint32_t disc_size = MB(64);
 
+// Size of the read ahead buffer for FLASH.BIN.  A miss reads this much
+// target memory in one go so the sectors which follow are already here.
+// With 0 every read goes to the target, see records/hic_hal.
+#ifndef FLASH_BIN_CACHE_SIZE
+#define FLASH_BIN_CACHE_SIZE    (2 * VFS_SECTOR_SIZE)
+#endif
+COMPILER_ASSERT(FLASH_BIN_CACHE_SIZE % VFS_SECTOR_SIZE == 0);
+COMPILER_ASSERT(PERF_REPORT_MAX_SIZE <= VFS_SECTOR_SIZE);
+
 //static const char mbed_redirect_file[] =
 //    "<!doctype html>\r\n"
 //    "<!-- mbed Platform Website and Authentication Shortcut -->\r\n"
@@ -62,14 +75,35 @@ static char assert_buf[64 + 1];
 static uint16_t assert_line;
 static assert_source_t assert_source;
 static uint32_t remount_count;
+static uint8_t flash_bin_target;
+#if FLASH_BIN_CACHE_SIZE > 0
+static uint8_t flash_bin_cache[FLASH_BIN_CACHE_SIZE];
+static uint32_t flash_bin_cache_addr;
+static uint32_t flash_bin_cache_size;
+#endif
+
+// Render a generated file into buf and return its size
+typedef uint32_t (*vfs_render_cb_t)(char *buf);
+
+// The last generated file read is kept rendered in file_buffer and
+// served from there until another file is read or the drive remounts
+static vfs_render_cb_t cached_render;
+static uint32_t cached_size;
 
 static uint32_t get_file_size(vfs_read_cb_t read_func);
+static uint32_t read_cached(vfs_render_cb_t render, uint32_t sector_offset, uint8_t *data);
 
 //static uint32_t read_file_mbed_htm(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
 static uint32_t read_file_details_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
 static uint32_t read_file_fail_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
 static uint32_t read_file_assert_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
 static uint32_t read_file_need_bl_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
+static uint32_t render_details_txt(char *buf);
+static uint32_t render_fail_txt(char *buf);
+static uint32_t render_assert_txt(char *buf);
+static uint32_t render_need_bl_txt(char *buf);
+static uint32_t read_file_perf_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
+static uint32_t read_file_flash_bin(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
 
 //static void insert(uint8_t *buf, uint8_t *new_str, uint32_t strip_count);
 //static void update_html_file(uint8_t *buf, uint32_t bufsize);
@@ -79,6 +113,11 @@ void vfs_user_build_filesystem()
 {
     uint32_t file_size;
     vfs_file_t file_handle;
+    // Contents may have changed since the last mount
+    cached_render = 0;
+#if FLASH_BIN_CACHE_SIZE > 0
+    flash_bin_cache_size = 0;
+#endif
     // Setup the filesystem based on target parameters
     vfs_init(daplink_drive_name, disc_size);
     // MBED.HTM
@@ -101,6 +140,22 @@ void vfs_user_build_filesystem()
         vfs_file_set_attr(file_handle, (vfs_file_attr_bit_t)0); // Remove read only attribute
     }
 
+    // PERF.TXT
+    if (daplink_is_interface()) {
+        file_size = get_file_size(read_file_perf_txt);
+        vfs_create_file("PERF    TXT", read_file_perf_txt, 0, file_size);
+    }
+
+    // FLASH.BIN
+    // Detecting the target resets it so the file is only present once a
+    // transfer has identified the target.
+    flash_bin_target = targetID != Target_UNKNOWN ? targetID : vfs_mngr_get_last_target();
+    if (daplink_is_interface() && (flash_bin_target != Target_UNKNOWN) &&
+            (flash_intf_target != 0) && (flash_intf_target->read != 0)) {
+        file_size = target_device[flash_bin_target].flash_end - target_device[flash_bin_target].flash_start;
+        vfs_create_file("FLASH   BIN", read_file_flash_bin, 0, file_size);
+    }
+
     // NEED_BL.TXT
     volatile uint32_t bl_start = DAPLINK_ROM_BL_START; // Silence warnings about null pointer
     volatile uint32_t if_start = DAPLINK_ROM_IF_START; // Silence warnings about null pointer
@@ -167,6 +222,12 @@ void vfs_user_file_change_handler(const vfs_filename_t filename, vfs_file_change
         } else if (!memcmp(filename, "OVFL_OFFCFG", sizeof(vfs_filename_t))) {
             config_set_overflow_detect(false);
             vfs_mngr_fs_remount();
+        } else if (!memcmp(filename, "RMNT_ON CFG", sizeof(vfs_filename_t))) {
+            config_set_full_remount(true);
+            vfs_mngr_fs_remount();
+        } else if (!memcmp(filename, "RMNT_OFFCFG", sizeof(vfs_filename_t))) {
+            config_set_full_remount(false);
+            vfs_mngr_fs_remount();
         }
     }
 
@@ -198,10 +259,32 @@ void vfs_user_disconnecting()
 // The file data must be null terminated for this to work correctly.
 static uint32_t get_file_size(vfs_read_cb_t read_func)
 {
-    // Determine size of the file by faking a read
+    // Determine size of the file by faking a read.  Files which are not
+    // cached also render into file_buffer so drop the cached file first.
+    cached_render = 0;
     return read_func(0, file_buffer, 1);
 }
 
+// Return the contents of a generated file, rendering it only if it is
+// not the file currently held in file_buffer
+static uint32_t read_cached(vfs_render_cb_t render, uint32_t sector_offset, uint8_t *data)
+{
+    if (sector_offset != 0) {
+        return 0;
+    }
+
+    if (cached_render != render) {
+        cached_size = render((char *)file_buffer);
+        cached_render = render;
+    }
+
+    if (data != file_buffer) {
+        memcpy(data, file_buffer, cached_size);
+    }
+
+    return cached_size;
+}
+
 // File callback to be used with vfs_add_file to return file contents
 //static uint32_t read_file_mbed_htm(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
 //{
@@ -215,14 +298,14 @@ static uint32_t get_file_size(vfs_read_cb_t read_func)
 
 // File callback to be used with vfs_add_file to return file contents
 static uint32_t read_file_details_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
+{
+    return read_cached(render_details_txt, sector_offset, data);
+}
+
+static uint32_t render_details_txt(char *buf)
 {
     uint32_t pos;
     const char *mode_str;
-    char *buf = (char *)data;
-
-    if (sector_offset != 0) {
-        return 0;
-    }
 
     pos = 0;
     pos += util_write_string(buf + pos, "# DAPLink Firmware - see https://github.com/mesheven/DAPLink\r\n");
@@ -244,6 +327,9 @@ static uint32_t read_file_details_txt(uint32_t sector_offset, uint8_t *data, uin
     pos += util_write_string(buf + pos, "Overflow detection: ");
     pos += util_write_string(buf + pos, config_get_overflow_detect() ? "1" : "0");
     pos += util_write_string(buf + pos, "\r\n");
+    pos += util_write_string(buf + pos, "Full remount: ");
+    pos += util_write_string(buf + pos, config_get_full_remount() ? "1" : "0");
+    pos += util_write_string(buf + pos, "\r\n");
     // Current mode
     mode_str = daplink_is_bootloader() ? "Bootloader" : "Interface";
     pos += util_write_string(buf + pos, "Daplink Mode: ");
@@ -310,32 +396,33 @@ static uint32_t read_file_details_txt(uint32_t sector_offset, uint8_t *data, uin
 
 // File callback to be used with vfs_add_file to return file contents
 static uint32_t read_file_fail_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
+{
+    return read_cached(render_fail_txt, sector_offset, data);
+}
+
+static uint32_t render_fail_txt(char *buf)
 {
     const char *contents = (const char *)error_get_string(vfs_mngr_get_transfer_status());
     uint32_t size = strlen(contents);
 
-    if (sector_offset != 0) {
-        return 0;
-    }
-
-    memcpy(data, contents, size);
-    data[size] = '\r';
+    memcpy(buf, contents, size);
+    buf[size] = '\r';
     size++;
-    data[size] = '\n';
+    buf[size] = '\n';
     size++;
     return size;
 }
 
 // File callback to be used with vfs_add_file to return file contents
 static uint32_t read_file_assert_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
+{
+    return read_cached(render_assert_txt, sector_offset, data);
+}
+
+static uint32_t render_assert_txt(char *buf)
 {
     uint32_t pos;
     const char *source_str;
-    char *buf = (char *)data;
-
-    if (sector_offset != 0) {
-        return 0;
-    }
 
     pos = 0;
 
@@ -366,16 +453,69 @@ static uint32_t read_file_assert_txt(uint32_t sector_offset, uint8_t *data, uint
 
 // File callback to be used with vfs_add_file to return file contents
 static uint32_t read_file_need_bl_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
+{
+    return read_cached(render_need_bl_txt, sector_offset, data);
+}
+
+static uint32_t render_need_bl_txt(char *buf)
 {
     const char *contents = "A bootloader update was started but unable to complete.\r\n"
                            "Reload the bootloader to fix this error message.\r\n";
     uint32_t size = strlen(contents);
 
+    memcpy(buf, contents, size);
+    return size;
+}
+
+// File callback to be used with vfs_add_file to return file contents.
+// Not cached since the counters change between reads.
+static uint32_t read_file_perf_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
+{
     if (sector_offset != 0) {
         return 0;
     }
 
-    memcpy(data, contents, size);
+    return perf_write_report((char *)data);
+}
+
+// File callback to be used with vfs_add_file to return file contents.
+// Target memory is read ahead into flash_bin_cache so consecutive single
+// sector reads only go to the target once per cache fill.  A failed read
+// fails the SCSI command instead of returning zeros.
+static uint32_t read_file_flash_bin(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
+{
+    const target_cfg_t *const target = &target_device[flash_bin_target];
+    uint32_t addr = target->flash_start + sector_offset * VFS_SECTOR_SIZE;
+    uint32_t size = num_sectors * VFS_SECTOR_SIZE;
+
+    if (addr >= target->flash_end) {
+        return 0;
+    }
+
+    size = MIN(size, target->flash_end - addr);
+
+    // Too big to be cached so read it directly
+    if (size > FLASH_BIN_CACHE_SIZE) {
+        if (flash_intf_target->read(addr, data, size) != ERROR_SUCCESS) {
+            return VFS_READ_ERROR;
+        }
+
+        return size;
+    }
+
+#if FLASH_BIN_CACHE_SIZE > 0
+    if ((addr < flash_bin_cache_addr) ||
+            (addr + size > flash_bin_cache_addr + flash_bin_cache_size)) {
+        flash_bin_cache_addr = addr;
+        flash_bin_cache_size = MIN(FLASH_BIN_CACHE_SIZE, target->flash_end - addr);
+        if (flash_intf_target->read(addr, flash_bin_cache, flash_bin_cache_size) != ERROR_SUCCESS) {
+            flash_bin_cache_size = 0;
+            return VFS_READ_ERROR;
+        }
+    }
+
+    memcpy(data, flash_bin_cache + (addr - flash_bin_cache_addr), size);
+#endif
     return size;
 }
 
@@ -467,7 +607,10 @@ static uint32_t read_file_need_bl_txt(uint32_t sector_offset, uint8_t *data, uin
 // Initialize flash algo, erase flash, uninit algo
 static void erase_target(void)
 {
-    flash_intf_target->init();
+    if (ERROR_SUCCESS != flash_intf_target->init()) {
+        return;
+    }
+
     flash_intf_target->erase_chip();
     flash_intf_target->uninit();
 }
@@ -72,10 +72,6 @@ typedef struct {
     uint16_t signature;
 } __attribute__((packed)) mbr_t;
 
-typedef struct file_allocation_table {
-    uint8_t f[512];
-} file_allocation_table_t;
-
 typedef struct FatDirectoryEntry {
     vfs_filename_t filename;
     uint8_t attributes;
@@ -112,12 +108,14 @@ static uint32_t read_mbr(uint32_t offset, uint8_t *data, uint32_t size);
 static uint32_t read_fat(uint32_t offset, uint8_t *data, uint32_t size);
 static uint32_t read_dir(uint32_t offset, uint8_t *data, uint32_t size);
 static void write_dir(uint32_t offset, const uint8_t *data, uint32_t size);
+static void write_chain(uint32_t offset, const uint8_t *data, uint32_t size);
 static void file_change_cb_stub(const vfs_filename_t filename, vfs_file_change_t change,
                                 vfs_file_t file, vfs_file_t new_file_data);
 static uint32_t cluster_to_sector(uint32_t cluster_idx);
 static bool filename_valid(const vfs_filename_t filename);
 static bool filename_character_valid(char character);
 static void set_init_done(void);
+static uint32_t find_media(uint32_t sector);
 
 // If sector size changes update comment below
 COMPILER_ASSERT(0x0200 == VFS_SECTOR_SIZE);
@@ -197,7 +195,7 @@ enum virtual_media_idx_t {
 const virtual_media_t virtual_media_tmpl[] = {
     /*  Read CB         Write CB        Region Size                 Region Name     */
     {   read_mbr,       write_none,     VFS_SECTOR_SIZE         },  /* MBR          */
-    {   read_fat,       write_none,     0 /* Set at runtime */  },  /* FAT1         */
+    {   read_fat,       write_chain,    0 /* Set at runtime */  },  /* FAT1         */
     {   read_fat,       write_none,     0 /* Set at runtime */  },  /* FAT2         */
     {   read_dir,       write_dir,      VFS_SECTOR_SIZE * 2     },  /* Root Dir     */
     /* Raw filesystem contents follow */
@@ -236,37 +234,33 @@ static const FatDirectoryEntry_t dir_entry_tmpl = {
 };
 
 mbr_t mbr;
-file_allocation_table_t fat;
 virtual_media_t virtual_media[16];
 root_dir_t dir_current;
 FatDirectoryEntry_t dir_initial[VFS_MAX_FILES];
 uint8_t file_count;
 vfs_file_change_cb_t file_change_cb;
 uint32_t virtual_media_idx;
-uint32_t fat_idx;
+uint32_t fat_idx;           // First free cluster, all clusters before it belong to files
 uint32_t dir_idx;
 uint32_t data_start;
 bool init_complete;
 
-// Virtual media must be larger than the template
-COMPILER_ASSERT(sizeof(virtual_media) > sizeof(virtual_media_tmpl));
+// Cluster chain of a file followed through the FAT writes of the host
+static uint32_t chain_cluster;      // Last cluster found in the chain or 0 if not tracking
+static uint32_t chain_clusters;     // Number of clusters found in the chain so far
+static uint32_t chain_size;         // Size of the chain while its last entry is the end of chain, otherwise 0
 
-static void write_fat(file_allocation_table_t *fat, uint32_t idx, uint16_t val)
-{
-    uint32_t low_idx;
-    uint32_t high_idx;
-    low_idx = idx * 2 + 0;
-    high_idx = idx * 2 + 1;
+// Number of times the filesystem has been built.  It is added to the
+// volume serial number so a host that compares it sees a new volume after
+// every remount and drops what it cached of the old one.
+static uint32_t mount_count;
 
-    // Assert that this is still within the fat table
-    if (high_idx >= ELEMENTS_IN_ARRAY(fat->f)) {
-        util_assert(0);
-        return;
-    }
+// First sector of each virtual media entry.  Entries are contiguous so
+// this is sorted and can be binary searched.
+static uint32_t media_start[ELEMENTS_IN_ARRAY(virtual_media)];
 
-    fat->f[low_idx] = (val >> 0) & 0xFF;
-    fat->f[high_idx] = (val >> 8) & 0xFF;
-}
+// Virtual media must be larger than the template
+COMPILER_ASSERT(sizeof(virtual_media) > sizeof(virtual_media_tmpl));
 
 void vfs_init(const vfs_filename_t drive_name, uint32_t disk_size)
 {
@@ -275,9 +269,9 @@ void vfs_init(const vfs_filename_t drive_name, uint32_t disk_size)
     uint32_t total_sectors;
     // Clear everything
     memset(&mbr, 0, sizeof(mbr));
-    memset(&fat, 0, sizeof(fat));
     fat_idx = 0;
     memset(&virtual_media, 0, sizeof(virtual_media));
+    memset(&media_start, 0, sizeof(media_start));
     memset(&dir_current, 0, sizeof(dir_current));
     memset(&dir_initial, 0, sizeof(dir_initial));
     dir_idx = 0;
@@ -286,8 +280,10 @@ void vfs_init(const vfs_filename_t drive_name, uint32_t disk_size)
     virtual_media_idx = 0;
     data_start = 0;
     init_complete = false;
+    vfs_chain_track(VFS_INVALID_SECTOR);
     // Initialize MBR
     memcpy(&mbr, &mbr_tmpl, sizeof(mbr_t));
+    mbr.volume_id += mount_count++;
     total_sectors = ((disk_size + KB(64)) / mbr.bytes_per_sector);
     // Make sure this is the right size for a FAT16 volume
     if (total_sectors < FAT_CLUSTERS_MIN * mbr.sectors_per_cluster) {
@@ -317,15 +313,13 @@ void vfs_init(const vfs_filename_t drive_name, uint32_t disk_size)
     data_start = 0;
 
     for (i = 0; i < ELEMENTS_IN_ARRAY(virtual_media_tmpl); i++) {
+        media_start[i] = data_start / VFS_SECTOR_SIZE;
         data_start += virtual_media[i].length;
     }
 
-    // Initialize FAT
-    fat_idx = 0;
-    write_fat(&fat, fat_idx, 0xFFF8);    // Media type "media_descriptor"
-    fat_idx++;
-    write_fat(&fat, fat_idx, 0xFFFF);    // FAT12 - always 0xFFF (no meaning), FAT16 - dirty/clean (clean = 0xFFFF)
-    fat_idx++;
+    // Initialize FAT.  Entries 0 and 1 are reserved and the FAT itself
+    // is generated from the files when it is read.
+    fat_idx = 2;
     // Initialize root dir
     dir_idx = 0;
     dir_current.f[dir_idx] = root_dir_entry;
@@ -353,24 +347,22 @@ vfs_file_t vfs_create_file(const vfs_filename_t filename, vfs_read_cb_t read_cb,
     FatDirectoryEntry_t *de;
     uint32_t clusters;
     uint32_t cluster_size;
-    uint32_t i;
     util_assert(filename_valid(filename));
     // Compute the number of clusters in the file
     cluster_size = mbr.bytes_per_sector * mbr.sectors_per_cluster;
     clusters = (len + cluster_size - 1) / cluster_size;
-    // Write the cluster chain to the fat table
+    // Allocate the clusters.  Files are contiguous so the FAT chain
+    // can be generated from virtual media when it is read.
     first_cluster = 0;
 
     if (len > 0) {
-        first_cluster = fat_idx;
-
-        for (i = 0; i < clusters - 1; i++) {
-            write_fat(&fat, fat_idx, fat_idx + 1);
-            fat_idx++;
+        if (fat_idx + clusters > mbr.logical_sectors_per_fat * VFS_SECTOR_SIZE / sizeof(uint16_t)) {
+            util_assert(0);
+            return VFS_FILE_INVALID;
         }
 
-        write_fat(&fat, fat_idx, 0xFFFF);
-        fat_idx++;
+        first_cluster = fat_idx;
+        fat_idx += clusters;
     }
 
     // Update directory entry
@@ -405,6 +397,8 @@ vfs_file_t vfs_create_file(const vfs_filename_t filename, vfs_read_cb_t read_cb,
     }
 
     virtual_media[virtual_media_idx].length = clusters * mbr.bytes_per_sector * mbr.sectors_per_cluster;
+    media_start[virtual_media_idx] = media_start[virtual_media_idx - 1] +
+                                     virtual_media[virtual_media_idx - 1].length / VFS_SECTOR_SIZE;
     virtual_media_idx++;
     file_count += 1;
     return de;
@@ -444,81 +438,109 @@ void vfs_set_file_change_callback(vfs_file_change_cb_t cb)
     file_change_cb = cb;
 }
 
-void vfs_read(uint32_t requested_sector, uint8_t *buf, uint32_t num_sectors)
+bool vfs_read(uint32_t requested_sector, uint8_t *buf, uint32_t num_sectors)
 {
-    uint8_t i = 0;
-    uint32_t current_sector;
-    // Zero out the buffer
-    memset(buf, 0, num_sectors * VFS_SECTOR_SIZE);
-    current_sector = 0;
-
+    uint32_t i;
     set_init_done();
+    i = find_media(requested_sector);
 
-    for (i = 0; i < ELEMENTS_IN_ARRAY(virtual_media); i++) {
-        uint32_t vm_sectors = virtual_media[i].length / VFS_SECTOR_SIZE;
-        uint32_t vm_start = current_sector;
-        uint32_t vm_end = current_sector + vm_sectors;
-
-        // Data can be used in this sector
-        if ((requested_sector >= vm_start) && (requested_sector < vm_end)) {
-            uint32_t sector_offset;
-            uint32_t sectors_to_write = vm_end - requested_sector;
-            sectors_to_write = MIN(sectors_to_write, num_sectors);
-            sector_offset = requested_sector - current_sector;
-            virtual_media[i].read_cb(sector_offset, buf, sectors_to_write);
-            // Update requested sector
-            requested_sector += sectors_to_write;
-            num_sectors -= sectors_to_write;
-        }
+    while (num_sectors > 0) {
+        uint32_t vm_end;
+        uint32_t sectors_to_write;
+        uint32_t read_size;
 
-        // If there is no more data to be read then break
-        if (num_sectors == 0) {
+        // Sectors past the last entry read as zero
+        if (i >= virtual_media_idx) {
+            memset(buf, 0, num_sectors * VFS_SECTOR_SIZE);
             break;
         }
 
-        // Move to the next virtual media entry
-        current_sector += vm_sectors;
+        vm_end = media_start[i] + virtual_media[i].length / VFS_SECTOR_SIZE;
+
+        // Skip over empty entries
+        if (requested_sector >= vm_end) {
+            i++;
+            continue;
+        }
+
+        sectors_to_write = MIN(vm_end - requested_sector, num_sectors);
+        read_size = virtual_media[i].read_cb(requested_sector - media_start[i], buf, sectors_to_write);
+        if (VFS_READ_ERROR == read_size) {
+            return false;
+        }
+
+        // Zero only what the callback did not fill
+        read_size = MIN(read_size, sectors_to_write * VFS_SECTOR_SIZE);
+        memset(buf + read_size, 0, sectors_to_write * VFS_SECTOR_SIZE - read_size);
+        // Update requested sector
+        buf += sectors_to_write * VFS_SECTOR_SIZE;
+        requested_sector += sectors_to_write;
+        num_sectors -= sectors_to_write;
+        i++;
     }
+
+    return true;
 }
 
 bool vfs_write(uint32_t requested_sector, const uint8_t *buf, uint32_t num_sectors)
 {
     bool rc = false;
-    uint8_t i = 0;
-    uint32_t current_sector;
-    current_sector = 0;
-
+    uint32_t i;
     set_init_done();
+    i = find_media(requested_sector);
+
+    while ((num_sectors > 0) && (i < virtual_media_idx)) {
+        uint32_t vm_end = media_start[i] + virtual_media[i].length / VFS_SECTOR_SIZE;
+        uint32_t sectors_to_read;
 
-    for (i = 0; i < virtual_media_idx; i++) {
-        uint32_t vm_sectors = virtual_media[i].length / VFS_SECTOR_SIZE;
-        uint32_t vm_start = current_sector;
-        uint32_t vm_end = current_sector + vm_sectors;
-
-        // Data can be used in this sector
-        if ((requested_sector >= vm_start) && (requested_sector < vm_end)) {
-            uint32_t sector_offset;
-            uint32_t sectors_to_read = vm_end - requested_sector;
-            sectors_to_read = MIN(sectors_to_read, num_sectors);
-            sector_offset = requested_sector - current_sector;
-            virtual_media[i].write_cb(sector_offset, buf, sectors_to_read);
+        if (requested_sector < vm_end) {
+            sectors_to_read = MIN(vm_end - requested_sector, num_sectors);
+            virtual_media[i].write_cb(requested_sector - media_start[i], buf, sectors_to_read);
             // Update requested sector
+            buf += sectors_to_read * VFS_SECTOR_SIZE;
             requested_sector += sectors_to_read;
             num_sectors -= sectors_to_read;
             rc = true;
         }
 
-        // If there is no more data to be read then break
-        if (num_sectors == 0) {
-            break;
-        }
-
-        // Move to the next virtual media entry
-        current_sector += vm_sectors;
+        i++;
     }
+
     return rc;
 }
 
+// Return the index of the virtual media entry holding sector, or
+// virtual_media_idx if the sector is past the end of the last entry
+static uint32_t find_media(uint32_t sector)
+{
+    uint32_t low;
+    uint32_t high;
+    uint32_t mid;
+    uint32_t last = virtual_media_idx - 1;
+
+    if ((0 == virtual_media_idx) ||
+            (sector >= media_start[last] + virtual_media[last].length / VFS_SECTOR_SIZE)) {
+        return virtual_media_idx;
+    }
+
+    // Find the last entry starting at or before sector.  Empty entries
+    // share their start with the next entry so they are never picked.
+    low = 0;
+    high = virtual_media_idx;
+
+    while (high - low > 1) {
+        mid = (low + high) / 2;
+
+        if (media_start[mid] <= sector) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
 static uint32_t read_zero(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
 {
     uint32_t read_size = VFS_SECTOR_SIZE * num_sectors;
@@ -547,21 +569,87 @@ static uint32_t read_mbr(uint32_t sector_offset, uint8_t *data, uint32_t num_sec
 
 /* No need to handle writes to the mbr */
 
+// The FAT is generated rather than stored.  Every cluster before fat_idx
+// belongs to a file and points at the next one, except for the last
+// cluster of each file which ends the chain.  Entries from fat_idx on are
+// free and left to vfs_read to zero.
 static uint32_t read_fat(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
 {
-    uint32_t read_size = sizeof(file_allocation_table_t);
-    COMPILER_ASSERT(sizeof(file_allocation_table_t) <= VFS_SECTOR_SIZE);
+    uint32_t cluster = sector_offset * VFS_SECTOR_SIZE / sizeof(uint16_t);
+    uint32_t end = MIN(cluster + num_sectors * VFS_SECTOR_SIZE / sizeof(uint16_t), fat_idx);
+    uint32_t chain_end = 0;
+    uint32_t read_size = 0;
+    uint16_t val;
+
+    for (; cluster < end; cluster++) {
+        if (0 == cluster) {
+            val = 0xFFF8;   // Media type "media_descriptor"
+        } else if (1 == cluster) {
+            val = 0xFFFF;   // FAT12 - always 0xFFF (no meaning), FAT16 - dirty/clean (clean = 0xFFFF)
+        } else {
+            if (cluster > chain_end) {
+                // Find the last cluster of the file holding this one
+                uint32_t sector = cluster_to_sector(cluster);
+                uint32_t idx = find_media(sector);
+                uint32_t file_end = media_start[idx] + virtual_media[idx].length / VFS_SECTOR_SIZE;
+                chain_end = cluster + (file_end - sector) / mbr.sectors_per_cluster - 1;
+            }
+
+            val = cluster == chain_end ? 0xFFFF : cluster + 1;
+        }
 
-    if (sector_offset != 0) {
-        // Don't worry about reading other sectors
-        return 0;
+        data[read_size++] = (val >> 0) & 0xFF;
+        data[read_size++] = (val >> 8) & 0xFF;
     }
 
-    memcpy(data, &fat, read_size);
     return read_size;
 }
 
-/* No need to handle writes to the fat */
+// Only the chain being tracked is of interest in writes to the fat.  The
+// second copy of the fat is not looked at.  The last cluster found stays
+// tracked after the end of the chain has been written since hosts which
+// write the fat after every part of a file move the end on each time.
+static void write_chain(uint32_t sector_offset, const uint8_t *data, uint32_t num_sectors)
+{
+    uint32_t first_entry = sector_offset * VFS_SECTOR_SIZE / sizeof(uint16_t);
+    uint32_t num_entries = num_sectors * VFS_SECTOR_SIZE / sizeof(uint16_t);
+    uint32_t max_clusters = mbr.logical_sectors_per_fat * VFS_SECTOR_SIZE / sizeof(uint16_t);
+    uint32_t idx;
+    uint16_t next;
+
+    // Clusters 0 and 1 are reserved, chain_cluster is 0 when not tracking
+    while ((chain_cluster >= 2) && (chain_cluster >= first_entry) &&
+            (chain_cluster - first_entry < num_entries)) {
+        idx = (chain_cluster - first_entry) * sizeof(uint16_t);
+        next = data[idx] | (data[idx + 1] << 8);
+
+        // Stop at entries that are free or reserved. They may be
+        // filled in by a later write.
+        if ((next < 2) || ((next >= 0xFFF0) && (next < 0xFFF8))) {
+            chain_size = 0;
+            return;
+        }
+
+        if (next >= 0xFFF8) {
+            // End of chain
+            chain_size = chain_clusters * mbr.sectors_per_cluster * mbr.bytes_per_sector;
+            return;
+        }
+
+        // The end is not known until the entry of the next cluster is
+        // written
+        chain_size = 0;
+
+        if (chain_clusters >= max_clusters) {
+            // Chain loops back on itself
+            chain_cluster = 0;
+            return;
+        }
+
+        chain_cluster = next;
+        chain_clusters++;
+    }
+}
 
 static uint32_t read_dir(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
 {
@@ -637,6 +725,26 @@ static void write_dir(uint32_t sector_offset, const uint8_t *data, uint32_t num_
     memcpy(&dir_current.f[start_index], data, num_sectors * VFS_SECTOR_SIZE);
 }
 
+void vfs_chain_track(vfs_sector_t start_sector)
+{
+    uint32_t sectors_before_data = data_start / VFS_SECTOR_SIZE;
+    chain_cluster = 0;
+    chain_clusters = 0;
+    chain_size = 0;
+
+    if ((VFS_INVALID_SECTOR == start_sector) || (start_sector < sectors_before_data) || (0 == mbr.sectors_per_cluster)) {
+        return;
+    }
+
+    chain_cluster = (start_sector - sectors_before_data) / mbr.sectors_per_cluster + 2;
+    chain_clusters = 1;
+}
+
+uint32_t vfs_chain_get_size(void)
+{
+    return chain_size;
+}
+
 static void file_change_cb_stub(const vfs_filename_t filename, vfs_file_change_t change, vfs_file_t file, vfs_file_t new_file_data)
 {
     // Do nothing
@@ -60,7 +60,9 @@ typedef uint32_t vfs_sector_t;
 
 // Callback for when data is written to a file on the virtual filesystem
 typedef void (*vfs_write_cb_t)(uint32_t sector_offset, const uint8_t *data, uint32_t num_sectors);
-// Callback for when data is ready from the virtual filesystem
+// Callback for when data is ready from the virtual filesystem.  Returns the
+// number of bytes filled in, the rest is zeroed, or VFS_READ_ERROR.
+#define VFS_READ_ERROR      0xFFFFFFFF
 typedef uint32_t (*vfs_read_cb_t)(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors);
 // Callback for when a file's attributes are changed on the virtual filesystem.  Note that the 'file' parameter
 // can be saved and compared to other files to see if they are referencing the same object.  The
@@ -96,8 +98,17 @@ vfs_file_attr_bit_t vfs_file_get_attr(vfs_file_t file);
 // Set the callback when a file is created, deleted or has atributes changed.
 void vfs_set_file_change_callback(vfs_file_change_cb_t cb);
 
-// Read one or more sectors from the virtual filesystem
-void vfs_read(uint32_t sector, uint8_t *buf, uint32_t num_of_sectors);
+// Follow the FAT cluster chain of the file starting at start_sector as the
+// host writes the FAT.  Pass VFS_INVALID_SECTOR to stop tracking.
+void vfs_chain_track(vfs_sector_t start_sector);
+
+// Get the size of the tracked cluster chain.  This is 0 until the end of
+// the chain has been written and again while the host extends the chain.
+uint32_t vfs_chain_get_size(void);
+
+// Read one or more sectors from the virtual filesystem.  Returns false
+// if the contents of a file could not be read.
+bool vfs_read(uint32_t sector, uint8_t *buf, uint32_t num_of_sectors);
 
 // Write one or more sectors to the virtual filesystem
 bool vfs_write(uint32_t sector, const uint8_t *buf, uint32_t num_of_sectors);
@@ -116,7 +116,25 @@ static const char *const error_message[] = {
     // ERROR_BL_UPDT_BAD_CRC
     "The bootloader CRC did not pass.",
     // ERROR_TARGET_UNKNOWN
-    "unsupported target device."
+    "unsupported target device.",
+    // ERROR_TARGET_OUT_OF_BOUNDS
+    "The address range is outside of the target flash.",
+    // ERROR_UF2_BLOCK
+    "The UF2 file cannot be decoded. A block is invalid.",
+    // ERROR_SREC_CKSUM
+    "The S-record file cannot be decoded. Checksum calculation failure occurred.",
+    // ERROR_SREC_PARSER
+    "The S-record file cannot be decoded. Parser logic failure occurred.",
+    // ERROR_ELF_HEADER
+    "The ELF file cannot be decoded. The file or program headers are invalid or unsupported.",
+    // ERROR_ELF_SEGMENT_ORDER
+    "The ELF file cannot be programmed. A segment is stored before the program headers.",
+    // ERROR_TARGET_READ
+    "Reading the target memory failed.",
+    // ERROR_FLASH_ORDER
+    "The file cannot be programmed. Its data is too far out of address order.",
+    // ERROR_TARGET_BUSY
+    "The target is in use by another flash operation.",
 };
 COMPILER_ASSERT(ERROR_COUNT == ELEMENTS_IN_ARRAY(error_message));
 
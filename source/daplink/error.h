@@ -78,6 +78,15 @@ typedef enum {
 
     // Add new values here
     ERROR_TARGET_UNKNOWN,
+    ERROR_TARGET_OUT_OF_BOUNDS,
+    ERROR_UF2_BLOCK,
+    ERROR_SREC_CKSUM,
+    ERROR_SREC_PARSER,
+    ERROR_ELF_HEADER,
+    ERROR_ELF_SEGMENT_ORDER,
+    ERROR_TARGET_READ,
+    ERROR_FLASH_ORDER,
+    ERROR_TARGET_BUSY,
     ERROR_COUNT
 } error_t;
 
@@ -30,6 +30,9 @@
 #include "util.h"
 #include "crc.h"
 #include "daplink.h"
+#include "cortex_m.h"
+#include "macro.h"
+#include "compiler.h"
 
 // Constant variables
 static const daplink_info_t *const info_bl = (daplink_info_t *)(DAPLINK_ROM_BL_START + DAPLINK_INFO_OFFSET);
@@ -40,10 +43,37 @@ static uint32_t host_id[4];
 static uint32_t target_id[4];
 static uint32_t hic_id = DAPLINK_HIC_ID;
 
-static uint32_t crc_bootloader;
-static uint32_t crc_interface;
-static uint32_t crc_config_admin;
-static uint32_t crc_config_user;
+// CRCs are computed the first time they are needed and cached
+typedef enum {
+    CRC_REGION_BOOTLOADER,
+    CRC_REGION_INTERFACE,
+    CRC_REGION_CONFIG_ADMIN,
+    CRC_REGION_CONFIG_USER,
+
+    CRC_REGION_COUNT
+} crc_region_t;
+
+typedef struct {
+    uint32_t start;
+    uint32_t size;      // Bytes covered by the CRC, 0 if the region is missing
+} crc_region_info_t;
+
+// The image CRCs exclude the CRC stored in the last word of the image
+static const crc_region_info_t crc_regions[] = {
+    // CRC_REGION_BOOTLOADER
+    {DAPLINK_ROM_BL_START, DAPLINK_ROM_BL_SIZE > 0 ? DAPLINK_ROM_BL_SIZE - 4 : 0},
+    // CRC_REGION_INTERFACE
+    {DAPLINK_ROM_IF_START, DAPLINK_ROM_IF_SIZE > 0 ? DAPLINK_ROM_IF_SIZE - 4 : 0},
+    // CRC_REGION_CONFIG_ADMIN
+    {DAPLINK_ROM_CONFIG_ADMIN_START, DAPLINK_ROM_CONFIG_ADMIN_SIZE},
+    // CRC_REGION_CONFIG_USER
+    {DAPLINK_ROM_CONFIG_USER_START, DAPLINK_ROM_CONFIG_USER_SIZE},
+};
+COMPILER_ASSERT(CRC_REGION_COUNT == ELEMENTS_IN_ARRAY(crc_regions));
+
+static uint32_t crc_values[CRC_REGION_COUNT];
+static uint32_t crc_valid;          // Bit per region with a cached CRC
+static uint32_t crc_generation;     // Incremented by every invalidation
 
 // Strings
 static char string_unique_id[48 + 1];
@@ -166,7 +196,6 @@ static void setup_string_descriptor()
 
 void info_init(void)
 {
-    info_crc_compute();
     read_unique_id(host_id);
     setup_basics();
     setup_unique_id();
@@ -236,49 +265,71 @@ bool info_get_config_user_present(void)
     return false;
 }
 
+static uint32_t get_crc(crc_region_t region)
+{
+    uint32_t generation;
+    uint32_t crc;
+    cortex_int_state_t state;
+    const crc_region_info_t *info = &crc_regions[region];
+
+    if (crc_valid & (1 << region)) {
+        return crc_values[region];
+    }
+
+    if (0 == info->size) {
+        return 0;
+    }
+
+    generation = crc_generation;
+    crc = crc32((void *)info->start, info->size);
+    // Only cache the CRC if the region was not written while computing it
+    state = cortex_int_get_and_disable();
+
+    if (generation == crc_generation) {
+        crc_values[region] = crc;
+        crc_valid |= 1 << region;
+    }
+
+    cortex_int_restore(state);
+    return crc;
+}
+
 uint32_t info_get_crc_bootloader()
 {
-    return crc_bootloader;
+    return get_crc(CRC_REGION_BOOTLOADER);
 }
 
 uint32_t info_get_crc_interface()
 {
-    return crc_interface;
+    return get_crc(CRC_REGION_INTERFACE);
 }
 
 uint32_t info_get_crc_config_admin()
 {
-    return crc_config_admin;
+    return get_crc(CRC_REGION_CONFIG_ADMIN);
 }
 
 uint32_t info_get_crc_config_user()
 {
-    return crc_config_user;
+    return get_crc(CRC_REGION_CONFIG_USER);
 }
 
-void info_crc_compute()
+void info_crc_invalidate(uint32_t addr, uint32_t size)
 {
-    crc_bootloader = 0;
-    crc_interface = 0;
-    crc_config_admin = 0;
-    crc_config_user = 0;
-
-    // Compute the CRCs of regions that exist
-    if (DAPLINK_ROM_BL_SIZE > 0) {
-        crc_bootloader = crc32((void *)DAPLINK_ROM_BL_START, DAPLINK_ROM_BL_SIZE - 4);
-    }
+    uint32_t i;
+    cortex_int_state_t state;
+    state = cortex_int_get_and_disable();
+    crc_generation++;
 
-    if (DAPLINK_ROM_IF_SIZE > 0) {
-        crc_interface = crc32((void *)DAPLINK_ROM_IF_START, DAPLINK_ROM_IF_SIZE - 4);
-    }
+    for (i = 0; i < CRC_REGION_COUNT; i++) {
+        const crc_region_info_t *info = &crc_regions[i];
 
-    if (DAPLINK_ROM_CONFIG_ADMIN_SIZE > 0) {
-        crc_config_admin = crc32((void *)DAPLINK_ROM_CONFIG_ADMIN_START, DAPLINK_ROM_CONFIG_ADMIN_SIZE);
+        if ((addr < info->start + info->size) && (info->start < addr + size)) {
+            crc_valid &= ~(1 << i);
+        }
     }
 
-    if (DAPLINK_ROM_CONFIG_USER_SIZE > 0) {
-        crc_config_user = crc32((void *)DAPLINK_ROM_CONFIG_USER_START, DAPLINK_ROM_CONFIG_USER_SIZE);
-    }
+    cortex_int_restore(state);
 }
 
 // Get version info as an integer
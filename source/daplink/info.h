@@ -31,7 +31,9 @@ extern "C" {
 
 void info_init(void);
 void info_set_uuid_target(uint32_t *uuid_data);
-void info_crc_compute(void);
+// Drop the cached CRCs of regions overlapping addr to addr + size.
+// Must be called after writing flash which is covered by a CRC.
+void info_crc_invalidate(uint32_t addr, uint32_t size);
 
 
 // Get the 48 digit unique ID as a null terminated string.
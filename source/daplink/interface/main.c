@@ -38,6 +38,8 @@
 #include "daplink.h"
 #include "util.h"
 #include "DAP.h"
+#include "perf_counter.h"
+#include "target_flash.h"
 
 // Event flags for main task
 // Timers events
@@ -256,8 +258,11 @@ __task void main_task(void)
     // Turn off LED
     gpio_set_hid_led(GPIO_LED_OFF);
     gpio_set_cdc_led(GPIO_LED_OFF);
+    // Start the performance counters before anything is measured
+    perf_init();
     // Initialize the DAP
     swd_init();
+    target_flash_lock_init();
     // do some init with the target before USB and files are configured
     prerun_board_config();
     prerun_target_config();
@@ -328,6 +333,8 @@ __task void main_task(void)
         if (flags & FLAGS_MAIN_90MS) {
             // Update USB busy status
             vfs_mngr_periodic(90); // FLAGS_MAIN_90MS
+            // Resume the target once programming has been idle
+            target_flash_session_periodic(90);
 
             // Update USB connect status
             switch (usb_state) {
@@ -28,6 +28,8 @@
 #include "DAP_config.h"
 #include "DAP.h"
 #include "target_ids.h"
+#include "perf_counter.h"
+#include "delay.h"
 
 // Default NVIC and Core debug base addresses
 // TODO: Read these addresses from ROM.
@@ -92,16 +94,20 @@ static void int2array(uint8_t *res, uint32_t data, uint8_t len)
 static uint8_t swd_transfer_retry(uint32_t req, uint32_t *data)
 {
     uint8_t i, ack;
+    uint32_t start = perf_get_cycles();
 
     for (i = 0; i < MAX_SWD_RETRY; i++) {
         ack = SWD_Transfer(req, data);
 
         // if ack != WAIT
         if (ack != DAP_TRANSFER_WAIT) {
+            perf_timer_record(PERF_TIMER_SWD_TRANSFER, start);
             return ack;
         }
     }
 
+    perf_count(PERF_EVENT_SWD_RETRY_LIMIT);
+    perf_timer_record(PERF_TIMER_SWD_TRANSFER, start);
     return ack;
 }
 
@@ -406,6 +412,12 @@ static uint8_t swd_read_word(uint32_t addr, uint32_t *val)
     return 1;
 }
 
+// Read the Debug Halting Control and Status Register of the core.
+uint8_t swd_read_dhcsr(uint32_t *val)
+{
+    return swd_read_word(DBG_HCSR, val);
+}
+
 // Write 32-bit word to target memory.
 static uint8_t swd_write_word(uint32_t addr, uint32_t val)
 {
@@ -682,7 +694,7 @@ static uint8_t swd_wait_until_halted(void)
     return 0;
 }
 
-uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
+static uint8_t swd_flash_syscall_run(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
 {
     DEBUG_STATE state = {{0}, 0};
     // Call flash algorithm function on target and wait for result.
@@ -716,6 +728,15 @@ uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t e
     return 1;
 }
 
+uint8_t swd_flash_syscall_exec(const program_syscall_t *sysCallParam, uint32_t entry, uint32_t arg1, uint32_t arg2, uint32_t arg3, uint32_t arg4)
+{
+    uint8_t status;
+    uint32_t start = perf_get_cycles();
+    status = swd_flash_syscall_run(sysCallParam, entry, arg1, arg2, arg3, arg4);
+    perf_timer_record(PERF_TIMER_FLASH_SYSCALL, start);
+    return status;
+}
+
 // SWD Reset
 static uint8_t swd_reset(void)
 {
@@ -886,7 +907,6 @@ static uint8_t get_target_id(uint32_t coreid)
 
 uint8_t swd_init_get_target(void)
 {
-    volatile uint32_t i = 0 ;
     uint32_t tmp = 0;
     uint32_t tmpid = 0;
     
@@ -897,10 +917,10 @@ uint8_t swd_init_get_target(void)
 
     //add Reset Pin
     swd_set_target_reset(1);
-    os_dly_wait(1);
+    delay_sleep_us(TARGET_DETECT_PULSE_US);
     swd_set_target_reset(0);
     //need wait 500us
-    for( i = 0; i < 1200; i++) {}
+    delay_us(500);
 
    //init SWD sequence and get IDcode
     if (!swd_reset()) {
@@ -953,6 +973,55 @@ uint8_t swd_init_get_target(void)
     return get_target_id(tmpid);
 }
 
+// Reset timing of the current target, or the defaults while it is unknown
+static uint32_t target_reset_pulse_us(void)
+{
+    if ((targetID != Target_UNKNOWN) && (target_device[targetID].reset_pulse_us != 0)) {
+        return target_device[targetID].reset_pulse_us;
+    }
+
+    return TARGET_RESET_PULSE_US;
+}
+
+static uint32_t target_reset_settle_us(void)
+{
+    if ((targetID != Target_UNKNOWN) && (target_device[targetID].reset_settle_us != 0)) {
+        return target_device[targetID].reset_settle_us;
+    }
+
+    return TARGET_RESET_SETTLE_US;
+}
+
+// Pulse nRESET and wait until the target is out of reset
+static void swd_reset_pulse(void)
+{
+    swd_set_target_reset(1);
+    delay_sleep_us(target_reset_pulse_us());
+    swd_set_target_reset(0);
+    delay_sleep_us(target_reset_settle_us());
+}
+
+// Wait for the core to halt on the reset vector catch
+static uint8_t swd_wait_reset_halt(void)
+{
+    uint32_t val;
+    uint32_t start = delay_timeout_start();
+
+    while (1) {
+        if (!swd_read_word(DBG_HCSR, &val)) {
+            return 0;
+        }
+
+        if (val & S_HALT) {
+            return 1;
+        }
+
+        if (delay_timeout_expired(start, TARGET_HALT_TIMEOUT_US)) {
+            return 0;
+        }
+    }
+}
+
 __attribute__((weak)) void swd_set_target_reset(uint8_t asserted)
 {
     (asserted) ? PIN_nRESET_OUT(0) : PIN_nRESET_OUT(1);
@@ -960,7 +1029,6 @@ __attribute__((weak)) void swd_set_target_reset(uint8_t asserted)
 
 uint8_t swd_set_target_state_hw(TARGET_RESET_STATE state)
 {
-    uint32_t val;
     swd_init();
 
     switch (state) {
@@ -969,18 +1037,12 @@ uint8_t swd_set_target_state_hw(TARGET_RESET_STATE state)
             break;
 
         case RESET_RUN:
-            swd_set_target_reset(1);
-            os_dly_wait(2);
-            swd_set_target_reset(0);
-            os_dly_wait(2);
+            swd_reset_pulse();
             swd_off();
             break;
 
         case RESET_PROGRAM:
-            swd_set_target_reset(1);
-            os_dly_wait(2);
-            swd_set_target_reset(0);
-            os_dly_wait(2);
+            swd_reset_pulse();
 
             if (!swd_init_debug()) {
                 return 0;
@@ -997,16 +1059,11 @@ uint8_t swd_set_target_state_hw(TARGET_RESET_STATE state)
             }
 
             // Reset again
-            swd_set_target_reset(1);
-            os_dly_wait(2);
-            swd_set_target_reset(0);
-            os_dly_wait(2);
+            swd_reset_pulse();
 
-            do {
-                if (!swd_read_word(DBG_HCSR, &val)) {
-                    return 0;
-                }
-            } while ((val & S_HALT) == 0);
+            if (!swd_wait_reset_halt()) {
+                return 0;
+            }
 
             // Disable halt on reset
             if (!swd_write_word(DBG_EMCR, 0)) {
@@ -1112,13 +1169,11 @@ uint8_t swd_set_target_state_sw(TARGET_RESET_STATE state)
                 return 0;
             }
 
-            os_dly_wait(2);
+            delay_sleep_us(target_reset_settle_us());
 
-            do {
-                if (!swd_read_word(DBG_HCSR, &val)) {
-                    return 0;
-                }
-            } while ((val & S_HALT) == 0);
+            if (!swd_wait_reset_halt()) {
+                return 0;
+            }
 
             // Disable halt on reset
             if (!swd_write_word(DBG_EMCR, 0)) {
@@ -384,6 +384,13 @@ static uint8_t swd_read_word(uint32_t addr, uint32_t *val)
     return 1;
 }
 
+// Cortex-A cores have no DHCSR.  Failing here means a debug session
+// left open after programming is never reused.
+uint8_t swd_read_dhcsr(uint32_t *val)
+{
+    return 0;
+}
+
 // Write 32-bit word to target memory.
 static uint8_t swd_write_word(uint32_t addr, uint32_t val)
 {
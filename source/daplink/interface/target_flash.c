@@ -21,6 +21,7 @@
 
 #include "string.h"
 
+#include "RTL.h"
 #include "target_config.h"
 #include "target_reset.h"
 #include "gpio.h"
@@ -31,6 +32,9 @@
 #include "flash_intf.h"
 #include "util.h"
 #include "settings.h"
+#include "perf_counter.h"
+#include "target_flash.h"
+#include "crc.h"
 
 #include "target_ids.h"
 
@@ -41,6 +45,11 @@ static error_t target_flash_erase_sector(uint32_t addr);
 static error_t target_flash_erase_chip(void);
 static uint32_t target_flash_program_page_min_size(uint32_t addr);
 static uint32_t target_flash_erase_sector_size(uint32_t addr);
+static error_t target_flash_read(uint32_t addr, uint8_t *buf, uint32_t size);
+static error_t target_flash_algo_init(void);
+static bool session_valid(void);
+static void session_end(void);
+static bool algo_ram_crc(uint32_t *crc);
 
 static const flash_intf_t flash_intf = {
     target_flash_init,
@@ -50,21 +59,105 @@ static const flash_intf_t flash_intf = {
     target_flash_erase_chip,
     target_flash_program_page_min_size,
     target_flash_erase_sector_size,
+    target_flash_read,
 };
 
 const flash_intf_t *const flash_intf_target = &flash_intf;
 
+// Time the target is kept halted with the flash algorithm loaded after
+// programming.  An operation started in this time skips the reset and
+// the algorithm download.  Set to 0 to resume the target right away.
+#ifndef TARGET_FLASH_SESSION_IDLE_MS
+#define TARGET_FLASH_SESSION_IDLE_MS    3000
+#endif
+
+// Time the debug port is kept powered after the last read
+#ifndef TARGET_FLASH_READ_IDLE_MS
+#define TARGET_FLASH_READ_IDLE_MS       1000
+#endif
+
+// Sectors erased since the flash algorithm was initialized.  Programming
+// may jump back to a sector already written, which must not be erased again.
+#define ERASED_SECTOR_MAP_BITS  256
+static uint32_t erased_sector_map[ERASED_SECTOR_MAP_BITS / 32];
 static uint32_t lastEraseSectorNumber = 0xFFFFFFFF;
 
+static bool sector_needs_erase(uint32_t sector);
+static void sector_set_erased(uint32_t sector);
+
+// Owned by the thread using flash_intf_target, from init to uninit for
+// programming and for each read.  Everything below is only accessed
+// while holding it.
+static OS_MUT flash_mutex;
+
+// Set once the debug port has been powered up for reads.  It stays up
+// across reads so each one does not need to attach to the target again.
+static bool read_session_open = false;
+static uint32_t read_idle_ms;
+
+// State of the debug session kept open after programming
+static bool session_open = false;
+static bool session_release = false;    // Run and forget the target when the session ends
+static uint8_t session_target;
+static uint32_t session_idcode;
+static uint32_t session_algo_crc;
+static uint32_t session_idle_ms;
+
+// A release requested while another thread owned the target.  Not guarded
+// by the mutex, only the thread calling target_flash_session_release and
+// target_flash_session_periodic uses it.
+static bool release_pending = false;
+
+void target_flash_lock_init(void)
+{
+    os_mut_init(&flash_mutex);
+}
+
+bool target_flash_lock(uint16_t timeout)
+{
+    return os_mut_wait(&flash_mutex, timeout) != OS_R_TMO;
+}
+
+void target_flash_unlock(void)
+{
+    os_mut_release(&flash_mutex);
+}
+
 static error_t target_flash_init()
+{
+    error_t status;
+
+    if (!target_flash_lock(0)) {
+        return ERROR_TARGET_BUSY;
+    }
+
+    lastEraseSectorNumber = 0xFFFFFFFF;
+    memset(erased_sector_map, 0, sizeof(erased_sector_map));
+
+    // Reuse the halted target and loaded algorithm if nothing changed
+    if (session_open) {
+        session_open = false;
+        if (session_valid()) {
+            return ERROR_SUCCESS;
+        }
+    }
+
+    read_session_open = false;
+    status = target_flash_algo_init();
+    if (status != ERROR_SUCCESS) {
+        target_flash_unlock();
+    }
+
+    return status;
+}
+
+static error_t target_flash_algo_init(void)
 {
     if (targetID == Target_UNKNOWN)
         return ERROR_TARGET_UNKNOWN;
     
     const program_target_t *const flash = target_device[targetID].flash_algo;
 
-    lastEraseSectorNumber = 0xFFFFFFFF;
-    
     if (0 == target_set_state(RESET_PROGRAM)) {
         return ERROR_RESET;
     }
@@ -83,13 +176,139 @@ static error_t target_flash_init()
 
 static error_t target_flash_uninit(void)
 {
+    // Leave the target attached, it is resumed once the session goes idle
+    if ((TARGET_FLASH_SESSION_IDLE_MS > 0) && (targetID != Target_UNKNOWN) &&
+            swd_read_dp(DP_IDCODE, &session_idcode) && algo_ram_crc(&session_algo_crc)) {
+        session_open = true;
+        session_target = targetID;
+        session_idle_ms = 0;
+        read_session_open = true;
+    } else {
+        session_end();
+    }
+
+    target_flash_unlock();
+    return ERROR_SUCCESS;
+}
+
+void target_flash_session_periodic(uint32_t elapsed_ms)
+{
+    if (release_pending) {
+        target_flash_session_release();
+    }
+
+    // Never interrupt an operation running in another thread
+    if (!target_flash_lock(0)) {
+        return;
+    }
+
+    if (session_open) {
+        session_idle_ms += elapsed_ms;
+        if (session_idle_ms >= TARGET_FLASH_SESSION_IDLE_MS) {
+            session_end();
+        }
+    } else if (read_session_open) {
+        // Power the debug port down once FLASH.BIN is no longer being read
+        read_idle_ms += elapsed_ms;
+        if (read_idle_ms >= TARGET_FLASH_READ_IDLE_MS) {
+            read_session_open = false;
+            swd_off();
+        }
+    }
+
+    target_flash_unlock();
+}
+
+void target_flash_session_release(void)
+{
+    // Another thread owns the target, target_flash_session_periodic
+    // retries once it is done
+    if (!target_flash_lock(0)) {
+        release_pending = true;
+        return;
+    }
+
+    release_pending = false;
+
+    if (session_open) {
+        session_release = true;
+    } else {
+        target_set_state(RESET_RUN);
+        targetID = Target_UNKNOWN;
+    }
+
+    target_flash_unlock();
+}
+
+// Check that the target of the session is still attached, halted, has
+// not been reset since and that nothing overwrote the flash algorithm
+static bool session_valid(void)
+{
+    uint32_t idcode;
+    uint32_t dhcsr;
+    uint32_t crc;
+
+    if (session_target != targetID) {
+        return false;
+    }
+
+    if (!swd_read_dp(DP_IDCODE, &idcode) || (idcode != session_idcode)) {
+        return false;
+    }
+
+    if (!swd_read_dhcsr(&dhcsr)) {
+        return false;
+    }
+
+    if ((dhcsr & (S_HALT | S_RESET_ST)) != S_HALT) {
+        return false;
+    }
+
+    return algo_ram_crc(&crc) && (crc == session_algo_crc);
+}
+
+// CRC of the target RAM holding the flash algorithm and its data
+static bool algo_ram_crc(uint32_t *crc)
+{
+    const program_target_t *const flash = target_device[targetID].flash_algo;
+    uint8_t chunk[32];
+    uint32_t addr = flash->algo_start;
+    uint32_t remaining = flash->algo_size;
+    uint32_t size;
+    uint32_t value = crc32_init();
+
+    while (remaining > 0) {
+        size = MIN(remaining, sizeof(chunk));
+        if (!swd_read_memory(addr, chunk, size)) {
+            return false;
+        }
+
+        value = crc32_update(value, chunk, size);
+        addr += size;
+        remaining -= size;
+    }
+
+    *crc = crc32_final(value);
+    return true;
+}
+
+static void session_end(void)
+{
+    session_open = false;
+    read_session_open = false;
+
     // Resume the target if configured to do so
     if (config_get_auto_rst()) {
         target_set_state(RESET_RUN);
     }
 
     swd_off();
-    return ERROR_SUCCESS;
+
+    if (session_release) {
+        session_release = false;
+        target_set_state(RESET_RUN);
+        targetID = Target_UNKNOWN;
+    }
 }
 
 static error_t target_flash_program_page(uint32_t addr, const uint8_t *buf, uint32_t size)
@@ -108,11 +327,10 @@ static error_t target_flash_program_page(uint32_t addr, const uint8_t *buf, uint
         uint32_t write_size = MIN(size, flash->program_buffer_size);
         uint32_t nextSectorAddress = 0;
         uint32_t currentSectorNumber = target_device[targetID].get_sector_number(addr);
-        if (currentSectorNumber != lastEraseSectorNumber) {
+        if (sector_needs_erase(currentSectorNumber)) {
             if(ERROR_SUCCESS != target_flash_erase_sector(currentSectorNumber)){
                 return ERROR_ERASE_SECTOR;
             }						
-            lastEraseSectorNumber = currentSectorNumber;
         }
           //check is cross sectors
         nextSectorAddress = target_device[targetID].get_sector_address(currentSectorNumber) + target_device[targetID].get_sector_length(currentSectorNumber);
@@ -135,6 +353,8 @@ static error_t target_flash_program_page(uint32_t addr, const uint8_t *buf, uint
             return ERROR_WRITE;
         }
 
+        perf_count_n(PERF_EVENT_FLASH_BYTES, write_size);
+
         if (config_get_automation_allowed()) {
             // Verify data flashed if in automation mode
             while (write_size > 0) {
@@ -175,6 +395,8 @@ static error_t target_flash_erase_sector(uint32_t sector)
         return ERROR_ERASE_SECTOR;
     }
 
+    // Also covers sectors erased through flash_intf_target by other users
+    sector_set_erased(sector);
     return ERROR_SUCCESS;
 }
 
@@ -189,7 +411,12 @@ static error_t target_flash_erase_chip(void)
 
     // Reset and re-initialize the target after the erase if required
     if (target_device[targetID].erase_reset) {
-        status = target_flash_init();
+        status = target_flash_algo_init();
+    }
+
+    // Every sector is blank now so none needs to be erased before programming
+    if (ERROR_SUCCESS == status) {
+        memset(erased_sector_map, 0xFF, sizeof(erased_sector_map));
     }
 
     return status;
@@ -206,3 +433,46 @@ static uint32_t target_flash_erase_sector_size(uint32_t addr)
 {
     return target_device[targetID].sector_size;
 }
+
+static error_t target_flash_read(uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    error_t status = ERROR_SUCCESS;
+
+    // Refuse reads while another thread is programming
+    if (!target_flash_lock(0)) {
+        return ERROR_TARGET_BUSY;
+    }
+
+    read_idle_ms = 0;
+    if (!read_session_open || !swd_read_memory(addr, buf, size)) {
+        // Attach to the target without resetting it.  This is also retried
+        // once if the target was reset or powered down since the last read.
+        read_session_open = swd_init_debug();
+        if (!read_session_open || !swd_read_memory(addr, buf, size)) {
+            read_session_open = false;
+            status = ERROR_TARGET_READ;
+        }
+    }
+
+    target_flash_unlock();
+    return status;
+}
+
+static bool sector_needs_erase(uint32_t sector)
+{
+    if (sector < ERASED_SECTOR_MAP_BITS) {
+        return !(erased_sector_map[sector / 32] & (1UL << (sector % 32)));
+    }
+
+    // Sectors outside of the map are erased whenever programming moves to them
+    return sector != lastEraseSectorNumber;
+}
+
+static void sector_set_erased(uint32_t sector)
+{
+    if (sector < ERASED_SECTOR_MAP_BITS) {
+        erased_sector_map[sector / 32] |= 1UL << (sector % 32);
+    }
+
+    lastEraseSectorNumber = sector;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file    target_flash.h
+ * @brief   Locking and debug session of the target flash interface
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TARGET_FLASH_H
+#define TARGET_FLASH_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Create the lock serializing the threads using flash_intf_target
+void target_flash_lock_init(void);
+
+// Take ownership of flash_intf_target waiting up to timeout ticks.  The
+// lock nests within a thread.  flash_intf_target init and read take it
+// without waiting and fail with ERROR_TARGET_BUSY if another thread has it.
+bool target_flash_lock(uint16_t timeout);
+void target_flash_unlock(void);
+
+// Advance the idle time of the session left open by flash_intf_target
+// and resume the target once it has been idle long enough
+void target_flash_session_periodic(uint32_t elapsed_ms);
+
+// Run the target and clear targetID when the session ends, or right
+// away if no session is open.  Called when a drag-n-drop transfer ends,
+// from the thread calling target_flash_session_periodic, which retries
+// the release if another thread owns the target.
+void target_flash_session_release(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -35,14 +35,32 @@ extern "C" {
 #define TIMER_TASK_PRIORITY         (11)
 #define DAP_TASK_PRIORITY           (15)
 #define MSC_TASK_PRIORITY           (5)
+// Below the main task so MSC traffic is serviced while sectors are programmed
+#define FLASH_TASK_PRIORITY         (9)
 #define TIMER_TASK_30_PRIORITY      (TIMER_TASK_PRIORITY)
 
 // trouble here is that reset for different targets is implemented differently so all targets
 //  have to use the largest stack or these have to be defined in multiple places... Not ideal
 //  may want to move away from threads for some of these behaviours to optimize mempory usage (RAM)
 #define TIMER_TASK_30_STACK (136)
+// The vendor flash commands run target_flash on the DAP task, which
+// needs the bigger stack.  HICs short of RAM set DAP_VENDOR_FLASH=0 to
+// leave the commands, their page buffer and the extra stack out.
+#ifndef DAP_VENDOR_FLASH
+#define DAP_VENDOR_FLASH    1
+#endif
+#if (DAP_VENDOR_FLASH != 0)
+#define DAP_TASK_STACK      (400)
+#else
 #define DAP_TASK_STACK      (272)
+#endif
 #define MAIN_TASK_STACK     (800)
+// Runs stream -> flash_decoder -> target_flash -> swd_host, which used to
+// run on the main task so it gets the same stack.  Together with the
+// FLASH_QUEUE_DEPTH sector buffers in vfs_manager.c this costs about
+// 1.9KB of RAM with the default queue depth of 2.  HICs short of RAM set
+// VFS_FLASH_TASK=0 and do without the task.
+#define FLASH_TASK_STACK    (MAIN_TASK_STACK)
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,109 @@
+/**
+ * @file    perf_counter.c
+ * @brief   Implementation of perf_counter.h
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "string.h"
+
+#include "perf_counter.h"
+#include "cortex_m.h"
+#include "macro.h"
+
+#if (__CORTEX_M < 0x03)
+// Cortex-M0 has no DWT cycle counter so the RTX SysTick is extended
+// with the RTX tick count instead.
+extern uint32_t os_time;
+#endif
+
+uint32_t perf_events[PERF_EVENT_COUNT];
+static perf_stat_t perf_stats[PERF_TIMER_COUNT];
+
+void perf_init(void)
+{
+#if (__CORTEX_M >= 0x03)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    perf_reset();
+}
+
+void perf_reset(void)
+{
+    uint32_t i;
+    cortex_int_state_t state;
+    state = cortex_int_get_and_disable();
+    memset(perf_events, 0, sizeof(perf_events));
+    memset(perf_stats, 0, sizeof(perf_stats));
+
+    for (i = 0; i < PERF_TIMER_COUNT; i++) {
+        perf_stats[i].min = 0xFFFFFFFF;
+    }
+
+    cortex_int_restore(state);
+}
+
+uint32_t perf_get_cycles(void)
+{
+#if (__CORTEX_M >= 0x03)
+    return DWT->CYCCNT;
+#else
+    uint32_t ticks;
+    uint32_t val;
+
+    // Re-read if a tick happened in between
+    do {
+        ticks = os_time;
+        val = SysTick->VAL;
+
+        // SysTick wrapped but the tick has not been counted yet because
+        // interrupts are disabled or a higher priority handler is running
+        if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+            val = SysTick->VAL;
+            ticks++;
+        }
+    } while (ticks != os_time);
+
+    return ticks * (SysTick->LOAD + 1) + (SysTick->LOAD - val);
+#endif
+}
+
+uint32_t perf_get_clock(void)
+{
+    return SystemCoreClock;
+}
+
+void perf_timer_record(perf_timer_t timer, uint32_t start)
+{
+    uint32_t cycles = perf_get_cycles() - start;
+    perf_stat_t *stat = &perf_stats[timer];
+    cortex_int_state_t state;
+    // Timers are recorded from both the DAP and the main task
+    state = cortex_int_get_and_disable();
+    stat->count++;
+    stat->total += cycles;
+    stat->min = MIN(stat->min, cycles);
+    stat->max = MAX(stat->max, cycles);
+    cortex_int_restore(state);
+}
+
+const perf_stat_t *perf_get_stat(perf_timer_t timer)
+{
+    return &perf_stats[timer];
+}
@@ -0,0 +1,109 @@
+/**
+ * @file    perf_counter.h
+ * @brief   Cycle accurate timing and event counters for the probe
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PERF_COUNTER_H
+#define PERF_COUNTER_H
+
+#include "stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Keep in sync with the list perf_timer_name
+typedef enum {
+    PERF_TIMER_DAP_COMMAND,     // One call to DAP_ProcessCommand
+    PERF_TIMER_SWD_TRANSFER,    // One swd_host transfer including WAIT retries
+    PERF_TIMER_FLASH_SYSCALL,   // One flash algorithm call on the target
+
+    // Add new values here
+    PERF_TIMER_COUNT
+} perf_timer_t;
+
+// Keep in sync with the list perf_event_name
+typedef enum {
+    PERF_EVENT_SWD_TRANSFER,    // SWD packets sent
+    PERF_EVENT_SWD_WAIT,        // WAIT acknowledges, each one causes a retry
+    PERF_EVENT_SWD_FAULT,       // FAULT acknowledges
+    PERF_EVENT_SWD_ERROR,       // Protocol or parity errors
+    PERF_EVENT_SWD_RETRY_LIMIT, // swd_host transfers that ran out of retries
+    PERF_EVENT_SWJ_CLOCKS,      // SWCLK cycles put on the wire
+    PERF_EVENT_FLASH_BYTES,     // Bytes programmed into target flash
+
+    // Add new values here
+    PERF_EVENT_COUNT
+} perf_event_t;
+
+// Largest report written by perf_write_report, one drive sector
+#define PERF_REPORT_MAX_SIZE    512
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+} perf_stat_t;
+
+extern uint32_t perf_events[PERF_EVENT_COUNT];
+
+// Start the cycle counter.  Must be called before any measurement.
+void perf_init(void);
+
+// Clear all timers and event counters
+void perf_reset(void);
+
+// Free running cycle count of the interface MCU
+uint32_t perf_get_cycles(void);
+
+// Frequency of perf_get_cycles in Hz
+uint32_t perf_get_clock(void);
+
+// Add the time elapsed since start (from perf_get_cycles) to a timer
+void perf_timer_record(perf_timer_t timer, uint32_t start);
+
+const perf_stat_t *perf_get_stat(perf_timer_t timer);
+const char *perf_get_timer_name(perf_timer_t timer);
+const char *perf_get_event_name(perf_event_t event);
+
+// Write a text report of all timers and events to buf and return its
+// size.  Values are zero padded so the size does not change as the
+// counters do, and the report is never larger than PERF_REPORT_MAX_SIZE.
+uint32_t perf_write_report(char *buf);
+
+// Count an event.  Inlined since this is used in the SWD hot path.
+__attribute__((always_inline))
+static inline void perf_count(perf_event_t event)
+{
+    perf_events[event]++;
+}
+
+// Add count to an event
+__attribute__((always_inline))
+static inline void perf_count_n(perf_event_t event, uint32_t count)
+{
+    perf_events[event] += count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
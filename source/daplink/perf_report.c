@@ -0,0 +1,112 @@
+/**
+ * @file    perf_report.c
+ * @brief   Text report of the perf_counter.h timers and events
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perf_counter.h"
+#include "macro.h"
+#include "util.h"
+#include "compiler.h"
+#include "DAP_config.h"     // for DAP_DEFAULT_SWJ_CLOCK
+
+// Every value is written as 10 digits
+#define VALUE_SIZE      10
+
+static const char *const perf_timer_name[] = {
+    // PERF_TIMER_DAP_COMMAND
+    "DAP command",
+    // PERF_TIMER_SWD_TRANSFER
+    "SWD transfer",
+    // PERF_TIMER_FLASH_SYSCALL
+    "Flash syscall",
+};
+COMPILER_ASSERT(PERF_TIMER_COUNT == ELEMENTS_IN_ARRAY(perf_timer_name));
+
+static const char *const perf_event_name[] = {
+    // PERF_EVENT_SWD_TRANSFER
+    "SWD packets",
+    // PERF_EVENT_SWD_WAIT
+    "SWD WAIT",
+    // PERF_EVENT_SWD_FAULT
+    "SWD FAULT",
+    // PERF_EVENT_SWD_ERROR
+    "SWD error",
+    // PERF_EVENT_SWD_RETRY_LIMIT
+    "SWD retry limit",
+    // PERF_EVENT_SWJ_CLOCKS
+    "SWJ clocks",
+    // PERF_EVENT_FLASH_BYTES
+    "Flash bytes",
+};
+COMPILER_ASSERT(PERF_EVENT_COUNT == ELEMENTS_IN_ARRAY(perf_event_name));
+
+const char *perf_get_timer_name(perf_timer_t timer)
+{
+    return perf_timer_name[timer];
+}
+
+const char *perf_get_event_name(perf_event_t event)
+{
+    return perf_event_name[event];
+}
+
+uint32_t perf_write_report(char *buf)
+{
+    uint32_t pos;
+    uint32_t i;
+    uint32_t flash_bytes;
+    const perf_stat_t *stat;
+
+    pos = 0;
+    pos += util_write_string(buf + pos, "# Counters, times in cycles\r\n");
+    pos += util_write_string(buf + pos, "Clock: ");
+    pos += util_write_uint32_zp(buf + pos, perf_get_clock(), VALUE_SIZE);
+    pos += util_write_string(buf + pos, " Hz\r\n");
+
+    for (i = 0; i < PERF_TIMER_COUNT; i++) {
+        stat = perf_get_stat((perf_timer_t)i);
+        pos += util_write_string(buf + pos, perf_timer_name[i]);
+        pos += util_write_string(buf + pos, ": count=");
+        pos += util_write_uint32_zp(buf + pos, stat->count, VALUE_SIZE);
+        pos += util_write_string(buf + pos, " avg=");
+        pos += util_write_uint32_zp(buf + pos, stat->count ? (uint32_t)(stat->total / stat->count) : 0, VALUE_SIZE);
+        pos += util_write_string(buf + pos, " max=");
+        pos += util_write_uint32_zp(buf + pos, stat->max, VALUE_SIZE);
+        pos += util_write_string(buf + pos, "\r\n");
+    }
+
+    for (i = 0; i < PERF_EVENT_COUNT; i++) {
+        pos += util_write_string(buf + pos, perf_event_name[i]);
+        pos += util_write_string(buf + pos, ": ");
+        pos += util_write_uint32_zp(buf + pos, perf_events[i], VALUE_SIZE);
+        pos += util_write_string(buf + pos, "\r\n");
+    }
+
+    // Cost of programming, wire time is estimated at the default SWCLK
+    flash_bytes = MAX(perf_events[PERF_EVENT_FLASH_BYTES], 1);
+    pos += util_write_string(buf + pos, "SWD packets per KB: ");
+    pos += util_write_uint32_zp(buf + pos, (uint32_t)((uint64_t)perf_events[PERF_EVENT_SWD_TRANSFER] * 1024 / flash_bytes), VALUE_SIZE);
+    pos += util_write_string(buf + pos, "\r\nSWJ wire time per KB at ");
+    pos += util_write_uint32_zp(buf + pos, DAP_DEFAULT_SWJ_CLOCK, VALUE_SIZE);
+    pos += util_write_string(buf + pos, " Hz: ");
+    pos += util_write_uint32_zp(buf + pos, (uint32_t)((uint64_t)perf_events[PERF_EVENT_SWJ_CLOCKS] * 1024 / flash_bytes * 1000000 / DAP_DEFAULT_SWJ_CLOCK), VALUE_SIZE);
+    pos += util_write_string(buf + pos, " us\r\n");
+
+    return pos;
+}
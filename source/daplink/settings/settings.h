@@ -40,9 +40,11 @@ void config_init(void);
 void config_set_auto_rst(bool on);
 void config_set_automation_allowed(bool on);
 void config_set_overflow_detect(bool on);
+void config_set_full_remount(bool on);
 bool config_get_auto_rst(void);
 bool config_get_automation_allowed(void);
 bool config_get_overflow_detect(void);
+bool config_get_full_remount(void);
 
 // Get/set settings residing in shared ram
 void config_ram_set_hold_in_bl(bool hold);
@@ -26,6 +26,7 @@
 #include "compiler.h"
 #include "cortex_m.h"
 #include "FlashPrg.h"
+#include "info.h"
 
 // 'kvld' in hex - key valid
 #define CFG_KEY             0x6b766c64
@@ -44,13 +45,14 @@ typedef struct __attribute__((__packed__)) cfg_setting {
     uint8_t auto_rst;
     uint8_t automation_allowed;
     uint8_t overflow_detect;
+    uint8_t full_remount;
 
     // Add new members here
 
 } cfg_setting_t;
 
 // Make sure FORMAT in generate_config.py is updated if size changes
-COMPILER_ASSERT(sizeof(cfg_setting_t) == 9);
+COMPILER_ASSERT(sizeof(cfg_setting_t) == 10);
 
 // Sector buffer must be as big or bigger than settings
 COMPILER_ASSERT(sizeof(cfg_setting_t) < SECTOR_BUFFER_SIZE);
@@ -70,6 +72,7 @@ static const cfg_setting_t config_default = {
     .auto_rst = 0,
     .automation_allowed = 0,
     .overflow_detect = 0,
+    .full_remount = 0,
 };
 
 // Buffer for data to flash
@@ -94,7 +97,9 @@ static bool config_needs_update()
     return false;
 }
 
-// Reprogram the new settings if flash writing is allowed
+// Reprogram the new settings if flash writing is allowed.  The cached
+// CRC of the config sector is dropped after every write, even a failed
+// one, since the sector may have changed.
 static void program_cfg(cfg_setting_t *new_cfg)
 {
     uint32_t status;
@@ -104,6 +109,7 @@ static void program_cfg(cfg_setting_t *new_cfg)
     state = cortex_int_get_and_disable();
     status = EraseSector(addr);
     cortex_int_restore(state);
+    info_crc_invalidate(addr, sizeof(write_buffer));
 
     if (status != 0) {
         return;
@@ -114,6 +120,7 @@ static void program_cfg(cfg_setting_t *new_cfg)
     state = cortex_int_get_and_disable();
     status = ProgramPage(addr, sizeof(write_buffer), write_buffer);
     cortex_int_restore(state);
+    info_crc_invalidate(addr, sizeof(write_buffer));
 
     if (0 != status) {
         return;
@@ -163,6 +170,12 @@ void config_set_overflow_detect(bool on)
     program_cfg(&config_rom_copy);
 }
 
+void config_set_full_remount(bool on)
+{
+    config_rom_copy.full_remount = on;
+    program_cfg(&config_rom_copy);
+}
+
 bool config_get_auto_rst()
 {
     return config_rom_copy.auto_rst;
@@ -177,3 +190,8 @@ bool config_get_overflow_detect()
 {
     return config_rom_copy.overflow_detect;
 }
+
+bool config_get_full_remount()
+{
+    return config_rom_copy.full_remount;
+}
@@ -43,6 +43,11 @@ void config_set_overflow_detect(bool on)
     // Do nothing
 }
 
+void config_set_full_remount(bool on)
+{
+    // Do nothing
+}
+
 bool config_get_auto_rst()
 {
     return false;
@@ -57,3 +62,8 @@ bool config_get_overflow_detect()
 {
     return false;
 }
+
+bool config_get_full_remount()
+{
+    return false;
+}
@@ -40,6 +40,26 @@ extern "C" {
 // This can vary from target to target and should be in the structure or flash blob
 #define TARGET_AUTO_INCREMENT_PAGE_SIZE    (1024)
 
+// Reset timing for targets which do not set their own.  These match the
+// two RTX ticks previously waited on each side of the reset pulse.
+#ifndef TARGET_RESET_PULSE_US
+#define TARGET_RESET_PULSE_US   (20000)
+#endif
+#ifndef TARGET_RESET_SETTLE_US
+#define TARGET_RESET_SETTLE_US  (20000)
+#endif
+
+// Reset pulse used while detecting an unknown target, the one RTX tick
+// waited before
+#ifndef TARGET_DETECT_PULSE_US
+#define TARGET_DETECT_PULSE_US  (10000)
+#endif
+
+// Longest time a target may take to halt after a reset
+#ifndef TARGET_HALT_TIMEOUT_US
+#define TARGET_HALT_TIMEOUT_US  (500000)
+#endif
+
 /**
  @struct target_cfg_t
  @brief  The firmware configuration struct has unique about the chip its running on.
@@ -57,6 +77,9 @@ typedef struct target_cfg {
     uint32_t (*get_sector_number)(uint32_t addr);  // convert flash address to sector number
     uint32_t (*get_sector_address)(uint32_t sector);  //convert sector number to flash address
     uint32_t (*get_sector_length)(uint32_t sector);  //get sector size. (some device has difference sector size)
+    uint32_t reset_pulse_us;        /*!< Time nRESET is held low, 0 for TARGET_RESET_PULSE_US */
+    uint32_t reset_settle_us;       /*!< Time from a reset until the debug port is usable, 0 for TARGET_RESET_SETTLE_US */
+    uint32_t uf2_family_id;         /*!< UF2 family ID of the device, 0 to program blocks of any family */
     
 } target_cfg_t;
 
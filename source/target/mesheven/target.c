@@ -56,6 +56,7 @@ uint32_t stm32f031_GetSecAddress(uint32_t sector);
 uint32_t stm32f031_GetSecLength(uint32_t sector);
 
 // target information
+// The reset times leave room for the capacitor usually fitted on nRESET
 const target_cfg_t target_device[] = 
 {
     //nrf51822
@@ -70,6 +71,9 @@ const target_cfg_t target_device[] =
         .get_sector_number = nrf51_GetSecNum,
         .get_sector_address = nrf51_GetSecAddress,
         .get_sector_length = nrf51_GetSecLength,
+        .reset_pulse_us     = 1000,
+        .reset_settle_us    = 2000,
+        .uf2_family_id      = 0x1B57745F,
     },
     //stm32f051kX
     {
@@ -83,6 +87,9 @@ const target_cfg_t target_device[] =
         .get_sector_number = stm32f051_GetSecNum,
         .get_sector_address = stm32f051_GetSecAddress,
         .get_sector_length = stm32f051_GetSecLength,        
+        .reset_pulse_us     = 1000,
+        .reset_settle_us    = 5000,
+        .uf2_family_id      = 0x647824B6,
     },
     //stm32f103rc
     {
@@ -96,6 +103,9 @@ const target_cfg_t target_device[] =
         .get_sector_number = stm32f103_GetSecNum,
         .get_sector_address = stm32f103_GetSecAddress,
         .get_sector_length = stm32f103_GetSecLength,        
+        .reset_pulse_us     = 1000,
+        .reset_settle_us    = 5000,
+        .uf2_family_id      = 0x5EE21072,
     },
     //stm32f405
     {
@@ -109,6 +119,9 @@ const target_cfg_t target_device[] =
         .get_sector_number = stm32f405_GetSecNum,
         .get_sector_address = stm32f405_GetSecAddress,
         .get_sector_length = stm32f405_GetSecLength,        
+        .reset_pulse_us     = 1000,
+        .reset_settle_us    = 5000,
+        .uf2_family_id      = 0x57755A57,
     },
     //stm32f071
     {
@@ -122,6 +135,9 @@ const target_cfg_t target_device[] =
         .get_sector_number = stm32f071_GetSecNum,
         .get_sector_address = stm32f071_GetSecAddress,
         .get_sector_length = stm32f071_GetSecLength,        
+        .reset_pulse_us     = 1000,
+        .reset_settle_us    = 5000,
+        .uf2_family_id      = 0x647824B6,
     },
     //stm32f031
     {
@@ -135,6 +151,9 @@ const target_cfg_t target_device[] =
         .get_sector_number = stm32f031_GetSecNum,
         .get_sector_address = stm32f031_GetSecAddress,
         .get_sector_length = stm32f031_GetSecLength,        
+        .reset_pulse_us     = 1000,
+        .reset_settle_us    = 5000,
+        .uf2_family_id      = 0x647824B6,
     }    
     
 };
@@ -28,6 +28,7 @@
 #include "macro.h"
 
 BOOL USBD_MSC_MediaReady = __FALSE;
+BOOL USBD_MSC_MediaChanged = __FALSE;   /* Report a medium change once media is ready */
 BOOL USBD_MSC_ReadOnly = __FALSE;
 U32 USBD_MSC_MemorySize;
 U32 USBD_MSC_BlockSize;
@@ -40,6 +41,8 @@ MSC_CSW USBD_MSC_CSW;       /* Command Status Wrapper */
 
 BOOL USBD_MSC_MediaReadyEx = __FALSE;   /* Previous state of Media ready */
 BOOL MemOK;     /* Memory OK */
+BOOL MediaChangeSense;  /* Medium change left to report in the sense data */
+BOOL ReadErrorSense;    /* Last command failed reading the medium */
 
 U32 Block;      /* R/W Block  */
 U32 Offset;     /* R/W Offset */
@@ -47,6 +50,7 @@ U32 Length;     /* R/W Length */
 
 U8 BulkStage;   /* Bulk Stage */
 U32 BulkLen;    /* Bulk In/Out Length */
+BOOL BulkDirect;    /* Bulk Out data was read into the block buffer */
 
 
 /* Dummy Weak Functions that need to be provided by user */
@@ -54,9 +58,9 @@ __weak void usbd_msc_init()
 {
 
 }
-__weak void usbd_msc_read_sect(U32 block, U8 *buf, U32 num_of_blocks)
+__weak BOOL usbd_msc_read_sect(U32 block, U8 *buf, U32 num_of_blocks)
 {
-
+    return (__TRUE);
 }
 __weak void usbd_msc_write_sect(U32 block, U8 *buf, U32 num_of_blocks)
 {
@@ -65,6 +69,10 @@ __weak void usbd_msc_write_sect(U32 block, U8 *buf, U32 num_of_blocks)
 __weak void usbd_msc_start_stop(BOOL start)
 {
 
+}
+__weak void usbd_msc_flush(void)
+{
+
 }
 
 
@@ -146,7 +154,7 @@ BOOL USBD_MSC_CheckMedia(void)
 {
     USBD_MSC_MediaReadyEx = USBD_MSC_MediaReady;
 
-    if (!USBD_MSC_MediaReady) {
+    if (!USBD_MSC_MediaReady || USBD_MSC_MediaChanged) {
         if (USBD_MSC_CBW.dDataLength) {
             if ((USBD_MSC_CBW.bmFlags & 0x80) != 0) {
                 USBD_MSC_SetStallEP(usbd_msc_ep_bulkin | 0x80);
@@ -158,6 +166,13 @@ BOOL USBD_MSC_CheckMedia(void)
             }
         }
 
+        if (USBD_MSC_MediaReady) {
+            /* A medium change fails only one command so that hosts which */
+            /* never request sense data still see the new medium          */
+            USBD_MSC_MediaChanged = __FALSE;
+            MediaChangeSense = __TRUE;
+        }
+
         USBD_MSC_CSW.bStatus = CSW_CMD_FAILED;
         USBD_MSC_SetCSW();
         return (__FALSE);
@@ -202,7 +217,14 @@ void USBD_MSC_MemoryRead(void)
             m = USBD_MSC_BlockGroup;
         }
 
-        usbd_msc_read_sect(Block, USBD_MSC_BlockBuf, m);
+        if (!usbd_msc_read_sect(Block, USBD_MSC_BlockBuf, m)) {
+            /* Fail the command, Request Sense reports a medium error */
+            USBD_MSC_SetStallEP(usbd_msc_ep_bulkin | 0x80);
+            ReadErrorSense = __TRUE;
+            USBD_MSC_CSW.bStatus = CSW_CMD_FAILED;
+            USBD_MSC_SetCSW();
+            return;
+        }
     }
 
     if (n) {
@@ -251,14 +273,15 @@ void USBD_MSC_MemoryWrite(void)
         BulkLen = 0;
     }
 
-    if (Offset + BulkLen > USBD_MSC_BlockSize) {
+    if (Offset + BulkLen > USBD_MSC_BlockGroup * USBD_MSC_BlockSize) {
         // This write would have overflowed USBD_MSC_BlockBuf
         util_assert(0);
         return;
     }
 
-    for (n = 0; n < BulkLen; n++) {
-        USBD_MSC_BlockBuf[Offset + n] = USBD_MSC_BulkBuf[n];
+    // Data read directly into the block buffer is already in place
+    if (!BulkDirect) {
+        memcpy(&USBD_MSC_BlockBuf[Offset], USBD_MSC_BulkBuf, BulkLen);
     }
 
     Offset += BulkLen;
@@ -325,7 +348,9 @@ void USBD_MSC_MemoryVerify(void)
                 n = USBD_MSC_BlockGroup;
             }
 
-            usbd_msc_read_sect(Block, USBD_MSC_BlockBuf, n);
+            if (!usbd_msc_read_sect(Block, USBD_MSC_BlockBuf, n)) {
+                MemOK = __FALSE;
+            }
         }
 
         for (n = 0; n < BulkLen; n++) {
@@ -514,11 +539,18 @@ void USBD_MSC_RequestSense(void)
     USBD_MSC_BulkBuf[ 0] = 0x70;             /* Response Code */
     USBD_MSC_BulkBuf[ 1] = 0x00;
 
-    if ((USBD_MSC_MediaReadyEx ^ USBD_MSC_MediaReady) & USBD_MSC_MediaReady) {  /* If media state changed to ready */
+    if (((USBD_MSC_MediaReadyEx ^ USBD_MSC_MediaReady) & USBD_MSC_MediaReady) ||  /* If media state changed to ready */
+            (USBD_MSC_MediaReady && (USBD_MSC_MediaChanged || MediaChangeSense))) {  /* or the medium was replaced */
         USBD_MSC_BulkBuf[ 2] = 0x06;           /* UNIT ATTENTION */
         USBD_MSC_BulkBuf[12] = 0x28;           /* Additional Sense Code: Not ready to ready transition */
         USBD_MSC_BulkBuf[13] = 0x00;           /* Additional Sense Code Qualifier */
         USBD_MSC_MediaReadyEx = USBD_MSC_MediaReady;
+        USBD_MSC_MediaChanged = __FALSE;
+        MediaChangeSense = __FALSE;
+    } else if (!USBD_MSC_MediaReady && USBD_MSC_MediaChanged) {
+        USBD_MSC_BulkBuf[ 2] = 0x02;           /* NOT READY */
+        USBD_MSC_BulkBuf[12] = 0x04;           /* Additional Sense Code: Logical unit not ready */
+        USBD_MSC_BulkBuf[13] = 0x01;           /* Additional Sense Code Qualifier: Becoming ready */
     } else if (!USBD_MSC_MediaReady) {
         USBD_MSC_BulkBuf[ 2] = 0x02;           /* NOT READY */
         USBD_MSC_BulkBuf[12] = 0x3A;           /* Additional Sense Code: Medium not present */
@@ -528,6 +560,10 @@ void USBD_MSC_RequestSense(void)
             USBD_MSC_BulkBuf[ 2] = 0x00;         /* NO SENSE */
             USBD_MSC_BulkBuf[12] = 0x00;         /* Additional Sense Code: No additional code */
             USBD_MSC_BulkBuf[13] = 0x00;         /* Additional Sense Code Qualifier */
+        } else if (ReadErrorSense) {
+            USBD_MSC_BulkBuf[ 2] = 0x03;         /* MEDIUM ERROR */
+            USBD_MSC_BulkBuf[12] = 0x11;         /* Additional Sense Code: Unrecovered read error */
+            USBD_MSC_BulkBuf[13] = 0x00;         /* Additional Sense Code Qualifier */
         } else {
             USBD_MSC_BulkBuf[ 2] = 0x05;         /* ILLEGAL REQUEST */
             USBD_MSC_BulkBuf[12] = 0x20;         /* Additional Sense Code: Invalid command */
@@ -623,6 +659,7 @@ void USBD_MSC_MediaRemoval(void)
     if (USBD_MSC_CBW.CB[4] & 1) {            /* If prevent */
         USBD_MSC_CSW.bStatus = CSW_CMD_FAILED;    /* Prevent media removal -> fail */
     } else {                                 /* If allow */
+        usbd_msc_flush();                    /* Host is done writing */
         USBD_MSC_CSW.bStatus = CSW_CMD_PASSED;    /* Allow media removal -> pass */
     }
 
@@ -784,6 +821,7 @@ void USBD_MSC_SynchronizeCache(void)
 {
     /* Synchronize check always passes as we always write data dirrectly
        so cache is always synchronized                                          */
+    usbd_msc_flush();
     USBD_MSC_CSW.bStatus = CSW_CMD_PASSED;
     USBD_MSC_SetCSW();
 }
@@ -870,6 +908,11 @@ fail:
             USBD_MSC_CSW.bStatus = CSW_CMD_FAILED;
             USBD_MSC_SetCSW();
         } else {
+            /* A read error is only reported to the Request Sense following it */
+            if (USBD_MSC_CBW.CB[0] != SCSI_REQUEST_SENSE) {
+                ReadErrorSense = __FALSE;
+            }
+
             switch (USBD_MSC_CBW.CB[0]) {
                 case SCSI_TEST_UNIT_READY:
                     USBD_MSC_TestUnitReady();
@@ -1139,7 +1182,19 @@ void USBD_MSC_EP_BULKIN_Event(U32 event)
 
 void USBD_MSC_EP_BULKOUT_Event(U32 event)
 {
-    BulkLen = USBD_ReadEP(usbd_msc_ep_bulkout, USBD_MSC_BulkBuf, USBD_MSC_BulkBufSize);
+    U8 *buf = USBD_MSC_BulkBuf;
+
+    /* Write data goes straight into the block buffer if a whole packet */
+    /* fits at a word aligned position                                  */
+    if ((BulkStage == MSC_BS_DATA_OUT) &&
+            ((USBD_MSC_CBW.CB[0] == SCSI_WRITE10) || (USBD_MSC_CBW.CB[0] == SCSI_WRITE12)) &&
+            (Offset + USBD_MSC_BulkBufSize <= USBD_MSC_BlockGroup * USBD_MSC_BlockSize) &&
+            (((U32)&USBD_MSC_BlockBuf[Offset] & 3) == 0)) {
+        buf = &USBD_MSC_BlockBuf[Offset];
+    }
+
+    BulkDirect = (buf != USBD_MSC_BulkBuf);
+    BulkLen = USBD_ReadEP(usbd_msc_ep_bulkout, buf, USBD_MSC_BulkBufSize);
     USBD_MSC_BulkOut();
 }
 
@@ -27,6 +27,7 @@
 
 /* USB Device Mass Storage Device Class Global Variables */
 extern BOOL USBD_MSC_MediaReady;
+extern BOOL USBD_MSC_MediaChanged;
 extern BOOL USBD_MSC_ReadOnly;
 extern U32 USBD_MSC_MemorySize;
 extern U32 USBD_MSC_BlockSize;
@@ -0,0 +1,197 @@
+/**
+ * @file    crc32_test.c
+ * @brief   Unit tests and benchmark for the table driven CRC-32
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+
+#include "crc.h"
+
+#define POLYNOMIAL          0x04C11DB7
+#define INITIAL_REMAINDER   0xFFFFFFFF
+#define FINAL_XOR_VALUE     0xFFFFFFFF
+#define CHECK_VALUE         0xCBF43926
+
+#define TEST_DATA_SIZE      4096
+#define BENCH_DATA_SIZE     (1024 * 1024)
+#define BENCH_MIN_US        500000
+
+static uint32_t failures;
+
+#define CHECK(cond, ...)                                                    \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            failures++;                                                     \
+            printf("FAIL %s:%u: ", __FILE__, __LINE__);                     \
+            printf(__VA_ARGS__);                                            \
+            printf("\n");                                                   \
+        }                                                                   \
+    } while (0)
+
+static uint64_t time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Bit at a time implementation crc32.c used before the table.  The
+// remainder is a uint32_t rather than an unsigned long so it still has
+// the width of the firmware on a 64 bit host.
+static uint32_t reflect(uint32_t data, uint8_t bits)
+{
+    uint32_t reflection = 0;
+    uint8_t bit;
+
+    for (bit = 0; bit < bits; bit++) {
+        if (data & 1) {
+            reflection |= 1UL << (bits - 1 - bit);
+        }
+
+        data >>= 1;
+    }
+
+    return reflection;
+}
+
+static uint32_t bitwise_continue(uint32_t prev_crc, const void *data, int size)
+{
+    const uint8_t *message = data;
+    uint32_t remainder = reflect(prev_crc ^ FINAL_XOR_VALUE, 32);
+    uint8_t bit;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        remainder ^= reflect(message[i], 8) << 24;
+
+        for (bit = 8; bit > 0; bit--) {
+            remainder = (remainder & 0x80000000) ? (remainder << 1) ^ POLYNOMIAL : remainder << 1;
+        }
+    }
+
+    return reflect(remainder, 32) ^ FINAL_XOR_VALUE;
+}
+
+static uint32_t bitwise_crc32(const void *data, int size)
+{
+    return bitwise_continue(INITIAL_REMAINDER ^ FINAL_XOR_VALUE, data, size);
+}
+
+static void fill_random(uint8_t *data, uint32_t size, uint32_t seed)
+{
+    uint32_t i;
+
+    for (i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+}
+
+static void test_check_value(void)
+{
+    static const char check[] = "123456789";
+    CHECK(CHECK_VALUE == crc32(check, sizeof(check) - 1), "check value %08X", crc32(check, sizeof(check) - 1));
+    CHECK(CHECK_VALUE == bitwise_crc32(check, sizeof(check) - 1), "bitwise check value %08X",
+          bitwise_crc32(check, sizeof(check) - 1));
+    CHECK(0 == crc32(check, 0), "empty crc %08X", crc32(check, 0));
+}
+
+// Every length and alignment against the bitwise implementation
+static void test_one_shot(void)
+{
+    uint8_t data[TEST_DATA_SIZE];
+    uint32_t offset, size, expect, actual;
+    fill_random(data, sizeof(data), 1);
+
+    for (offset = 0; offset < 4; offset++) {
+        for (size = 0; size + offset <= sizeof(data); size += (size < 64) ? 1 : 61) {
+            expect = bitwise_crc32(data + offset, size);
+            actual = crc32(data + offset, size);
+            CHECK(expect == actual, "offset %u size %u: %08X, expected %08X", offset, size, actual, expect);
+        }
+    }
+}
+
+// The incremental functions and crc32_continue with random splits
+static void test_incremental(void)
+{
+    uint8_t data[TEST_DATA_SIZE];
+    uint32_t run, size, pos, part, remainder, expect, actual;
+    uint32_t seed = 2;
+    fill_random(data, sizeof(data), 3);
+
+    for (run = 0; run < 200; run++) {
+        seed = seed * 1103515245 + 12345;
+        size = (seed >> 8) % (sizeof(data) + 1);
+        expect = bitwise_crc32(data, size);
+        remainder = crc32_init();
+
+        for (pos = 0; pos < size; pos += part) {
+            seed = seed * 1103515245 + 12345;
+            part = ((seed >> 8) % 300) + 1;
+            part = (part < size - pos) ? part : size - pos;
+            remainder = crc32_update(remainder, data + pos, part);
+        }
+
+        actual = crc32_final(remainder);
+        CHECK(expect == actual, "size %u split: %08X, expected %08X", size, actual, expect);
+        part = size / 3;
+        actual = crc32_continue(crc32(data, part), data + part, size - part);
+        expect = bitwise_continue(bitwise_crc32(data, part), data + part, size - part);
+        CHECK(expect == actual, "size %u continue: %08X, expected %08X", size, actual, expect);
+    }
+}
+
+static void bench(const char *name, uint32_t (*function)(const void *, int))
+{
+    uint8_t *data = malloc(BENCH_DATA_SIZE);
+    uint32_t runs = 0;
+    uint64_t start, elapsed;
+    volatile uint32_t result;
+    fill_random(data, BENCH_DATA_SIZE, 4);
+    start = time_us();
+
+    do {
+        result = function(data, BENCH_DATA_SIZE);
+        runs++;
+        elapsed = time_us() - start;
+    } while (elapsed < BENCH_MIN_US);
+
+    (void)result;
+    printf("crc32 %-8s: %8.2f MB/s\n", name, (double)BENCH_DATA_SIZE * runs / elapsed);
+    free(data);
+}
+
+int main(int argc, char *argv[])
+{
+    test_check_value();
+    test_one_shot();
+    test_incremental();
+    printf("crc32 tests: %s\n", failures ? "FAILED" : "passed");
+
+    if ((argc > 1) && (0 == strcmp(argv[1], "--bench"))) {
+        bench("table", crc32);
+        bench("bitwise", bitwise_crc32);
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+/**
+ * @file    flash_manager_test.c
+ * @brief   Tests of the flash manager block buffering
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "error.h"
+#include "util.h"
+#include "flash_manager.h"
+#include "flash_sim.h"
+
+#define FLASH_START         0x10000
+#define FLASH_SIZE          0x10000
+#define BLOCK_SIZE          512
+
+static const flash_sim_config_t flash_config = {
+    .start              = FLASH_START,
+    .size               = FLASH_SIZE,
+    .sector_size        = 1024,
+    .page_size          = 256,
+};
+
+static uint32_t failures;
+static uint8_t image[FLASH_SIZE];
+static bool page_erase;
+
+#define CHECK(cond, ...)                                                    \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            failures++;                                                     \
+            printf("FAIL %s:%u %s: ", __FILE__, __LINE__,                   \
+                   page_erase ? "page erase" : "chip erase");               \
+            printf(__VA_ARGS__);                                            \
+            printf("\n");                                                   \
+        }                                                                   \
+    } while (0)
+
+void _util_assert(bool expression, const char *filename, uint16_t line)
+{
+    if (!expression) {
+        printf("Assert at %s:%u\n", filename, line);
+        abort();
+    }
+}
+
+static void fill_random(uint8_t *data, uint32_t size, uint32_t seed)
+{
+    uint32_t i;
+
+    for (i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+}
+
+static void open_flash(void)
+{
+    flash_sim_reset(&flash_config);
+    flash_manager_set_page_erase(page_erase);
+    CHECK(ERROR_SUCCESS == flash_manager_init(flash_intf_target), "init failed");
+}
+
+static error_t write(uint32_t offset, uint32_t size)
+{
+    return flash_manager_data(FLASH_START + offset, image + offset, size);
+}
+
+// Close the manager and check the flash holds the image up to size
+static void close_flash(uint32_t size)
+{
+    const flash_sim_stats_t *stats = flash_sim_get_stats();
+    CHECK(ERROR_SUCCESS == flash_manager_uninit(), "uninit failed");
+    CHECK(0 == stats->reprograms, "%u pages programmed twice", stats->reprograms);
+    CHECK(0 == memcmp(flash_sim_data(), image, size), "flash does not match the image");
+}
+
+// Bytes written twice do not complete a block before the rest arrives
+static void test_rewrite_in_block(void)
+{
+    open_flash();
+    CHECK(ERROR_SUCCESS == write(0, 256), "first half");
+    CHECK(ERROR_SUCCESS == write(0, 256), "first half again");
+    CHECK(0 == flash_sim_get_stats()->page_programs, "block programmed with only half of it written");
+    CHECK(ERROR_SUCCESS == write(256, 256), "second half");
+    CHECK(2 == flash_sim_get_stats()->page_programs, "block not programmed once complete");
+    close_flash(BLOCK_SIZE);
+}
+
+// Overlapping records and whole blocks sent again after they have been
+// programmed, like a resent UF2 block, are skipped when they match
+static void test_resend(void)
+{
+    open_flash();
+    CHECK(ERROR_SUCCESS == write(0, 300), "first record");
+    CHECK(ERROR_SUCCESS == write(200, 824), "overlapping record");
+    CHECK(ERROR_SUCCESS == write(0, BLOCK_SIZE), "block sent again");
+    CHECK(ERROR_SUCCESS == write(100, 50), "part of a block sent again");
+    CHECK(ERROR_SUCCESS == write(BLOCK_SIZE - 10, 20), "data across two programmed blocks");
+    CHECK(4 == flash_sim_get_stats()->page_programs, "%u pages programmed", flash_sim_get_stats()->page_programs);
+    close_flash(2 * BLOCK_SIZE);
+}
+
+// Different data for a programmed block fails instead of programming it again
+static void test_changed_data(void)
+{
+    uint8_t changed[16];
+    open_flash();
+    CHECK(ERROR_SUCCESS == write(0, BLOCK_SIZE), "block");
+    memcpy(changed, image + 64, sizeof(changed));
+    changed[5] ^= 1;
+    CHECK(ERROR_FLASH_ORDER == flash_manager_data(FLASH_START + 64, changed, sizeof(changed)),
+          "changed data accepted");
+    flash_manager_uninit();
+    CHECK(0 == flash_sim_get_stats()->reprograms, "pages programmed twice");
+}
+
+// Blocks programmed out of order join up so more separate blocks can be
+// programmed than there are ranges, but only so many gaps can be open
+static void test_ranges(void)
+{
+    uint32_t i;
+    open_flash();
+
+    for (i = 0; i < 16; i += 2) {
+        CHECK(ERROR_SUCCESS == write(i * BLOCK_SIZE, BLOCK_SIZE), "block %u", i);
+    }
+
+    for (i = 1; i < 16; i += 2) {
+        CHECK(ERROR_SUCCESS == write(i * BLOCK_SIZE, BLOCK_SIZE), "block %u", i);
+    }
+
+    for (i = 17; i < 31; i += 2) {
+        CHECK(ERROR_SUCCESS == write(i * BLOCK_SIZE, BLOCK_SIZE), "block %u", i);
+    }
+
+    for (i = 16; i < 31; i += 2) {
+        CHECK(ERROR_SUCCESS == write(i * BLOCK_SIZE, BLOCK_SIZE), "block %u", i);
+    }
+
+    CHECK(ERROR_SUCCESS == write(0, 31 * BLOCK_SIZE), "everything sent again");
+    close_flash(31 * BLOCK_SIZE);
+    open_flash();
+
+    for (i = 0; i < 16; i += 2) {
+        CHECK(ERROR_SUCCESS == write(i * BLOCK_SIZE, BLOCK_SIZE), "block %u", i);
+    }
+
+    CHECK(ERROR_FLASH_ORDER == write(16 * BLOCK_SIZE, BLOCK_SIZE), "more ranges than can be tracked");
+    flash_manager_uninit();
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t mode;
+    fill_random(image, sizeof(image), 1);
+
+    for (mode = 0; mode < 2; mode++) {
+        page_erase = mode;
+        test_rewrite_in_block();
+        test_resend();
+        test_changed_data();
+        test_ranges();
+    }
+
+    printf("flash manager tests: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file    flash_sim.c
+ * @brief   Implementation of flash_sim.h
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdlib.h"
+#include "string.h"
+#include "unistd.h"
+
+#include "flash_sim.h"
+
+static error_t sim_init(void);
+static error_t sim_uninit(void);
+static error_t sim_program_page(uint32_t addr, const uint8_t *buf, uint32_t size);
+static error_t sim_erase_sector(uint32_t addr);
+static error_t sim_erase_chip(void);
+static uint32_t sim_program_page_min_size(uint32_t addr);
+static uint32_t sim_erase_sector_size(uint32_t addr);
+static error_t sim_read(uint32_t addr, uint8_t *buf, uint32_t size);
+
+static const flash_intf_t flash_intf = {
+    sim_init,
+    sim_uninit,
+    sim_program_page,
+    sim_erase_sector,
+    sim_erase_chip,
+    sim_program_page_min_size,
+    sim_erase_sector_size,
+    sim_read,
+};
+
+// Replaces the weak definition in flash_intf.c
+const flash_intf_t *const flash_intf_target = &flash_intf;
+
+static flash_sim_config_t cfg;
+static flash_sim_stats_t stats;
+static uint8_t *data;
+// One flag per page, set when the page is programmed and cleared by an erase
+static uint8_t *programmed;
+
+static void wait_us(uint32_t us)
+{
+    if (us > 0) {
+        usleep(us);
+    }
+}
+
+void flash_sim_reset(const flash_sim_config_t *config)
+{
+    cfg = *config;
+    memset(&stats, 0, sizeof(stats));
+    free(data);
+    free(programmed);
+    data = malloc(cfg.size);
+    programmed = calloc(cfg.size / cfg.page_size, 1);
+    memset(data, 0xFF, cfg.size);
+}
+
+const uint8_t *flash_sim_data(void)
+{
+    return data;
+}
+
+const flash_sim_stats_t *flash_sim_get_stats(void)
+{
+    return &stats;
+}
+
+static error_t sim_init(void)
+{
+    stats.inits++;
+    return ERROR_SUCCESS;
+}
+
+static error_t sim_uninit(void)
+{
+    return ERROR_SUCCESS;
+}
+
+static error_t sim_program_page(uint32_t addr, const uint8_t *buf, uint32_t size)
+{
+    uint32_t offset = addr - cfg.start;
+    uint32_t page;
+
+    if ((addr < cfg.start) || (offset % cfg.page_size != 0) ||
+            (size % cfg.page_size != 0) || (size > cfg.size - offset)) {
+        return ERROR_WRITE;
+    }
+
+    // Like most flash a page must be erased before it is programmed again
+    for (page = offset / cfg.page_size; page < (offset + size) / cfg.page_size; page++) {
+        if (programmed[page]) {
+            stats.reprograms++;
+            return ERROR_WRITE;
+        }
+    }
+
+    for (page = offset / cfg.page_size; page < (offset + size) / cfg.page_size; page++) {
+        programmed[page] = 1;
+        stats.page_programs++;
+        wait_us(cfg.program_page_us);
+    }
+
+    memcpy(data + offset, buf, size);
+    return ERROR_SUCCESS;
+}
+
+// Takes the sector address like flash_manager and the IAP interface
+static error_t sim_erase_sector(uint32_t addr)
+{
+    uint32_t offset = addr - cfg.start;
+
+    if ((addr < cfg.start) || (offset >= cfg.size) || (offset % cfg.sector_size != 0)) {
+        return ERROR_ERASE_SECTOR;
+    }
+
+    memset(data + offset, 0xFF, cfg.sector_size);
+    memset(programmed + offset / cfg.page_size, 0, cfg.sector_size / cfg.page_size);
+    stats.sector_erases++;
+    wait_us(cfg.erase_sector_us);
+    return ERROR_SUCCESS;
+}
+
+static error_t sim_erase_chip(void)
+{
+    memset(data, 0xFF, cfg.size);
+    memset(programmed, 0, cfg.size / cfg.page_size);
+    stats.chip_erases++;
+    wait_us(cfg.erase_chip_us);
+    return ERROR_SUCCESS;
+}
+
+static uint32_t sim_program_page_min_size(uint32_t addr)
+{
+    return cfg.page_size;
+}
+
+static uint32_t sim_erase_sector_size(uint32_t addr)
+{
+    return cfg.sector_size;
+}
+
+static error_t sim_read(uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    uint32_t offset = addr - cfg.start;
+
+    if ((addr < cfg.start) || (size > cfg.size) || (offset > cfg.size - size)) {
+        return ERROR_TARGET_READ;
+    }
+
+    memcpy(buf, data + offset, size);
+    return ERROR_SUCCESS;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file    flash_sim.h
+ * @brief   RAM backed flash_intf_t with erase and program latencies
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLASH_SIM_H
+#define FLASH_SIM_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#include "flash_intf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t start;                 // Address of the first byte
+    uint32_t size;                  // Size of the flash in bytes
+    uint32_t sector_size;           // Erase unit
+    uint32_t page_size;             // Smallest program unit
+    uint32_t erase_sector_us;       // Time to erase one sector
+    uint32_t erase_chip_us;         // Time to erase the whole flash
+    uint32_t program_page_us;       // Time to program one page
+} flash_sim_config_t;
+
+typedef struct {
+    uint32_t inits;
+    uint32_t sector_erases;
+    uint32_t chip_erases;
+    uint32_t page_programs;         // Pages programmed, counted in page_size units
+    uint32_t reprograms;            // Program calls on pages not erased since their last program
+} flash_sim_stats_t;
+
+// The simulated flash is linked in as flash_intf_target.  Set the
+// geometry and latencies and erase the whole flash.
+void flash_sim_reset(const flash_sim_config_t *config);
+
+// Contents of the flash, config->size bytes
+const uint8_t *flash_sim_data(void);
+
+const flash_sim_stats_t *flash_sim_get_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,322 @@
+/**
+ * @file    hex_test.c
+ * @brief   Unit tests and benchmark for the Intel HEX parser
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+
+#include "intelhex.h"
+#include "image.h"
+
+// Output buffer size used by write_hex in file_stream.c
+#define BIN_BUF_SIZE        256
+#define BENCH_IMAGE_SIZE    (1024 * 1024)
+#define BENCH_MIN_US        500000
+
+typedef struct {
+    uint32_t base;                  // Address of image[0]
+    uint8_t *image;                 // Memory the decoded data is written to
+    uint32_t image_size;
+    uint32_t writes;                // Number of blocks returned by the parser
+    uint32_t full_writes;           // Blocks which filled the output buffer
+    bool out_of_range;              // Data was returned outside of image
+} output_t;
+
+static uint32_t failures;
+
+#define CHECK(cond, ...)                                                    \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            failures++;                                                     \
+            printf("FAIL %s:%u: ", __FILE__, __LINE__);                     \
+            printf(__VA_ARGS__);                                            \
+            printf("\n");                                                   \
+        }                                                                   \
+    } while (0)
+
+static uint64_t time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void output_write(output_t *out, uint32_t addr, const uint8_t *data, uint32_t size, uint32_t buf_size)
+{
+    if (0 == size) {
+        return;
+    }
+
+    out->writes++;
+    out->full_writes += (size == buf_size) ? 1 : 0;
+
+    if ((0 == out->image) || (addr < out->base) || (addr - out->base + size > out->image_size)) {
+        out->out_of_range = out->out_of_range || (0 != out->image);
+        return;
+    }
+
+    memcpy(out->image + (addr - out->base), data, size);
+}
+
+// Feed hex to the parser in chunk sized pieces the way write_hex and
+// close_hex in file_stream.c do
+static hexfile_parse_status_t decode(const uint8_t *hex, uint32_t size, uint32_t chunk,
+                                     uint32_t buf_size, output_t *out)
+{
+    uint8_t bin_buf[BIN_BUF_SIZE];
+    hexfile_parse_status_t status = HEX_PARSE_OK;
+    uint32_t bin_addr, bin_cnt, parsed, pos, left;
+    const uint8_t *data;
+    reset_hex_parser();
+
+    for (pos = 0; pos < size; pos += chunk) {
+        data = hex + pos;
+        left = (size - pos < chunk) ? size - pos : chunk;
+
+        while (1) {
+            status = parse_hex_blob(data, left, &parsed, bin_buf, buf_size, &bin_addr, &bin_cnt);
+
+            if ((HEX_PARSE_OK == status) || (HEX_PARSE_EOF == status)) {
+                output_write(out, bin_addr, bin_buf, bin_cnt, buf_size);
+                break;
+            } else if (HEX_PARSE_UNALIGNED == status) {
+                output_write(out, bin_addr, bin_buf, bin_cnt, buf_size);
+                data += parsed;
+                left -= parsed;
+            } else {
+                return status;
+            }
+        }
+
+        if (HEX_PARSE_EOF == status) {
+            return status;
+        }
+    }
+
+    // A file without an end record still has its last block programmed
+    flush_hex_parser(&bin_addr, &bin_cnt);
+    output_write(out, bin_addr, bin_buf, bin_cnt, buf_size);
+    return status;
+}
+
+static uint8_t *make_hex(uint32_t addr, const uint8_t *data, uint32_t size, uint32_t line_size, uint32_t *hex_size)
+{
+    return image_encode(IMAGE_HEX, addr, data, size, line_size, hex_size);
+}
+
+// Remove the end of file record so more records can be appended
+static uint32_t strip_eof(uint8_t *hex, uint32_t size)
+{
+    static const char eof[] = ":00000001FF\r\n";
+
+    if ((size >= sizeof(eof) - 1) && (0 == memcmp(hex + size - (sizeof(eof) - 1), eof, sizeof(eof) - 1))) {
+        size -= sizeof(eof) - 1;
+    }
+
+    return size;
+}
+
+static void test_round_trip(void)
+{
+    static const uint32_t line_sizes[] = {1, 16, 32, 250};
+    static const uint32_t chunks[] = {1, 2, 3, 7, 64, 512, 4096};
+    const uint32_t size = 200000;
+    const uint32_t addr = 0x0800FF00;       // Crosses 64KB boundaries
+    uint8_t *image = malloc(size);
+    uint8_t *decoded = malloc(size);
+    uint8_t *hex;
+    uint32_t hex_size, i, j;
+    output_t out;
+    hexfile_parse_status_t status;
+    image_make_firmware(image, size, 1);
+
+    for (i = 0; i < sizeof(line_sizes) / sizeof(line_sizes[0]); i++) {
+        hex = make_hex(addr, image, size, line_sizes[i], &hex_size);
+
+        for (j = 0; j < sizeof(chunks) / sizeof(chunks[0]); j++) {
+            memset(decoded, 0xFF, size);
+            memset(&out, 0, sizeof(out));
+            out.base = addr;
+            out.image = decoded;
+            out.image_size = size;
+            status = decode(hex, hex_size, chunks[j], BIN_BUF_SIZE, &out);
+            CHECK(HEX_PARSE_EOF == status, "line %u chunk %u: status %i", line_sizes[i], chunks[j], status);
+            CHECK(!out.out_of_range, "line %u chunk %u: data outside the image", line_sizes[i], chunks[j]);
+            CHECK(0 == memcmp(image, decoded, size), "line %u chunk %u: data mismatch", line_sizes[i], chunks[j]);
+        }
+
+        free(hex);
+    }
+
+    free(decoded);
+    free(image);
+}
+
+// Contiguous records must be collected into full output buffers
+static void test_coalesce(void)
+{
+    const uint32_t size = 64 * 1024;
+    uint8_t *image = malloc(size);
+    uint8_t *hex;
+    uint32_t hex_size;
+    output_t out;
+    image_make_firmware(image, size, 2);
+    hex = make_hex(0, image, size, 16, &hex_size);
+    memset(&out, 0, sizeof(out));
+    decode(hex, hex_size, 512, BIN_BUF_SIZE, &out);
+    CHECK(size / BIN_BUF_SIZE == out.writes, "%u writes for %u bytes", out.writes, size);
+    CHECK(out.writes == out.full_writes, "%u of %u writes were partial", out.writes - out.full_writes, out.writes);
+    free(hex);
+    free(image);
+}
+
+// Records which do not continue the buffered data start a new block
+static void test_gap(void)
+{
+    uint8_t image[0x3000];
+    uint8_t decoded[0x3000];
+    uint8_t *first, *second, *hex;
+    uint32_t first_size, second_size;
+    output_t out;
+    hexfile_parse_status_t status;
+    image_make_firmware(image, sizeof(image), 3);
+    memset(&image[0x1000], 0xFF, 0x1000);
+    first = make_hex(0x20000, image, 0x1000, 32, &first_size);
+    second = make_hex(0x22000, &image[0x2000], 0x1000, 32, &second_size);
+    first_size = strip_eof(first, first_size);
+    hex = malloc(first_size + second_size);
+    memcpy(hex, first, first_size);
+    memcpy(hex + first_size, second, second_size);
+    memset(decoded, 0xFF, sizeof(decoded));
+    memset(&out, 0, sizeof(out));
+    out.base = 0x20000;
+    out.image = decoded;
+    out.image_size = sizeof(decoded);
+    status = decode(hex, first_size + second_size, 100, BIN_BUF_SIZE, &out);
+    CHECK(HEX_PARSE_EOF == status, "status %i", status);
+    CHECK(0 == memcmp(image, decoded, sizeof(image)), "data mismatch around a gap");
+    CHECK(2 * 0x1000 / BIN_BUF_SIZE == out.writes, "%u writes for two regions", out.writes);
+    free(hex);
+    free(second);
+    free(first);
+}
+
+static void test_errors(void)
+{
+    uint8_t image[64];
+    uint8_t *hex;
+    uint32_t hex_size;
+    output_t out;
+    hexfile_parse_status_t status;
+    image_make_firmware(image, sizeof(image), 4);
+
+    // Checksum of the first data record, after the extended address record
+    hex = make_hex(0, image, sizeof(image), 16, &hex_size);
+    hex[17 + 9 + 32] = (hex[17 + 9 + 32] == '0') ? '1' : '0';
+    memset(&out, 0, sizeof(out));
+    status = decode(hex, hex_size, 512, BIN_BUF_SIZE, &out);
+    CHECK(HEX_PARSE_CKSUM_FAIL == status, "bad checksum gave status %i", status);
+    free(hex);
+
+    // Character which is not a hex digit in the data
+    hex = make_hex(0, image, sizeof(image), 16, &hex_size);
+    hex[17 + 9 + 4] = 'G';
+    memset(&out, 0, sizeof(out));
+    status = decode(hex, hex_size, 512, BIN_BUF_SIZE, &out);
+    CHECK(HEX_PARSE_FAILURE == status, "bad digit gave status %i", status);
+    free(hex);
+
+    // Record longer than the output buffer
+    hex = make_hex(0, image, sizeof(image), 32, &hex_size);
+    memset(&out, 0, sizeof(out));
+    status = decode(hex, hex_size, 512, 16, &out);
+    CHECK(HEX_PARSE_LINE_OVERRUN == status, "long record gave status %i", status);
+    free(hex);
+}
+
+static void test_records(void)
+{
+    // Extended segment address 0x1000 puts the data at 0x10000.  Lower
+    // case digits, start address records and a missing end record.
+    static const char hex[] =
+        ":020000021000EC\n"
+        ":0400000501020304ED\n"
+        ":04000000deadbeefc4\n"
+        ":0400040001020304EE\n";
+    static const uint8_t expect[] = {0xDE, 0xAD, 0xBE, 0xEF, 0x01, 0x02, 0x03, 0x04};
+    uint8_t decoded[sizeof(expect)];
+    output_t out;
+    hexfile_parse_status_t status;
+    memset(decoded, 0xFF, sizeof(decoded));
+    memset(&out, 0, sizeof(out));
+    out.base = 0x10000;
+    out.image = decoded;
+    out.image_size = sizeof(decoded);
+    status = decode((const uint8_t *)hex, sizeof(hex) - 1, 5, BIN_BUF_SIZE, &out);
+    CHECK(HEX_PARSE_OK == status, "status %i", status);
+    CHECK(!out.out_of_range, "data outside the image");
+    CHECK(0 == memcmp(expect, decoded, sizeof(expect)), "data mismatch");
+    CHECK(1 == out.writes, "%u writes", out.writes);
+}
+
+static void bench(uint32_t line_size, uint32_t chunk)
+{
+    uint8_t *image = malloc(BENCH_IMAGE_SIZE);
+    uint8_t *hex;
+    uint32_t hex_size, runs = 0;
+    uint64_t start, elapsed;
+    output_t out;
+    image_make_firmware(image, BENCH_IMAGE_SIZE, 5);
+    hex = make_hex(0, image, BENCH_IMAGE_SIZE, line_size, &hex_size);
+    start = time_us();
+
+    do {
+        memset(&out, 0, sizeof(out));
+        decode(hex, hex_size, chunk, BIN_BUF_SIZE, &out);
+        runs++;
+        elapsed = time_us() - start;
+    } while (elapsed < BENCH_MIN_US);
+
+    printf("hex %3u byte records, %4u byte chunks: %7.2f MB/s of hex, %7.2f MB/s decoded, %u writes\n",
+           line_size, chunk, (double)hex_size * runs / elapsed, (double)BENCH_IMAGE_SIZE * runs / elapsed,
+           out.writes);
+    free(hex);
+    free(image);
+}
+
+int main(int argc, char *argv[])
+{
+    test_round_trip();
+    test_coalesce();
+    test_gap();
+    test_errors();
+    test_records();
+    printf("hex parser tests: %s\n", failures ? "FAILED" : "passed");
+
+    if ((argc > 1) && (0 == strcmp(argv[1], "--bench"))) {
+        bench(16, 512);
+        bench(32, 512);
+        bench(32, 64 * 512);
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file    host_perf.c
+ * @brief   perf_counter.h on the host monotonic clock
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "string.h"
+#include "time.h"
+
+#include "perf_counter.h"
+#include "macro.h"
+
+// perf_get_cycles counts microseconds
+#define HOST_PERF_CLOCK     1000000
+
+uint32_t perf_events[PERF_EVENT_COUNT];
+static perf_stat_t perf_stats[PERF_TIMER_COUNT];
+
+void perf_init(void)
+{
+    perf_reset();
+}
+
+void perf_reset(void)
+{
+    uint32_t i;
+    memset(perf_events, 0, sizeof(perf_events));
+    memset(perf_stats, 0, sizeof(perf_stats));
+
+    for (i = 0; i < PERF_TIMER_COUNT; i++) {
+        perf_stats[i].min = 0xFFFFFFFF;
+    }
+}
+
+uint32_t perf_get_cycles(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * HOST_PERF_CLOCK + ts.tv_nsec / (1000000000 / HOST_PERF_CLOCK));
+}
+
+uint32_t perf_get_clock(void)
+{
+    return HOST_PERF_CLOCK;
+}
+
+void perf_timer_record(perf_timer_t timer, uint32_t start)
+{
+    uint32_t cycles = perf_get_cycles() - start;
+    perf_stat_t *stat = &perf_stats[timer];
+    stat->count++;
+    stat->total += cycles;
+    stat->min = MIN(stat->min, cycles);
+    stat->max = MAX(stat->max, cycles);
+}
+
+const perf_stat_t *perf_get_stat(perf_timer_t timer)
+{
+    return &perf_stats[timer];
+}
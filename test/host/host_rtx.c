@@ -0,0 +1,277 @@
+/**
+ * @file    host_rtx.c
+ * @brief   RTX tasks, mutexes, semaphores, mailboxes and pools on pthreads
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stddef.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+#include "errno.h"
+#include "unistd.h"
+
+#include "RTL.h"
+
+// Same tick as the firmware, see OS_TICK in RTX_Config.c
+U32 const os_clockrate = 10000;
+U32 os_time;
+
+static __thread OS_TID self_tid;
+static OS_TID next_tid = 1;
+static pthread_mutex_t tid_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    void (*task)(void);
+    OS_TID tid;
+} task_start_t;
+
+// Absolute time timeout ticks from now
+static void deadline(struct timespec *ts, U16 timeout)
+{
+    uint64_t ns;
+    clock_gettime(CLOCK_REALTIME, ts);
+    ns = (uint64_t)ts->tv_nsec + (uint64_t)timeout * os_clockrate * 1000;
+    ts->tv_sec += ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
+// Wait on cond until pred is true.  Returns false on a timeout.
+#define WAIT_UNTIL(cond, mutex, timeout, pred)                              \
+    ({                                                                      \
+        struct timespec ts_;                                                \
+        int rc_ = 0;                                                        \
+        if ((timeout) != OS_WAIT_FOREVER) {                                 \
+            deadline(&ts_, (timeout));                                      \
+        }                                                                   \
+        while (!(pred) && (rc_ != ETIMEDOUT)) {                             \
+            if (0 == (timeout)) {                                           \
+                rc_ = ETIMEDOUT;                                            \
+            } else if ((timeout) == OS_WAIT_FOREVER) {                      \
+                pthread_cond_wait((cond), (mutex));                         \
+            } else {                                                        \
+                rc_ = pthread_cond_timedwait((cond), (mutex), &ts_);        \
+            }                                                               \
+        }                                                                   \
+        (pred);                                                             \
+    })
+
+static void *task_entry(void *arg)
+{
+    task_start_t start = *(task_start_t *)arg;
+    free(arg);
+    self_tid = start.tid;
+    start.task();
+    return 0;
+}
+
+void host_rtx_init(void)
+{
+    pthread_mutex_lock(&tid_mutex);
+    self_tid = next_tid++;
+    pthread_mutex_unlock(&tid_mutex);
+}
+
+OS_TID os_tsk_create_user(void (*task)(void), U32 prio, void *stk, U16 size)
+{
+    pthread_t thread;
+    task_start_t *start = malloc(sizeof(*start));
+
+    if (0 == start) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&tid_mutex);
+    start->tid = next_tid++;
+    pthread_mutex_unlock(&tid_mutex);
+    start->task = task;
+
+    if (pthread_create(&thread, 0, task_entry, start) != 0) {
+        free(start);
+        return 0;
+    }
+
+    pthread_detach(thread);
+    return start->tid;
+}
+
+OS_TID os_tsk_self(void)
+{
+    return self_tid;
+}
+
+void os_dly_wait(U16 delay_time)
+{
+    usleep((useconds_t)delay_time * os_clockrate);
+}
+
+void os_mut_init(OS_MUT *mutex)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    // RTX mutexes can be taken again by their owner
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mutex->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+OS_RESULT os_mut_wait(OS_MUT *mutex, U16 timeout)
+{
+    struct timespec ts;
+
+    if (OS_WAIT_FOREVER == timeout) {
+        pthread_mutex_lock(&mutex->mutex);
+        return OS_R_OK;
+    }
+
+    if (0 == pthread_mutex_trylock(&mutex->mutex)) {
+        return OS_R_OK;
+    }
+
+    if (0 == timeout) {
+        return OS_R_TMO;
+    }
+
+    deadline(&ts, timeout);
+    return (0 == pthread_mutex_timedlock(&mutex->mutex, &ts)) ? OS_R_MUT : OS_R_TMO;
+}
+
+OS_RESULT os_mut_release(OS_MUT *mutex)
+{
+    return (0 == pthread_mutex_unlock(&mutex->mutex)) ? OS_R_OK : OS_R_NOK;
+}
+
+void os_sem_init(OS_SEM *semaphore, U16 token_count)
+{
+    pthread_mutex_init(&semaphore->mutex, 0);
+    pthread_cond_init(&semaphore->cond, 0);
+    semaphore->count = token_count;
+}
+
+OS_RESULT os_sem_wait(OS_SEM *semaphore, U16 timeout)
+{
+    OS_RESULT result = OS_R_TMO;
+    pthread_mutex_lock(&semaphore->mutex);
+
+    if (WAIT_UNTIL(&semaphore->cond, &semaphore->mutex, timeout, semaphore->count > 0)) {
+        semaphore->count--;
+        result = OS_R_OK;
+    }
+
+    pthread_mutex_unlock(&semaphore->mutex);
+    return result;
+}
+
+OS_RESULT os_sem_send(OS_SEM *semaphore)
+{
+    pthread_mutex_lock(&semaphore->mutex);
+    semaphore->count++;
+    pthread_cond_signal(&semaphore->cond);
+    pthread_mutex_unlock(&semaphore->mutex);
+    return OS_R_OK;
+}
+
+void host_mbx_init(void *mailbox, U16 mbx_size)
+{
+    host_mbx_t *mbx = (host_mbx_t *)mailbox;
+    pthread_mutex_init(&mbx->mutex, 0);
+    pthread_cond_init(&mbx->cond, 0);
+    mbx->size = (mbx_size - offsetof(host_mbx_t, msg)) / sizeof(void *);
+    mbx->first = 0;
+    mbx->count = 0;
+}
+
+OS_RESULT host_mbx_send(void *mailbox, void *message_ptr, U16 timeout)
+{
+    host_mbx_t *mbx = (host_mbx_t *)mailbox;
+    OS_RESULT result = OS_R_TMO;
+    pthread_mutex_lock(&mbx->mutex);
+
+    if (WAIT_UNTIL(&mbx->cond, &mbx->mutex, timeout, mbx->count < mbx->size)) {
+        mbx->msg[(mbx->first + mbx->count) % mbx->size] = message_ptr;
+        mbx->count++;
+        pthread_cond_broadcast(&mbx->cond);
+        result = OS_R_OK;
+    }
+
+    pthread_mutex_unlock(&mbx->mutex);
+    return result;
+}
+
+OS_RESULT host_mbx_wait(void *mailbox, void **message, U16 timeout)
+{
+    host_mbx_t *mbx = (host_mbx_t *)mailbox;
+    OS_RESULT result = OS_R_TMO;
+    pthread_mutex_lock(&mbx->mutex);
+
+    if (WAIT_UNTIL(&mbx->cond, &mbx->mutex, timeout, mbx->count > 0)) {
+        *message = mbx->msg[mbx->first];
+        mbx->first = (mbx->first + 1) % mbx->size;
+        mbx->count--;
+        pthread_cond_broadcast(&mbx->cond);
+        result = OS_R_OK;
+    }
+
+    pthread_mutex_unlock(&mbx->mutex);
+    return result;
+}
+
+int _init_box(void *box_mem, U32 box_size, U32 blk_size)
+{
+    host_box_t *box = (host_box_t *)box_mem;
+    uint8_t *blk = (uint8_t *)(((uintptr_t)(box + 1) + 7) & ~(uintptr_t)7);
+    uint8_t *end = (uint8_t *)box_mem + box_size;
+    void **link = &box->free;
+
+    blk_size = (blk_size + 7) & ~7;
+    pthread_mutex_init(&box->mutex, 0);
+
+    // Chain the free blocks through their first word
+    for (; blk + blk_size <= end; blk += blk_size) {
+        *link = blk;
+        link = (void **)blk;
+    }
+
+    *link = 0;
+    return 0;
+}
+
+void *_alloc_box(void *box_mem)
+{
+    host_box_t *box = (host_box_t *)box_mem;
+    void *blk;
+    pthread_mutex_lock(&box->mutex);
+    blk = box->free;
+
+    if (blk != 0) {
+        box->free = *(void **)blk;
+    }
+
+    pthread_mutex_unlock(&box->mutex);
+    return blk;
+}
+
+int _free_box(void *box_mem, void *block)
+{
+    host_box_t *box = (host_box_t *)box_mem;
+    pthread_mutex_lock(&box->mutex);
+    *(void **)block = box->free;
+    box->free = block;
+    pthread_mutex_unlock(&box->mutex);
+    return 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file    host_target.c
+ * @brief   Implementation of host_target.h
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "RTL.h"
+#include "rl_usb.h"
+#include "host_target.h"
+#include "daplink.h"
+#include "main.h"
+#include "settings.h"
+#include "util.h"
+#include "vfs_manager.h"
+#include "target_config.h"
+#include "target_ids.h"
+#include "target_flash.h"
+
+// Globals normally owned by the USB MSC class driver
+BOOL USBD_MSC_MediaReady = __FALSE;
+BOOL USBD_MSC_MediaChanged = __FALSE;
+U32 USBD_MSC_MemorySize;
+U32 USBD_MSC_BlockSize;
+U32 USBD_MSC_BlockGroup;
+U32 USBD_MSC_BlockCount;
+U8 *USBD_MSC_BlockBuf;
+
+volatile uint32_t host_disconnect_count;
+
+static OS_MUT flash_mutex;
+
+static uint32_t get_sector_number(uint32_t addr)
+{
+    return (addr - HOST_TARGET_FLASH_START) / HOST_TARGET_SECTOR_SIZE;
+}
+
+static uint32_t get_sector_address(uint32_t sector)
+{
+    return HOST_TARGET_FLASH_START + sector * HOST_TARGET_SECTOR_SIZE;
+}
+
+static uint32_t get_sector_length(uint32_t sector)
+{
+    return HOST_TARGET_SECTOR_SIZE;
+}
+
+// Only the first target is simulated, the rest are never detected
+const target_cfg_t target_device[] = {
+    {
+        .sector_size        = HOST_TARGET_SECTOR_SIZE,
+        .sector_cnt         = HOST_TARGET_FLASH_SIZE / HOST_TARGET_SECTOR_SIZE,
+        .flash_start        = HOST_TARGET_FLASH_START,
+        .flash_end          = HOST_TARGET_FLASH_START + HOST_TARGET_FLASH_SIZE,
+        .ram_start          = HOST_TARGET_RAM_START,
+        .ram_end            = HOST_TARGET_RAM_END,
+        .flash_algo         = 0,
+        .erase_reset        = 0,
+        .get_sector_number  = get_sector_number,
+        .get_sector_address = get_sector_address,
+        .get_sector_length  = get_sector_length,
+        .uf2_family_id      = 0x1B57745F,
+    },
+};
+
+uint8_t targetID = Target_UNKNOWN;
+
+void host_target_init(void)
+{
+    host_rtx_init();
+    target_flash_lock_init();
+}
+
+uint8_t swd_init_get_target(void)
+{
+    return Target_NRF51822;
+}
+
+void target_flash_lock_init(void)
+{
+    os_mut_init(&flash_mutex);
+}
+
+bool target_flash_lock(uint16_t timeout)
+{
+    return os_mut_wait(&flash_mutex, timeout) != OS_R_TMO;
+}
+
+void target_flash_unlock(void)
+{
+    os_mut_release(&flash_mutex);
+}
+
+void target_flash_session_periodic(uint32_t elapsed_ms)
+{
+    // No session is kept open by the simulated flash
+}
+
+void target_flash_session_release(void)
+{
+    targetID = Target_UNKNOWN;
+}
+
+bool daplink_is_bootloader(void)
+{
+    return false;
+}
+
+bool daplink_is_interface(void)
+{
+    return true;
+}
+
+bool config_get_automation_allowed(void)
+{
+    return false;
+}
+
+bool config_get_full_remount(void)
+{
+    return false;
+}
+
+void main_blink_hid_led(main_led_state_t permanent)
+{
+    // No LEDs
+}
+
+void _util_assert(bool expression, const char *filename, uint16_t line)
+{
+    if (!expression) {
+        fprintf(stderr, "Assert failed: %s:%u\n", filename, line);
+        abort();
+    }
+}
+
+static const char details_txt[] = "Host build of the DAPLink drag-n-drop code\r\n";
+
+static uint32_t read_file_details_txt(uint32_t sector_offset, uint8_t *data, uint32_t num_sectors)
+{
+    if (sector_offset != 0) {
+        return 0;
+    }
+
+    memcpy(data, details_txt, sizeof(details_txt) - 1);
+    return sizeof(details_txt) - 1;
+}
+
+void vfs_user_build_filesystem(void)
+{
+    vfs_init("DAPLINK    ", HOST_DISC_SIZE);
+    vfs_create_file("DETAILS TXT", read_file_details_txt, 0, sizeof(details_txt) - 1);
+}
+
+void vfs_user_file_change_handler(const vfs_filename_t filename, vfs_file_change_t change, vfs_file_t file, vfs_file_t new_file_data)
+{
+    // None of the command files are supported
+}
+
+void vfs_user_disconnecting(void)
+{
+    host_disconnect_count++;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file    host_target.h
+ * @brief   Simulated target and interface glue for host builds
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_TARGET_H
+#define HOST_TARGET_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Memory of the target reported by swd_init_get_target
+#define HOST_TARGET_FLASH_START     0x00000000
+#define HOST_TARGET_FLASH_SIZE      0x00040000
+#define HOST_TARGET_SECTOR_SIZE     0x00000400
+#define HOST_TARGET_RAM_START       0x20000000
+#define HOST_TARGET_RAM_END         0x20004000
+
+// Size of the drive built by vfs_user_build_filesystem, same as the firmware
+#define HOST_DISC_SIZE              (64 * 1024 * 1024)
+
+// Number of times the drive has been disconnected by the vfs manager
+extern volatile uint32_t host_disconnect_count;
+
+// Set up the RTX emulation and the target flash lock.  Must be called
+// from the thread which then drives the vfs manager.
+void host_target_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
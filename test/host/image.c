@@ -0,0 +1,379 @@
+/**
+ * @file    image.c
+ * @brief   Implementation of image.h
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "image.h"
+#include "host_target.h"
+
+#define UF2_BLOCK_SIZE          512
+#define UF2_MAGIC_START0        0x0A324655
+#define UF2_MAGIC_START1        0x9E5D5157
+#define UF2_MAGIC_END           0x0AB16F30
+#define UF2_FLAG_FAMILY_ID      0x00002000
+#define UF2_FAMILY_ID           0x1B57745F
+// Every UF2_RESEND_PERIOD blocks two earlier blocks are sent again
+#define UF2_RESEND_PERIOD       8
+
+#define ELF_HEADER_SIZE         52
+#define ELF_PH_SIZE             32
+#define ELF_PH_COUNT            3
+#define ELF_PT_LOAD             1
+#define ELF_PT_NOTE             4
+// Segment data starts after the headers and is separated by filler
+// bytes which must never reach flash
+#define ELF_DATA_OFFSET         0x100
+#define ELF_GAP_SIZE            0x20
+#define ELF_FILLER              0xA5
+
+const char *const image_format_name[IMAGE_FORMAT_COUNT] = {
+    "bin",
+    "hex",
+    "srec",
+    "uf2",
+    "uf2_resend",
+    "elf",
+};
+
+const char *const image_format_ext[IMAGE_FORMAT_COUNT] = {
+    "BIN",
+    "HEX",
+    "SRE",
+    "UF2",
+    "UF2",
+    "ELF",
+};
+
+typedef struct {
+    uint8_t *data;
+    uint32_t size;
+    uint32_t capacity;
+} buffer_t;
+
+static void buffer_reserve(buffer_t *buf, uint32_t size)
+{
+    if (buf->size + size > buf->capacity) {
+        buf->capacity = (buf->size + size) * 2;
+        buf->data = realloc(buf->data, buf->capacity);
+
+        if (0 == buf->data) {
+            abort();
+        }
+    }
+}
+
+static void buffer_append(buffer_t *buf, const void *data, uint32_t size)
+{
+    buffer_reserve(buf, size);
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+}
+
+// Append a record of count bytes in hex digits, the checksum and a line end
+static void append_record(buffer_t *buf, const char *prefix, const uint8_t *bytes, uint32_t count,
+                          uint8_t checksum)
+{
+    char text[8];
+    uint32_t i;
+    buffer_append(buf, prefix, strlen(prefix));
+
+    for (i = 0; i < count; i++) {
+        snprintf(text, sizeof(text), "%02X", bytes[i]);
+        buffer_append(buf, text, 2);
+    }
+
+    snprintf(text, sizeof(text), "%02X\r\n", checksum);
+    buffer_append(buf, text, 4);
+}
+
+static void append_hex_record(buffer_t *buf, uint8_t type, uint16_t offset, const uint8_t *data, uint8_t size)
+{
+    uint8_t bytes[4 + 255];
+    uint8_t sum = 0;
+    uint32_t i;
+    bytes[0] = size;
+    bytes[1] = offset >> 8;
+    bytes[2] = offset & 0xFF;
+    bytes[3] = type;
+    memcpy(&bytes[4], data, size);
+
+    for (i = 0; i < 4 + size; i++) {
+        sum += bytes[i];
+    }
+
+    append_record(buf, ":", bytes, 4 + size, (uint8_t)(0x100 - sum));
+}
+
+static void encode_hex(buffer_t *buf, uint32_t addr, const uint8_t *data, uint32_t size, uint32_t line_size)
+{
+    uint32_t upper = 0xFFFFFFFF;
+    uint32_t count;
+    uint8_t ext[2];
+
+    while (size > 0) {
+        if ((addr >> 16) != upper) {
+            upper = addr >> 16;
+            ext[0] = upper >> 8;
+            ext[1] = upper & 0xFF;
+            append_hex_record(buf, 0x04, 0, ext, 2);
+        }
+
+        // Records do not cross a 64KB boundary
+        count = line_size;
+        count = count < size ? count : size;
+        count = count < 0x10000 - (addr & 0xFFFF) ? count : 0x10000 - (addr & 0xFFFF);
+        append_hex_record(buf, 0x00, addr & 0xFFFF, data, count);
+        addr += count;
+        data += count;
+        size -= count;
+    }
+
+    append_hex_record(buf, 0x01, 0, 0, 0);
+}
+
+// S-records with a 4 byte address
+static void append_srec_record(buffer_t *buf, char type, uint32_t addr, const uint8_t *data, uint8_t size)
+{
+    uint8_t bytes[5 + 255];
+    uint8_t sum = 0;
+    char prefix[3] = {'S', type, 0};
+    uint32_t i;
+    bytes[0] = size + 5;
+    bytes[1] = addr >> 24;
+    bytes[2] = (addr >> 16) & 0xFF;
+    bytes[3] = (addr >> 8) & 0xFF;
+    bytes[4] = addr & 0xFF;
+    memcpy(&bytes[5], data, size);
+
+    for (i = 0; i < 5 + size; i++) {
+        sum += bytes[i];
+    }
+
+    append_record(buf, prefix, bytes, 5 + size, (uint8_t)~sum);
+}
+
+static void encode_srec(buffer_t *buf, uint32_t addr, const uint8_t *data, uint32_t size, uint32_t line_size)
+{
+    static const char header[] = "S00A00004441504C494E4BF2\r\n";
+    uint32_t count;
+    buffer_append(buf, header, sizeof(header) - 1);
+
+    while (size > 0) {
+        count = line_size < size ? line_size : size;
+        append_srec_record(buf, '3', addr, data, count);
+        addr += count;
+        data += count;
+        size -= count;
+    }
+
+    append_srec_record(buf, '7', 0, 0, 0);
+}
+
+static void put_word(uint8_t *dest, uint32_t value)
+{
+    dest[0] = value & 0xFF;
+    dest[1] = (value >> 8) & 0xFF;
+    dest[2] = (value >> 16) & 0xFF;
+    dest[3] = value >> 24;
+}
+
+static void append_uf2_block(buffer_t *buf, uint32_t addr, const uint8_t *data, uint32_t size,
+                             uint32_t block_no, uint32_t num_blocks)
+{
+    uint8_t block[UF2_BLOCK_SIZE];
+    memset(block, 0, sizeof(block));
+    put_word(&block[0], UF2_MAGIC_START0);
+    put_word(&block[4], UF2_MAGIC_START1);
+    put_word(&block[8], UF2_FLAG_FAMILY_ID);
+    put_word(&block[12], addr);
+    put_word(&block[16], size);
+    put_word(&block[20], block_no);
+    put_word(&block[24], num_blocks);
+    put_word(&block[28], UF2_FAMILY_ID);
+    memcpy(&block[32], data, size);
+    put_word(&block[UF2_BLOCK_SIZE - 4], UF2_MAGIC_END);
+    buffer_append(buf, block, sizeof(block));
+}
+
+// Blocks are sent in order.  With resend set the block before and a block
+// further back are sent again after every UF2_RESEND_PERIOD blocks, the
+// way a host retrying writes can, but never after the last block.
+static void encode_uf2(buffer_t *buf, uint32_t addr, const uint8_t *data, uint32_t size, uint32_t payload_size,
+                       bool resend)
+{
+    uint32_t num_blocks = (size + payload_size - 1) / payload_size;
+    uint32_t block_no;
+    uint32_t count;
+    uint32_t i;
+    uint32_t resend_no[2];
+
+    for (block_no = 0; block_no < num_blocks; block_no++) {
+        count = payload_size * (block_no + 1) < size ? payload_size : size - payload_size * block_no;
+        append_uf2_block(buf, addr + payload_size * block_no, data + payload_size * block_no, count,
+                         block_no, num_blocks);
+
+        if (!resend || (block_no % UF2_RESEND_PERIOD != UF2_RESEND_PERIOD - 1) ||
+                (block_no + 1 >= num_blocks)) {
+            continue;
+        }
+
+        resend_no[0] = block_no - 1;
+        resend_no[1] = block_no - (UF2_RESEND_PERIOD - 2);
+
+        for (i = 0; i < 2; i++) {
+            append_uf2_block(buf, addr + payload_size * resend_no[i], data + payload_size * resend_no[i],
+                             payload_size, resend_no[i], num_blocks);
+        }
+    }
+}
+
+static void put_half(uint8_t *dest, uint16_t value)
+{
+    dest[0] = value & 0xFF;
+    dest[1] = value >> 8;
+}
+
+static void put_program_header(uint8_t *dest, uint32_t type, uint32_t offset, uint32_t addr,
+                               uint32_t file_size, uint32_t mem_size)
+{
+    put_word(&dest[0], type);
+    put_word(&dest[4], offset);
+    put_word(&dest[8], addr);
+    put_word(&dest[12], addr);
+    put_word(&dest[16], file_size);
+    put_word(&dest[20], mem_size);
+    put_word(&dest[24], 5);
+    put_word(&dest[28], 4);
+}
+
+// An ELF32 file with the data split into two loadable segments.  A note
+// header covers the filler between them, and the second segment has zero
+// filled memory after its file contents.
+static void encode_elf(buffer_t *buf, uint32_t addr, const uint8_t *data, uint32_t size)
+{
+    uint8_t header[ELF_DATA_OFFSET];
+    uint8_t gap[ELF_GAP_SIZE];
+    uint8_t *ph = &header[ELF_HEADER_SIZE];
+    uint32_t first_size = (size / 2) & ~3;
+    uint32_t second_offset = ELF_DATA_OFFSET + first_size + ELF_GAP_SIZE;
+    memset(header, ELF_FILLER, sizeof(header));
+    memset(gap, ELF_FILLER, sizeof(gap));
+    memset(header, 0, ELF_HEADER_SIZE);
+    header[0] = 0x7F;
+    header[1] = 'E';
+    header[2] = 'L';
+    header[3] = 'F';
+    header[4] = 1;          // 32 bit
+    header[5] = 1;          // Little endian
+    header[6] = 1;          // Version
+    put_half(&header[16], 2);                   // Executable
+    put_half(&header[18], 40);                  // ARM
+    put_word(&header[20], 1);
+    put_word(&header[24], addr + 0x101);        // Entry
+    put_word(&header[28], ELF_HEADER_SIZE);     // Program header table
+    put_half(&header[40], ELF_HEADER_SIZE);
+    put_half(&header[42], ELF_PH_SIZE);
+    put_half(&header[44], ELF_PH_COUNT);
+    put_half(&header[46], 40);
+    put_program_header(&ph[0], ELF_PT_LOAD, ELF_DATA_OFFSET, addr, first_size, first_size);
+    put_program_header(&ph[ELF_PH_SIZE], ELF_PT_NOTE, ELF_DATA_OFFSET + first_size, 0,
+                       ELF_GAP_SIZE, 0);
+    put_program_header(&ph[ELF_PH_SIZE * 2], ELF_PT_LOAD, second_offset, addr + first_size,
+                       size - first_size, size - first_size + 0x100);
+    buffer_append(buf, header, sizeof(header));
+    buffer_append(buf, data, first_size);
+    buffer_append(buf, gap, sizeof(gap));
+    buffer_append(buf, data + first_size, size - first_size);
+    buffer_append(buf, gap, sizeof(gap));
+}
+
+image_format_t image_format_from_name(const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < IMAGE_FORMAT_COUNT; i++) {
+        if (0 == strcmp(name, image_format_name[i])) {
+            return (image_format_t)i;
+        }
+    }
+
+    return IMAGE_FORMAT_COUNT;
+}
+
+void image_make_firmware(uint8_t *data, uint32_t size, uint32_t seed)
+{
+    uint32_t state = seed * 2654435761u + 1;
+    uint32_t i;
+
+    for (i = 0; i < size; i++) {
+        state = state * 1103515245 + 12345;
+        data[i] = state >> 16;
+    }
+
+    // Initial SP in RAM, reset, NMI and hard fault handlers in flash
+    if (size >= 16) {
+        put_word(&data[0], HOST_TARGET_RAM_END);
+
+        for (i = 4; i <= 12; i += 4) {
+            put_word(&data[i], HOST_TARGET_FLASH_START + 0x101 + i);
+        }
+    }
+}
+
+uint8_t *image_encode(image_format_t format, uint32_t addr, const uint8_t *data, uint32_t size,
+                      uint32_t line_size, uint32_t *encoded_size)
+{
+    buffer_t buf = {0, 0, 0};
+
+    switch (format) {
+        case IMAGE_BIN:
+            buffer_append(&buf, data, size);
+            break;
+
+        case IMAGE_HEX:
+            encode_hex(&buf, addr, data, size, line_size);
+            break;
+
+        case IMAGE_SREC:
+            encode_srec(&buf, addr, data, size, line_size);
+            break;
+
+        case IMAGE_UF2:
+            encode_uf2(&buf, addr, data, size, line_size, false);
+            break;
+
+        case IMAGE_UF2_RESEND:
+            encode_uf2(&buf, addr, data, size, line_size, true);
+            break;
+
+        case IMAGE_ELF:
+            encode_elf(&buf, addr, data, size);
+            break;
+
+        default:
+            break;
+    }
+
+    *encoded_size = buf.size;
+    return buf.data;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file    image.h
+ * @brief   Test firmware images and their bin, hex, srec and uf2 encodings
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    IMAGE_BIN,
+    IMAGE_HEX,
+    IMAGE_SREC,
+    IMAGE_UF2,
+    IMAGE_UF2_RESEND,
+    IMAGE_ELF,
+
+    IMAGE_FORMAT_COUNT
+} image_format_t;
+
+// Lower case name of each format, used on the command line
+extern const char *const image_format_name[IMAGE_FORMAT_COUNT];
+
+// 8.3 extension of each format
+extern const char *const image_format_ext[IMAGE_FORMAT_COUNT];
+
+// Return the format called name or IMAGE_FORMAT_COUNT if there is none
+image_format_t image_format_from_name(const char *name);
+
+// Fill data with a vector table valid for the host target followed by
+// pseudo random bytes picked by seed
+void image_make_firmware(uint8_t *data, uint32_t size, uint32_t seed);
+
+// Encode size bytes of data to be programmed at addr.  Text formats put
+// line_size bytes, at most 250, in each record and uf2 uses it as the
+// block payload size.  uf2_resend sends some blocks a second time, out of
+// order, and elf splits the data into two loadable segments with gaps
+// between them.  Returns a buffer to free and sets encoded_size.
+uint8_t *image_encode(image_format_t format, uint32_t addr, const uint8_t *data, uint32_t size,
+                      uint32_t line_size, uint32_t *encoded_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,433 @@
+/**
+ * @file    msd_replay.c
+ * @brief   Replay MSD write traces through the drag-n-drop code on a host
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+#include "unistd.h"
+
+#include "RTL.h"
+#include "rl_usb.h"
+#include "macro.h"
+#include "error.h"
+#include "vfs_manager.h"
+#include "flash_manager.h"
+#include "flash_sim.h"
+#include "host_target.h"
+#include "image.h"
+#include "msd_trace.h"
+
+// Longest time a transfer may take before it is reported as stuck
+#define TRANSFER_TIMEOUT_MS     60000
+
+// Simulated time passed to vfs_mngr_periodic for each millisecond waited
+// once the trace has been sent, so the disconnect delays pass quickly
+#define WAIT_TICK_MS            100
+
+typedef struct {
+    image_format_t format;
+    msd_trace_order_t order;
+    uint32_t size;
+    uint32_t line_size;
+    uint32_t chunk_sectors;
+    bool page_erase;
+    bool use_delays;
+    const char *trace_path;
+    const char *expect_path;
+    const char *save_path;
+} options_t;
+
+static flash_sim_config_t flash_config = {
+    .start              = HOST_TARGET_FLASH_START,
+    .size               = HOST_TARGET_FLASH_SIZE,
+    .sector_size        = HOST_TARGET_SECTOR_SIZE,
+    .page_size          = 256,
+    .erase_sector_us    = 2000,
+    .erase_chip_us      = 20000,
+    .program_page_us    = 100,
+};
+
+static uint64_t time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Volume serial number in the boot sector of the drive
+static uint32_t read_volume_id(void)
+{
+    uint8_t boot[VFS_SECTOR_SIZE];
+
+    if (!usbd_msc_read_sect(0, boot, 1)) {
+        return 0;
+    }
+
+    return boot[39] | (boot[40] << 8) | (boot[41] << 16) | ((uint32_t)boot[42] << 24);
+}
+
+// Run the vfs manager until the drive has been disconnected count times
+static bool wait_for_disconnect(uint32_t count)
+{
+    uint32_t waited_ms;
+
+    for (waited_ms = 0; waited_ms < TRANSFER_TIMEOUT_MS; waited_ms++) {
+        if (host_disconnect_count >= count) {
+            return true;
+        }
+
+        usleep(1000);
+        vfs_mngr_periodic(WAIT_TICK_MS);
+    }
+
+    return false;
+}
+
+// Run the vfs manager until the rebuilt drive is ready again
+static bool wait_for_media(void)
+{
+    uint32_t waited_ms;
+
+    for (waited_ms = 0; waited_ms < TRANSFER_TIMEOUT_MS; waited_ms++) {
+        if (USBD_MSC_MediaReady) {
+            return true;
+        }
+
+        usleep(1000);
+        vfs_mngr_periodic(WAIT_TICK_MS);
+    }
+
+    return false;
+}
+
+// Replay a trace onto an erased flash and check the result against expect.
+// Without expect_programmed the transfer must fail without touching the flash.
+static bool run_transfer(const char *label, const msd_trace_t *trace, const options_t *options,
+                         const uint8_t *expect, uint32_t expect_size, bool expect_programmed)
+{
+    const flash_sim_stats_t *stats;
+    const uint8_t *flash;
+    uint32_t disconnects = host_disconnect_count + 1;
+    uint32_t volume_id = read_volume_id();
+    uint32_t written = msd_trace_get_size(trace);
+    uint32_t end, i;
+    uint64_t start_us;
+    double elapsed;
+    error_t status;
+    const char *failure = 0;
+
+    flash_sim_reset(&flash_config);
+    flash_manager_set_page_erase(options->page_erase);
+    start_us = time_us();
+    msd_trace_replay(trace, options->use_delays);
+
+    if (!wait_for_disconnect(disconnects)) {
+        failure = "transfer did not finish";
+    }
+
+    elapsed = (time_us() - start_us) / 1000000.0;
+    status = vfs_mngr_get_transfer_status();
+    stats = flash_sim_get_stats();
+    flash = flash_sim_data();
+
+    if (0 == failure) {
+        if (ERROR_SUCCESS != status) {
+            failure = error_get_string(status);
+        } else if (stats->reprograms > 0) {
+            failure = "pages were programmed twice without an erase";
+        } else if ((0 != expect) && (expect_size > flash_config.size)) {
+            failure = "image is larger than the flash";
+        } else if ((0 != expect) && (memcmp(flash, expect, expect_size) != 0)) {
+            failure = "flash does not match the image";
+        }
+    }
+
+    // Nothing past the sector holding the end of the image may be written
+    if ((0 == failure) && (0 != expect)) {
+        end = MIN(ROUND_UP(expect_size, VFS_SECTOR_SIZE), flash_config.size);
+
+        for (i = end; i < flash_config.size; i++) {
+            if (flash[i] != 0xFF) {
+                failure = "flash written past the end of the image";
+                break;
+            }
+        }
+    }
+
+    if (!expect_programmed) {
+        if ((ERROR_SUCCESS != status) && (0 == stats->page_programs)) {
+            failure = 0;
+        } else if (0 == failure) {
+            failure = "programmed when it should not have been";
+        }
+    }
+
+    printf("%s: %u bytes in %u commands in %.3fs - %.3f MB/s, %u pages programmed, %u sectors erased - %s\n",
+           label, written, trace->record_count, elapsed, elapsed > 0 ? written / elapsed / 1000000.0 : 0,
+           stats->page_programs, stats->sector_erases,
+           failure ? failure : (expect_programmed ? "OK" : "OK, not programmed"));
+
+    // Let the drive come back for the next transfer
+    if (!wait_for_media()) {
+        printf("%s: drive did not reconnect\n", label);
+        return false;
+    }
+
+    // A host caching the old contents must see a different volume
+    if (read_volume_id() == volume_id) {
+        printf("%s: volume serial number did not change\n", label);
+        return false;
+    }
+
+    return 0 == failure;
+}
+
+// Copy a generated image in the given format and order
+static bool run_copy(const options_t *options, bool expect_programmed)
+{
+    vfs_filename_t name;
+    msd_trace_t trace;
+    uint8_t *image;
+    uint8_t *encoded;
+    uint32_t encoded_size;
+    uint32_t line_size = options->line_size;
+    char label[64];
+    bool success;
+
+    if (0 == line_size) {
+        line_size = ((IMAGE_UF2 == options->format) || (IMAGE_UF2_RESEND == options->format)) ? 256 : 16;
+    }
+
+    image = malloc(options->size);
+
+    if (0 == image) {
+        return false;
+    }
+
+    image_make_firmware(image, options->size, options->format * MSD_TRACE_ORDER_COUNT + options->order);
+    encoded = image_encode(options->format, HOST_TARGET_FLASH_START, image, options->size,
+                           line_size, &encoded_size);
+    memcpy(name, "IMAGE   ", 8);
+    memcpy(&name[8], image_format_ext[options->format], 3);
+    snprintf(label, sizeof(label), "%-10s %-11s %s", image_format_name[options->format],
+             msd_trace_order_name[options->order], options->page_erase ? "page erase" : "chip erase");
+
+    if (!msd_trace_build_copy(&trace, name, encoded, encoded_size, options->order, options->chunk_sectors)) {
+        printf("%s: could not build the trace\n", label);
+        free(encoded);
+        free(image);
+        return false;
+    }
+
+    if ((0 != options->save_path) && !msd_trace_save(&trace, options->save_path)) {
+        printf("Could not save %s\n", options->save_path);
+    }
+
+    success = run_transfer(label, &trace, options, image, options->size, expect_programmed);
+    msd_trace_free(&trace);
+    free(encoded);
+    free(image);
+    return success;
+}
+
+// Replay a recorded trace, comparing the flash with a binary if given
+static bool run_trace(const options_t *options)
+{
+    msd_trace_t trace;
+    uint8_t *expect = 0;
+    uint32_t expect_size = 0;
+    long file_size;
+    FILE *file;
+    bool success;
+
+    if (!msd_trace_load(&trace, options->trace_path)) {
+        printf("Could not load %s\n", options->trace_path);
+        return false;
+    }
+
+    if (0 != options->expect_path) {
+        file = fopen(options->expect_path, "rb");
+
+        if ((0 == file) || (fseek(file, 0, SEEK_END) != 0) || ((file_size = ftell(file)) < 0)) {
+            printf("Could not read %s\n", options->expect_path);
+
+            if (0 != file) {
+                fclose(file);
+            }
+
+            msd_trace_free(&trace);
+            return false;
+        }
+
+        expect_size = file_size;
+        expect = malloc(expect_size ? expect_size : 1);
+        rewind(file);
+
+        if ((0 == expect) || (fread(expect, 1, expect_size, file) != expect_size)) {
+            printf("Could not read %s\n", options->expect_path);
+            fclose(file);
+            free(expect);
+            msd_trace_free(&trace);
+            return false;
+        }
+
+        fclose(file);
+    }
+
+    success = run_transfer(options->trace_path, &trace, options, expect, expect_size, true);
+    msd_trace_free(&trace);
+    free(expect);
+    return success;
+}
+
+// Copy every format in every order with both erase modes.  File data is
+// only recognized once the directory entry of a file with a known
+// extension has been written so the other orders must not program.
+static bool run_check(options_t *options)
+{
+    uint32_t format, order, page_erase;
+    bool success = true;
+
+    for (page_erase = 0; page_erase < 2; page_erase++) {
+        for (format = 0; format < IMAGE_FORMAT_COUNT; format++) {
+            for (order = 0; order < MSD_TRACE_ORDER_COUNT; order++) {
+                options->format = (image_format_t)format;
+                options->order = (msd_trace_order_t)order;
+                options->page_erase = page_erase;
+                success = run_copy(options, (MSD_TRACE_DIR_FIRST == order) ||
+                                   (MSD_TRACE_PROGRESSIVE == order)) && success;
+            }
+        }
+    }
+
+    return success;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [options]\n"
+           "  --check              Copy every format in every order and check the flash\n"
+           "  --format FORMAT      bin, hex, srec, uf2, uf2_resend or elf\n"
+           "                       (default bin)\n"
+           "  --order ORDER        data_first, dir_first, fat_first or progressive (default data_first)\n"
+           "  --size BYTES         Size of the generated image (default 100000)\n"
+           "  --line BYTES         Bytes per hex or srec record and uf2 block (default 16, uf2 256, at most 250)\n"
+           "  --chunk SECTORS      Sectors per data write of a generated trace (default 64)\n"
+           "  --save FILE          Save the generated trace for msd_trace.py\n"
+           "  --trace FILE         Replay a trace recorded by msd_trace.py\n"
+           "  --expect FILE        Binary the flash must hold after --trace\n"
+           "  --delays             Wait the recorded time between commands\n"
+           "  --page-erase         Erase sectors as they are programmed instead of the chip\n"
+           "  --program-us US      Time to program a %u byte page (default %u)\n"
+           "  --erase-us US        Time to erase a %u byte sector (default %u)\n",
+           name, flash_config.page_size, flash_config.program_page_us,
+           flash_config.sector_size, flash_config.erase_sector_us);
+}
+
+int main(int argc, char *argv[])
+{
+    options_t options = {
+        .format = IMAGE_BIN,
+        .order = MSD_TRACE_DATA_FIRST,
+        .size = 100000,
+        .line_size = 0,
+        .chunk_sectors = 64,
+    };
+    bool check = false;
+    bool success;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : 0;
+
+        if (0 == strcmp(argv[i], "--check")) {
+            check = true;
+        } else if (0 == strcmp(argv[i], "--delays")) {
+            options.use_delays = true;
+        } else if (0 == strcmp(argv[i], "--page-erase")) {
+            options.page_erase = true;
+        } else if (0 == value) {
+            usage(argv[0]);
+            return 2;
+        } else if (0 == strcmp(argv[i], "--format")) {
+            options.format = image_format_from_name(value);
+            i++;
+        } else if (0 == strcmp(argv[i], "--order")) {
+            for (options.order = (msd_trace_order_t)0; options.order < MSD_TRACE_ORDER_COUNT; options.order++) {
+                if (0 == strcmp(value, msd_trace_order_name[options.order])) {
+                    break;
+                }
+            }
+
+            i++;
+        } else if (0 == strcmp(argv[i], "--size")) {
+            options.size = strtoul(value, 0, 0);
+            i++;
+        } else if (0 == strcmp(argv[i], "--line")) {
+            options.line_size = strtoul(value, 0, 0);
+            i++;
+        } else if (0 == strcmp(argv[i], "--chunk")) {
+            options.chunk_sectors = strtoul(value, 0, 0);
+            i++;
+        } else if (0 == strcmp(argv[i], "--save")) {
+            options.save_path = value;
+            i++;
+        } else if (0 == strcmp(argv[i], "--trace")) {
+            options.trace_path = value;
+            i++;
+        } else if (0 == strcmp(argv[i], "--expect")) {
+            options.expect_path = value;
+            i++;
+        } else if (0 == strcmp(argv[i], "--program-us")) {
+            flash_config.program_page_us = strtoul(value, 0, 0);
+            i++;
+        } else if (0 == strcmp(argv[i], "--erase-us")) {
+            flash_config.erase_sector_us = strtoul(value, 0, 0);
+            i++;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if ((options.format >= IMAGE_FORMAT_COUNT) || (options.order >= MSD_TRACE_ORDER_COUNT) ||
+            (0 == options.chunk_sectors) || (options.line_size > 250) || (options.size < 16)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Start up like the USB thread of the firmware
+    host_target_init();
+    flash_sim_reset(&flash_config);
+    usbd_msc_init();
+    vfs_mngr_init(true);
+
+    if (check) {
+        success = run_check(&options);
+    } else if (0 != options.trace_path) {
+        success = run_trace(&options);
+    } else {
+        success = run_copy(&options, true);
+    }
+
+    return success ? 0 : 1;
+}
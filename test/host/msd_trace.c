@@ -0,0 +1,394 @@
+/**
+ * @file    msd_trace.c
+ * @brief   Implementation of msd_trace.h
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+#include "unistd.h"
+
+#include "RTL.h"
+#include "rl_usb.h"
+#include "macro.h"
+#include "msd_trace.h"
+#include "vfs_manager.h"
+
+#define TRACE_MAGIC         "MSDT"
+#define TRACE_VERSION       1
+#define DIR_ENTRY_SIZE      32
+#define FAT_ENTRY_FREE      0x0000
+#define FAT_ENTRY_LAST      0xFFFF
+
+const char *const msd_trace_order_name[MSD_TRACE_ORDER_COUNT] = {
+    "data_first",
+    "dir_first",
+    "fat_first",
+    "progressive",
+};
+
+static uint32_t get16(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *data)
+{
+    return get16(data) | (get16(data + 2) << 16);
+}
+
+static void put16(uint8_t *data, uint32_t value)
+{
+    data[0] = value & 0xFF;
+    data[1] = (value >> 8) & 0xFF;
+}
+
+static void put32(uint8_t *data, uint32_t value)
+{
+    put16(data, value & 0xFFFF);
+    put16(data + 2, value >> 16);
+}
+
+static uint64_t time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Append a copy of count sectors of data
+static void trace_append(msd_trace_t *trace, uint32_t lba, const uint8_t *data, uint32_t count,
+                         uint32_t delay_us)
+{
+    msd_trace_record_t *record;
+    trace->records = realloc(trace->records, (trace->record_count + 1) * sizeof(*record));
+    record = &trace->records[trace->record_count];
+    record->lba = lba;
+    record->count = count;
+    record->delay_us = delay_us;
+    record->data = malloc(count * VFS_SECTOR_SIZE);
+
+    if ((0 == trace->records) || (0 == record->data)) {
+        abort();
+    }
+
+    memcpy(record->data, data, count * VFS_SECTOR_SIZE);
+    trace->record_count++;
+}
+
+bool msd_trace_load(msd_trace_t *trace, const char *path)
+{
+    uint8_t header[12];
+    uint8_t *data;
+    uint32_t record_count;
+    uint32_t i;
+    bool success = false;
+    FILE *file = fopen(path, "rb");
+    memset(trace, 0, sizeof(*trace));
+
+    if (0 == file) {
+        return false;
+    }
+
+    if ((fread(header, sizeof(header), 1, file) != 1) || (memcmp(header, TRACE_MAGIC, 4) != 0) ||
+            (get32(&header[4]) != TRACE_VERSION)) {
+        fclose(file);
+        return false;
+    }
+
+    record_count = get32(&header[8]);
+
+    for (i = 0; i < record_count; i++) {
+        if (fread(header, sizeof(header), 1, file) != 1) {
+            break;
+        }
+
+        data = malloc(get32(&header[4]) * VFS_SECTOR_SIZE);
+
+        if ((0 == data) || (fread(data, VFS_SECTOR_SIZE, get32(&header[4]), file) != get32(&header[4]))) {
+            free(data);
+            break;
+        }
+
+        trace_append(trace, get32(&header[0]), data, get32(&header[4]), get32(&header[8]));
+        free(data);
+    }
+
+    success = (i == record_count);
+    fclose(file);
+
+    if (!success) {
+        msd_trace_free(trace);
+    }
+
+    return success;
+}
+
+bool msd_trace_save(const msd_trace_t *trace, const char *path)
+{
+    uint8_t header[12];
+    const msd_trace_record_t *record;
+    uint32_t i;
+    bool success;
+    FILE *file = fopen(path, "wb");
+
+    if (0 == file) {
+        return false;
+    }
+
+    memcpy(header, TRACE_MAGIC, 4);
+    put32(&header[4], TRACE_VERSION);
+    put32(&header[8], trace->record_count);
+    success = fwrite(header, sizeof(header), 1, file) == 1;
+
+    for (i = 0; success && (i < trace->record_count); i++) {
+        record = &trace->records[i];
+        put32(&header[0], record->lba);
+        put32(&header[4], record->count);
+        put32(&header[8], record->delay_us);
+        success = (fwrite(header, sizeof(header), 1, file) == 1) &&
+                  (fwrite(record->data, VFS_SECTOR_SIZE, record->count, file) == record->count);
+    }
+
+    return (0 == fclose(file)) && success;
+}
+
+void msd_trace_free(msd_trace_t *trace)
+{
+    uint32_t i;
+
+    for (i = 0; i < trace->record_count; i++) {
+        free(trace->records[i].data);
+    }
+
+    free(trace->records);
+    memset(trace, 0, sizeof(*trace));
+}
+
+uint32_t msd_trace_get_size(const msd_trace_t *trace)
+{
+    uint32_t size = 0;
+    uint32_t i;
+
+    for (i = 0; i < trace->record_count; i++) {
+        size += trace->records[i].count * VFS_SECTOR_SIZE;
+    }
+
+    return size;
+}
+
+static uint8_t *read_sectors(uint32_t lba, uint32_t count)
+{
+    uint8_t *data = malloc(count * VFS_SECTOR_SIZE);
+
+    if ((0 != data) && !usbd_msc_read_sect(lba, data, count)) {
+        free(data);
+        data = 0;
+    }
+
+    return data;
+}
+
+// Chain count clusters from first_cluster in fat, the last one ending the chain
+static void fat_chain(uint8_t *fat, uint32_t first_cluster, uint32_t count)
+{
+    uint32_t cluster, i;
+
+    for (i = 0; i < count; i++) {
+        cluster = first_cluster + i;
+        put16(&fat[cluster * 2], (i == count - 1) ? FAT_ENTRY_LAST : cluster + 1);
+    }
+}
+
+bool msd_trace_build_copy(msd_trace_t *trace, const vfs_filename_t name, const uint8_t *data,
+                          uint32_t size, msd_trace_order_t order, uint32_t chunk_sectors)
+{
+    uint8_t boot[VFS_SECTOR_SIZE];
+    uint8_t *fat_data = 0;
+    uint8_t *fat_part = 0;
+    uint8_t *dir_empty = 0;
+    uint8_t *dir_final = 0;
+    uint8_t *file_data = 0;
+    uint8_t *entry = 0;
+    uint32_t sectors_per_cluster, fat_start, fat_sectors, fat_count;
+    uint32_t root_sector, root_sectors, data_start;
+    uint32_t file_sectors, cluster_count, first_cluster, run, cluster, i, j, count, written;
+    bool success = false;
+    memset(trace, 0, sizeof(*trace));
+
+    if (!usbd_msc_read_sect(0, boot, 1) || (get16(&boot[11]) != VFS_SECTOR_SIZE)) {
+        return false;
+    }
+
+    sectors_per_cluster = boot[13];
+    fat_start = get16(&boot[14]);
+    fat_count = boot[16];
+    fat_sectors = get16(&boot[22]);
+    root_sector = fat_start + fat_count * fat_sectors;
+    root_sectors = (get16(&boot[17]) * DIR_ENTRY_SIZE + VFS_SECTOR_SIZE - 1) / VFS_SECTOR_SIZE;
+    data_start = root_sector + root_sectors;
+
+    // Pad the file to a whole number of sectors
+    file_sectors = (size + VFS_SECTOR_SIZE - 1) / VFS_SECTOR_SIZE;
+    file_data = calloc(file_sectors ? file_sectors : 1, VFS_SECTOR_SIZE);
+    cluster_count = (file_sectors + sectors_per_cluster - 1) / sectors_per_cluster;
+    cluster_count = cluster_count ? cluster_count : 1;
+    fat_data = read_sectors(fat_start, fat_sectors);
+    dir_empty = read_sectors(root_sector, root_sectors);
+    dir_final = malloc(root_sectors * VFS_SECTOR_SIZE);
+    fat_part = malloc(fat_sectors * VFS_SECTOR_SIZE);
+
+    if ((0 == file_data) || (0 == fat_data) || (0 == dir_empty) || (0 == dir_final) || (0 == fat_part)) {
+        goto done;
+    }
+
+    memcpy(file_data, data, size);
+
+    // Find a free run of clusters in the first FAT
+    first_cluster = 0;
+    run = 0;
+
+    for (cluster = 2; cluster < fat_sectors * VFS_SECTOR_SIZE / 2; cluster++) {
+        run = (FAT_ENTRY_FREE == get16(&fat_data[cluster * 2])) ? run + 1 : 0;
+
+        if (run == cluster_count) {
+            first_cluster = cluster - cluster_count + 1;
+            break;
+        }
+    }
+
+    if (0 == first_cluster) {
+        goto done;
+    }
+
+    // The free FAT is kept for the chains of a progressive copy
+    memcpy(fat_part, fat_data, fat_sectors * VFS_SECTOR_SIZE);
+    fat_chain(fat_data, first_cluster, cluster_count);
+
+    // Directory entries with and without the final size
+    for (i = 0; i < root_sectors * VFS_SECTOR_SIZE / DIR_ENTRY_SIZE; i++) {
+        if ((0x00 == dir_empty[i * DIR_ENTRY_SIZE]) || (0xE5 == dir_empty[i * DIR_ENTRY_SIZE])) {
+            entry = &dir_empty[i * DIR_ENTRY_SIZE];
+            break;
+        }
+    }
+
+    if (0 == entry) {
+        goto done;
+    }
+
+    memset(entry, 0, DIR_ENTRY_SIZE);
+    memcpy(entry, name, sizeof(vfs_filename_t));
+    entry[11] = 0x20;
+    put16(&entry[26], first_cluster);
+    put32(&entry[28], 0);
+    memcpy(dir_final, dir_empty, root_sectors * VFS_SECTOR_SIZE);
+    put32(&dir_final[entry - dir_empty + 28], size);
+
+    if ((MSD_TRACE_DIR_FIRST == order) || (MSD_TRACE_PROGRESSIVE == order)) {
+        trace_append(trace, root_sector, dir_empty, root_sectors, 0);
+    }
+
+    // Like a host which writes the metadata after every chunk, so the
+    // directory entry and FAT agree on a size before the end of the file
+    if (MSD_TRACE_PROGRESSIVE == order) {
+        for (i = 0; i < file_sectors; i += chunk_sectors) {
+            count = MIN(chunk_sectors, file_sectors - i);
+            fat_chain(fat_part, first_cluster, (i + count + sectors_per_cluster - 1) / sectors_per_cluster);
+
+            for (j = 0; j < fat_count; j++) {
+                trace_append(trace, fat_start + j * fat_sectors, fat_part, fat_sectors, 0);
+            }
+
+            trace_append(trace, data_start + (first_cluster - 2) * sectors_per_cluster + i,
+                         file_data + i * VFS_SECTOR_SIZE, count, 0);
+            written = MIN(size, (i + count) * VFS_SECTOR_SIZE);
+            put32(&dir_final[entry - dir_empty + 28], written);
+            trace_append(trace, root_sector, dir_final, root_sectors, 0);
+        }
+
+        success = true;
+        goto done;
+    }
+
+    if (MSD_TRACE_DATA_FIRST != order) {
+        for (i = 0; i < fat_count; i++) {
+            trace_append(trace, fat_start + i * fat_sectors, fat_data, fat_sectors, 0);
+        }
+    }
+
+    // File data in host sized chunks
+    for (i = 0; i < file_sectors; i += chunk_sectors) {
+        trace_append(trace, data_start + (first_cluster - 2) * sectors_per_cluster + i,
+                     file_data + i * VFS_SECTOR_SIZE, MIN(chunk_sectors, file_sectors - i), 0);
+    }
+
+    if (MSD_TRACE_DATA_FIRST == order) {
+        for (i = 0; i < fat_count; i++) {
+            trace_append(trace, fat_start + i * fat_sectors, fat_data, fat_sectors, 0);
+        }
+    }
+
+    trace_append(trace, root_sector, dir_final, root_sectors, 0);
+    success = true;
+done:
+    free(file_data);
+    free(fat_data);
+    free(fat_part);
+    free(dir_empty);
+    free(dir_final);
+
+    if (!success) {
+        msd_trace_free(trace);
+    }
+
+    return success;
+}
+
+void msd_trace_replay(const msd_trace_t *trace, bool use_delays)
+{
+    const msd_trace_record_t *record;
+    uint64_t last_periodic = time_us();
+    uint64_t now;
+    uint32_t i, pos, count;
+
+    for (i = 0; i < trace->record_count; i++) {
+        record = &trace->records[i];
+
+        if (use_delays && (record->delay_us > 0)) {
+            usleep(record->delay_us);
+        }
+
+        // USB hands over sectors in the buffer set up by the vfs manager
+        for (pos = 0; pos < record->count; pos += count) {
+            count = MIN(USBD_MSC_BlockGroup, record->count - pos);
+            memcpy(USBD_MSC_BlockBuf, record->data + pos * VFS_SECTOR_SIZE, count * VFS_SECTOR_SIZE);
+            usbd_msc_write_sect(record->lba + pos, USBD_MSC_BlockBuf, count);
+        }
+
+        // Run the vfs manager with the elapsed time like the main thread
+        now = time_us();
+
+        if (now - last_periodic >= 1000) {
+            vfs_mngr_periodic((now - last_periodic) / 1000);
+            last_periodic += (now - last_periodic) / 1000 * 1000;
+        }
+    }
+}
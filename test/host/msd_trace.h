@@ -0,0 +1,80 @@
+/**
+ * @file    msd_trace.h
+ * @brief   Load, build and replay MSD write traces against the vfs manager
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MSD_TRACE_H
+#define MSD_TRACE_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#include "virtual_fs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Same file format as test/msd_trace.py
+typedef struct {
+    uint32_t lba;                   // First sector written
+    uint32_t count;                 // Number of sectors
+    uint32_t delay_us;              // Time since the previous write
+    uint8_t *data;                  // count * VFS_SECTOR_SIZE bytes
+} msd_trace_record_t;
+
+typedef struct {
+    msd_trace_record_t *records;
+    uint32_t record_count;
+} msd_trace_t;
+
+typedef enum {
+    MSD_TRACE_DATA_FIRST,           // File data, the FAT, then the directory entry
+    MSD_TRACE_DIR_FIRST,            // Empty directory entry, FAT, data, final entry
+    MSD_TRACE_FAT_FIRST,            // FAT, file data, then the directory entry
+    MSD_TRACE_PROGRESSIVE,          // Empty directory entry, then for each chunk of data the FAT
+                                    // chained up to it, the data and the entry with the size so far
+
+    MSD_TRACE_ORDER_COUNT
+} msd_trace_order_t;
+
+extern const char *const msd_trace_order_name[MSD_TRACE_ORDER_COUNT];
+
+bool msd_trace_load(msd_trace_t *trace, const char *path);
+bool msd_trace_save(const msd_trace_t *trace, const char *path);
+void msd_trace_free(msd_trace_t *trace);
+
+// Number of bytes written by the trace
+uint32_t msd_trace_get_size(const msd_trace_t *trace);
+
+// Build a trace copying data to the 8.3 file name on the mounted drive,
+// like build_copy_trace in msd_trace.py.  The FAT and root directory are
+// read through usbd_msc_read_sect.
+bool msd_trace_build_copy(msd_trace_t *trace, const vfs_filename_t name, const uint8_t *data,
+                          uint32_t size, msd_trace_order_t order, uint32_t chunk_sectors);
+
+// Send the trace through usbd_msc_write_sect in groups of USBD_MSC_BlockGroup
+// sectors, running vfs_mngr_periodic between commands like the USB thread
+void msd_trace_replay(const msd_trace_t *trace, bool use_delays);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
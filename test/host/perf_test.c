@@ -0,0 +1,124 @@
+/**
+ * @file    perf_test.c
+ * @brief   Size tests of the PERF.TXT report
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdio.h"
+#include "string.h"
+
+#include "perf_counter.h"
+#include "settings.h"
+#include "vfs_manager.h"
+
+// Room past the sector to catch writes beyond the returned size
+#define BUF_SIZE            (2 * VFS_SECTOR_SIZE)
+#define FILL                0xA5
+
+static uint32_t failures;
+
+#define CHECK(cond, ...)                                                    \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            failures++;                                                     \
+            printf("FAIL %s:%u: ", __FILE__, __LINE__);                     \
+            printf(__VA_ARGS__);                                            \
+            printf("\n");                                                   \
+        }                                                                   \
+    } while (0)
+
+// Used by _util_assert in util.c, which this test never calls
+
+void config_ram_set_assert(const char *file, uint16_t line)
+{
+}
+
+void config_ram_clear_assert(void)
+{
+}
+
+bool config_ram_get_assert(char *buf, uint16_t buf_size, uint16_t *line, assert_source_t *source)
+{
+    return false;
+}
+
+void vfs_mngr_fs_remount(void)
+{
+}
+
+// Set every timer and event to value
+static void fill_counters(uint32_t value)
+{
+    perf_stat_t *stat;
+    uint32_t i;
+
+    for (i = 0; i < PERF_TIMER_COUNT; i++) {
+        stat = (perf_stat_t *)perf_get_stat((perf_timer_t)i);
+        stat->count = value;
+        stat->min = value;
+        stat->max = value;
+        stat->total = value ? UINT64_MAX : 0;
+    }
+
+    for (i = 0; i < PERF_EVENT_COUNT; i++) {
+        perf_events[i] = value;
+    }
+}
+
+static uint32_t write_report(uint8_t *buf)
+{
+    uint32_t size, i;
+    memset(buf, FILL, BUF_SIZE);
+    size = perf_write_report((char *)buf);
+
+    for (i = size; i < BUF_SIZE; i++) {
+        if (FILL != buf[i]) {
+            break;
+        }
+    }
+
+    CHECK(BUF_SIZE == i, "byte %u written past the report size %u", i, size);
+    CHECK((size >= 2) && (0 == memcmp(buf + size - 2, "\r\n", 2)), "report does not end with a new line");
+    return size;
+}
+
+// The report fits in the single sector PERF.TXT is read into and keeps
+// the same size whatever the counters hold
+static void test_size(void)
+{
+    uint8_t buf[BUF_SIZE];
+    uint32_t reset_size, max_size, single_size;
+    perf_reset();
+    reset_size = write_report(buf);
+    fill_counters(UINT32_MAX);
+    max_size = write_report(buf);
+    fill_counters(1);
+    single_size = write_report(buf);
+    CHECK(max_size <= PERF_REPORT_MAX_SIZE, "report is %u bytes, more than %u", max_size, PERF_REPORT_MAX_SIZE);
+    CHECK(max_size <= VFS_SECTOR_SIZE, "report is %u bytes, more than a sector", max_size);
+    CHECK((reset_size == max_size) && (single_size == max_size), "report size changes: %u, %u and %u",
+          reset_size, single_size, max_size);
+    printf("PERF.TXT is %u of %u bytes\n", max_size, PERF_REPORT_MAX_SIZE);
+}
+
+int main(int argc, char *argv[])
+{
+    test_size();
+    printf("perf tests: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
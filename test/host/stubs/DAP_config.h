@@ -0,0 +1,58 @@
+/**
+ * @file    DAP_config.h
+ * @brief   CMSIS-DAP configuration for host builds, the pins drive swd_sim
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DAP_CONFIG_H__
+#define __DAP_CONFIG_H__
+
+#include "stdint.h"
+
+#include "swd_sim.h"
+
+// Used by DAP.h for its inline pin delays
+#define __forceinline           inline __attribute__((always_inline))
+
+// Same values as the LPC11U35 configuration
+#define CPU_CLOCK               48000000
+#define DAP_SWD                 1
+#define DAP_JTAG                0
+#define DAP_JTAG_DEV_CNT        0
+#define DAP_DEFAULT_PORT        1
+#define DAP_DEFAULT_SWJ_CLOCK   5000000
+#define DAP_PACKET_SIZE         64
+#define DAP_PACKET_COUNT        1
+
+// nRESET is open drain so setting up or turning off the port releases it
+static inline void PORT_SWD_SETUP(void)
+{
+    swd_sim_set_nreset(1);
+}
+
+static inline void PORT_OFF(void)
+{
+    swd_sim_set_nreset(1);
+}
+
+static inline void PIN_nRESET_OUT(uint32_t bit)
+{
+    swd_sim_set_nreset(bit);
+}
+
+#endif
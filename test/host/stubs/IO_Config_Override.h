@@ -0,0 +1,43 @@
+/**
+ * @file    IO_Config_Override.h
+ * @brief   Empty HIC pin configuration for host builds
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __IO_CONFIG_OVERRIDE_H__
+#define __IO_CONFIG_OVERRIDE_H__
+
+// Selected with IO_CONFIG_OVERRIDE so IO_Config.h skips the LPC11U35
+// registers.  The drag-n-drop code does not touch any pins.
+
+// Used by cortex_m.h, the host has no interrupts to mask
+static inline int __disable_irq(void)
+{
+    return 0;
+}
+
+static inline void __enable_irq(void)
+{
+}
+
+static inline unsigned int __get_xPSR(void)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * @file    RTL.h
+ * @brief   RTX subset used by the drag-n-drop code, implemented on pthreads
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RTL_H
+#define RTL_H
+
+#include "stdint.h"
+#include "pthread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef char            S8;
+typedef unsigned char   U8;
+typedef short           S16;
+typedef unsigned short  U16;
+typedef int             S32;
+typedef unsigned int    U32;
+typedef long long       S64;
+typedef unsigned long long U64;
+typedef unsigned char   BIT;
+typedef unsigned int    BOOL;
+
+#ifndef __TRUE
+#define __TRUE          1
+#endif
+#ifndef __FALSE
+#define __FALSE         0
+#endif
+
+#define __task
+#define __packed        __attribute__((packed))
+#define __weak          __attribute__((weak))
+
+typedef U32 OS_TID;
+typedef void *OS_ID;
+typedef U32 OS_RESULT;
+
+#define OS_R_TMO        0x01
+#define OS_R_EVT        0x02
+#define OS_R_SEM        0x03
+#define OS_R_MBX        0x04
+#define OS_R_MUT        0x05
+#define OS_R_OK         0x00
+#define OS_R_NOK        0xff
+
+// Timeout value which waits forever
+#define OS_WAIT_FOREVER 0xFFFF
+
+typedef struct {
+    pthread_mutex_t mutex;
+} OS_MUT;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    U32 count;
+} OS_SEM;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    U32 size;
+    U32 first;
+    U32 count;
+    void *msg[1];
+} host_mbx_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    void *free;
+} host_box_t;
+
+// Mailboxes and pools keep their RTX layout: a header followed by storage
+#define os_mbx_declare(name, cnt)   \
+    struct { host_mbx_t hdr; void *msg[cnt]; } name
+#define _declare_box(pool, size, cnt)   \
+    struct { host_box_t hdr; U64 mem[((size) + 7) / 8 * (cnt)]; } pool[1]
+
+// Length of an RTX tick in microseconds
+extern U32 const os_clockrate;
+// Number of ticks since the first task was started
+extern U32 os_time;
+
+// Start the RTX emulation with the calling thread as the first task
+void host_rtx_init(void);
+
+OS_TID os_tsk_create_user(void (*task)(void), U32 prio, void *stk, U16 size);
+OS_TID os_tsk_self(void);
+void os_dly_wait(U16 delay_time);
+
+void os_mut_init(OS_MUT *mutex);
+OS_RESULT os_mut_wait(OS_MUT *mutex, U16 timeout);
+OS_RESULT os_mut_release(OS_MUT *mutex);
+
+void os_sem_init(OS_SEM *semaphore, U16 token_count);
+OS_RESULT os_sem_wait(OS_SEM *semaphore, U16 timeout);
+OS_RESULT os_sem_send(OS_SEM *semaphore);
+
+void host_mbx_init(void *mailbox, U16 mbx_size);
+OS_RESULT host_mbx_send(void *mailbox, void *message_ptr, U16 timeout);
+OS_RESULT host_mbx_wait(void *mailbox, void **message, U16 timeout);
+#define os_mbx_init(mbx, size)          host_mbx_init((mbx), (size))
+#define os_mbx_send(mbx, msg, tmo)      host_mbx_send((mbx), (msg), (tmo))
+#define os_mbx_wait(mbx, msg, tmo)      host_mbx_wait((mbx), (msg), (tmo))
+
+int _init_box(void *box_mem, U32 box_size, U32 blk_size);
+void *_alloc_box(void *box_mem);
+int _free_box(void *box_mem, void *block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
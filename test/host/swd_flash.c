@@ -0,0 +1,374 @@
+/**
+ * @file    swd_flash.c
+ * @brief   Program the simulated SWD target through target_flash.c
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "RTL.h"
+#include "macro.h"
+#include "error.h"
+#include "gpio.h"
+#include "settings.h"
+#include "util.h"
+#include "perf_counter.h"
+#include "flash_intf.h"
+#include "flash_manager.h"
+#include "target_config.h"
+#include "target_flash.h"
+#include "target_ids.h"
+#include "DAP_config.h"
+#include "swd_sim.h"
+#include "image.h"
+
+// Longer than any idle time of target_flash.c so its sessions end
+#define SESSION_END_MS          60000
+
+// Size of the reads of the flash after programming, same as a sector of FLASH.BIN
+#define READ_SIZE               512
+
+typedef struct {
+    const char *name;
+    uint8_t id;                     // Target_* detected by swd_init_get_target
+    uint32_t idcode;
+    swd_sim_word_t id_words[2];     // Device ID registers read by get_target_id
+} sim_target_t;
+
+typedef struct {
+    uint32_t size;
+    bool sector_erase;
+    bool verify;
+    bool hw_reset;
+} options_t;
+
+// DBGMCU_IDCODE of the STM32F0 and the nRF51 FICR word checked by swd_host.c
+static const sim_target_t sim_targets[] = {
+    {"nrf51",       Target_NRF51822,  0x0BB11477, {{0x40015800, 0x00000000}, {0x10000000, 0x55AA55AA}}},
+    {"stm32f051",   Target_STM32F051, 0x0BB11477, {{0x40015800, 0x20006440}}},
+    {"stm32f103",   Target_STM32F103, 0x1BA01477, {{0}}},
+    {"stm32f405",   Target_STM32F405, 0x2BA01477, {{0}}},
+    {"stm32f071",   Target_STM32F071, 0x0BB11477, {{0x40015800, 0x20006448}}},
+    {"stm32f031",   Target_STM32F031, 0x0BB11477, {{0x40015800, 0x20006444}}},
+};
+
+static swd_sim_config_t sim_config = {
+    .swclk_hz           = DAP_DEFAULT_SWJ_CLOCK,
+    .erase_sector_us    = 20000,
+    .erase_chip_us      = 40000,
+    .program_word_us    = 50,
+};
+
+static options_t options;
+
+// Settings and pins read by target_flash.c and target_reset.c
+
+bool config_get_auto_rst(void)
+{
+    return false;
+}
+
+bool config_get_automation_allowed(void)
+{
+    return options.verify;
+}
+
+uint8_t gpio_get_config(uint8_t cfgid)
+{
+    return ((PIN_CONFIG_DT01 == cfgid) && options.hw_reset) ? PIN_HIGH : PIN_LOW;
+}
+
+void _util_assert(bool expression, const char *filename, uint16_t line)
+{
+    if (!expression) {
+        printf("Assert at %s:%u\n", filename, line);
+        abort();
+    }
+}
+
+static const sim_target_t *find_target(const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < ELEMENTS_IN_ARRAY(sim_targets); i++) {
+        if (0 == strcmp(name, sim_targets[i].name)) {
+            return &sim_targets[i];
+        }
+    }
+
+    return 0;
+}
+
+// Program the way the drag-n-drop code does, erasing the chip first
+static error_t program_chip_erase(uint32_t addr, const uint8_t *data, uint32_t size)
+{
+    error_t status;
+    error_t uninit_status;
+    uint32_t pos, n;
+    flash_manager_set_page_erase(false);
+    status = flash_manager_init(flash_intf_target);
+
+    if (ERROR_SUCCESS != status) {
+        return status;
+    }
+
+    for (pos = 0; (ERROR_SUCCESS == status) && (pos < size); pos += n) {
+        n = MIN(size - pos, READ_SIZE);
+        status = flash_manager_data(addr + pos, data + pos, n);
+    }
+
+    uninit_status = flash_manager_uninit();
+    return (ERROR_SUCCESS != status) ? status : uninit_status;
+}
+
+// Program pages directly so target_flash.c erases each sector it reaches
+static error_t program_sector_erase(uint32_t addr, const uint8_t *data, uint32_t size)
+{
+    error_t status;
+    uint32_t pos, n;
+    status = flash_intf_target->init();
+
+    if (ERROR_SUCCESS != status) {
+        return status;
+    }
+
+    for (pos = 0; (ERROR_SUCCESS == status) && (pos < size); pos += n) {
+        n = MIN(size - pos, flash_intf_target->program_page_min_size(addr + pos));
+        status = flash_intf_target->program_page(addr + pos, data + pos, n);
+    }
+
+    flash_intf_target->uninit();
+    return status;
+}
+
+static error_t read_back(uint32_t addr, const uint8_t *expect, uint32_t size)
+{
+    uint8_t buf[READ_SIZE];
+    error_t status = ERROR_SUCCESS;
+    uint32_t pos, n;
+
+    for (pos = 0; (ERROR_SUCCESS == status) && (pos < size); pos += n) {
+        n = MIN(size - pos, sizeof(buf));
+        status = flash_intf_target->read(addr + pos, buf, n);
+
+        if ((ERROR_SUCCESS == status) && (0 != memcmp(buf, expect + pos, n))) {
+            status = ERROR_TARGET_READ;
+        }
+    }
+
+    return status;
+}
+
+static void print_cost(const char *label, const char *what, uint32_t bytes, const swd_sim_stats_t *stats)
+{
+    double kb = MAX(bytes, 1) / 1024.0;
+    double wire_ms = stats->clocks * 1000.0 / sim_config.swclk_hz;
+    printf("%-30s %-7s: %u bytes, %u transfers (%.1f/KB), %.2f ms on the wire at %u Hz (%.3f ms/KB)",
+           label, what, bytes, stats->transfers, stats->transfers / kb, wire_ms, sim_config.swclk_hz,
+           wire_ms / kb);
+}
+
+// Program an image into the simulated target, read it back and report
+// the SWD traffic of both
+static bool run_program(const sim_target_t *sim_target)
+{
+    const target_cfg_t *target = &target_device[sim_target->id];
+    uint32_t flash_size = target->sector_cnt * target->sector_size;
+    uint32_t size = MIN(options.size, flash_size);
+    uint8_t *flash;
+    uint8_t *image = malloc(size);
+    swd_sim_stats_t program_stats;
+    uint32_t flash_bytes, i;
+    error_t status;
+    const char *failure = 0;
+    char label[64];
+
+    if (0 == image) {
+        return false;
+    }
+
+    snprintf(label, sizeof(label), "%-9s %s%s%s", sim_target->name,
+             options.sector_erase ? "sector erase" : "chip erase",
+             options.verify ? ", verify" : "", options.hw_reset ? ", nRESET" : "");
+    sim_config.target = target;
+    sim_config.idcode = sim_target->idcode;
+    sim_config.id_words = sim_target->id_words;
+    sim_config.id_word_count = ELEMENTS_IN_ARRAY(sim_target->id_words);
+    swd_sim_reset(&sim_config);
+    flash = swd_sim_flash();
+
+    // Old firmware so programming without an erase fails
+    memset(flash, 0, flash_size);
+    image_make_firmware(image, size, sim_target->id);
+    targetID = swd_init_get_target();
+
+    if (targetID != sim_target->id) {
+        printf("%s: detected as target %u\n", label, targetID);
+        free(image);
+        return false;
+    }
+
+    perf_reset();
+    swd_sim_clear_stats();
+    status = options.sector_erase ? program_sector_erase(target->flash_start, image, size) :
+             program_chip_erase(target->flash_start, image, size);
+    program_stats = *swd_sim_get_stats();
+    flash_bytes = perf_events[PERF_EVENT_FLASH_BYTES];
+
+    if (ERROR_SUCCESS != status) {
+        failure = error_get_string(status);
+    } else if (program_stats.program_errors > 0) {
+        failure = "programmed without an erase";
+    } else if (0 != memcmp(flash, image, size)) {
+        failure = "flash does not match the image";
+    } else if (flash_bytes != size) {
+        failure = "flash bytes counted wrong";
+    }
+
+    // The rest of the flash is left as it was or erased
+    for (i = size; (0 == failure) && (i < flash_size); i++) {
+        if ((flash[i] != 0xFF) && (options.sector_erase ? (flash[i] != 0) : true)) {
+            failure = "flash written past the end of the image";
+        }
+    }
+
+    print_cost(label, "program", size, &program_stats);
+    printf(", %u algorithm calls, %.1f ms flash busy - %s\n", program_stats.algo_calls,
+           program_stats.busy_us / 1000.0, failure ? failure : "OK");
+
+    // Read back through FLASH.BIN once the programming session has ended
+    target_flash_session_periodic(SESSION_END_MS);
+    swd_sim_clear_stats();
+    status = (0 == failure) ? read_back(target->flash_start, image, size) : ERROR_SUCCESS;
+
+    if ((0 == failure) && (ERROR_SUCCESS != status)) {
+        failure = "read back does not match the image";
+        print_cost(label, "read", size, swd_sim_get_stats());
+        printf(" - %s\n", failure);
+    } else if (0 == failure) {
+        print_cost(label, "read", size, swd_sim_get_stats());
+        printf(" - OK\n");
+    }
+
+    target_flash_session_periodic(SESSION_END_MS);
+    free(image);
+    return 0 == failure;
+}
+
+// Every target with both erase modes, then verification and the nRESET
+// pin on the targets which use them
+static bool run_check(void)
+{
+    uint32_t i, sector_erase;
+    bool success = true;
+
+    for (sector_erase = 0; sector_erase < 2; sector_erase++) {
+        for (i = 0; i < ELEMENTS_IN_ARRAY(sim_targets); i++) {
+            options.sector_erase = sector_erase;
+            success = run_program(&sim_targets[i]) && success;
+        }
+    }
+
+    options.sector_erase = false;
+    options.verify = true;
+    success = run_program(find_target("nrf51")) && success;
+    options.verify = false;
+    options.hw_reset = true;
+    success = run_program(find_target("stm32f103")) && success;
+    options.hw_reset = false;
+    return success;
+}
+
+static void usage(const char *name)
+{
+    uint32_t i;
+    printf("Usage: %s [options]\n"
+           "  --check              Program every target in every mode and check the flash\n"
+           "  --target NAME        Target to program (default nrf51):",
+           name);
+
+    for (i = 0; i < ELEMENTS_IN_ARRAY(sim_targets); i++) {
+        printf(" %s", sim_targets[i].name);
+    }
+
+    printf("\n"
+           "  --size BYTES         Size of the generated image (default 32768)\n"
+           "  --swclk HZ           SWCLK frequency for the wire time (default %u)\n"
+           "  --sector-erase       Erase sectors as they are programmed instead of the chip\n"
+           "  --verify             Read back each page after programming like automation mode\n"
+           "  --hw-reset           Reset with nRESET on the targets which support it\n"
+           "  --program-us US      Time to program 4 bytes (default %u)\n"
+           "  --erase-us US        Time to erase a sector (default %u)\n",
+           sim_config.swclk_hz, sim_config.program_word_us, sim_config.erase_sector_us);
+}
+
+int main(int argc, char *argv[])
+{
+    const sim_target_t *sim_target = find_target("nrf51");
+    bool check = false;
+    bool success;
+    int i;
+    options.size = 32768;
+
+    for (i = 1; i < argc; i++) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : 0;
+
+        if (0 == strcmp(argv[i], "--check")) {
+            check = true;
+        } else if (0 == strcmp(argv[i], "--sector-erase")) {
+            options.sector_erase = true;
+        } else if (0 == strcmp(argv[i], "--verify")) {
+            options.verify = true;
+        } else if (0 == strcmp(argv[i], "--hw-reset")) {
+            options.hw_reset = true;
+        } else if (0 == value) {
+            usage(argv[0]);
+            return 2;
+        } else if (0 == strcmp(argv[i], "--target")) {
+            sim_target = find_target(value);
+            i++;
+        } else if (0 == strcmp(argv[i], "--size")) {
+            options.size = strtoul(value, 0, 0);
+            i++;
+        } else if (0 == strcmp(argv[i], "--swclk")) {
+            sim_config.swclk_hz = strtoul(value, 0, 0);
+            i++;
+        } else if (0 == strcmp(argv[i], "--program-us")) {
+            sim_config.program_word_us = strtoul(value, 0, 0);
+            i++;
+        } else if (0 == strcmp(argv[i], "--erase-us")) {
+            sim_config.erase_sector_us = strtoul(value, 0, 0);
+            i++;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if ((0 == sim_target) || (0 == sim_config.swclk_hz) || (options.size < 64)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    host_rtx_init();
+    target_flash_lock_init();
+    success = check ? run_check() : run_program(sim_target);
+    return success ? 0 : 1;
+}
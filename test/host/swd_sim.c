@@ -0,0 +1,669 @@
+/**
+ * @file    swd_sim.c
+ * @brief   Implementation of swd_sim.h
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdlib.h"
+#include "string.h"
+
+#include "swd_sim.h"
+#include "debug_cm.h"
+#include "DAP_config.h"
+#include "DAP.h"
+#include "perf_counter.h"
+
+// SWD settings left by DAP_Setup
+#define TURNAROUND          1
+#define IDLE_CYCLES         0
+
+// Value of the three acknowledge bits when the target does not respond
+#define ACK_NONE            0x07
+
+// Request bits of SWD_Transfer
+#define REQ_APnDP           (1 << 0)
+#define REQ_RnW             (1 << 1)
+#define REQ_ADDR(req)       ((req) & 0x0C)
+
+// Core registers written through DCRSR, R0-R15 and xPSR
+#define CORE_REG_COUNT      17
+#define CORE_REG_XPSR       16
+#define XPSR_T              0x01000000
+
+#define DHCSR_CTRL_MASK     (C_DEBUGEN | C_HALT | C_STEP | C_MASKINTS | C_SNAPSTALL)
+#define DCRSR_REGSEL        0x1F
+#define DCRSR_REGWnR        (1 << 16)
+#define AIRCR_VECTKEYSTAT   0xFA050000
+
+#define MEM_AP_IDR          0x04770031
+#define TAR_WRAP            1024
+
+// Base addresses used by the register definitions in debug_cm.h
+#define DBG_Addr            0xE000EDF0
+#define NVIC_Addr           0xE000E000
+
+// Time the target never reaches
+#define NEVER               UINT64_MAX
+
+static struct {
+    swd_sim_config_t config;
+    swd_sim_stats_t stats;
+    uint8_t *flash;
+    uint32_t flash_start;
+    uint32_t flash_size;
+    uint8_t *ram;
+    uint32_t ram_start;
+    uint32_t ram_size;
+    uint64_t now_ns;                // Target time, advanced by the wire
+
+    // Wire state
+    bool swd_selected;              // JTAG to SWD sequence seen
+    bool line_reset;                // Only an IDCODE read is answered
+    uint32_t swj_ones;              // Consecutive high SWDIO cycles
+    uint32_t swj_bits;              // Cycles since the last line reset
+    uint16_t swj_shift;             // Last 16 cycles, latest in bit 15
+
+    // Debug port and MEM-AP
+    uint32_t ctrl_stat;
+    uint32_t select;
+    uint32_t rdbuff;                // Result of the last AP read
+    uint32_t csw;
+    uint32_t tar;
+
+    // Core
+    bool nreset_low;
+    bool halted;
+    bool reset_st;                  // S_RESET_ST, cleared when DHCSR is read
+    bool regrdy;
+    bool algo_initialized;          // Init of the flash algorithm was called
+    uint64_t halt_at_ns;            // Time the running flash algorithm returns
+    uint32_t dhcsr;
+    uint32_t demcr;
+    uint32_t dcrdr;
+    uint32_t regs[CORE_REG_COUNT];
+} sim;
+
+static void wire(uint32_t clocks)
+{
+    sim.stats.clocks += clocks;
+    sim.now_ns += (uint64_t)clocks * 1000000000 / sim.config.swclk_hz;
+}
+
+// The flash algorithm returns once its time has passed on the wire
+static void core_update(void)
+{
+    if (!sim.halted && (sim.halt_at_ns != NEVER) && (sim.now_ns >= sim.halt_at_ns)) {
+        sim.halted = true;
+        sim.halt_at_ns = NEVER;
+    }
+}
+
+// System reset, the debug registers keep their values
+static void core_reset(void)
+{
+    memset(sim.regs, 0, sizeof(sim.regs));
+    sim.algo_initialized = false;
+    sim.reset_st = true;
+    sim.regrdy = false;
+    sim.halt_at_ns = NEVER;
+    sim.halted = !sim.nreset_low && (sim.dhcsr & C_DEBUGEN) && (sim.demcr & VC_CORERESET);
+}
+
+static bool in_range(uint32_t addr, uint32_t size, uint32_t start, uint32_t region_size)
+{
+    return (addr >= start) && (addr - start <= region_size) && (size <= region_size - (addr - start));
+}
+
+static uint32_t get32(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// Check that the core was set up to call a function of the flash
+// algorithm the way swd_flash_syscall_exec does it
+static bool algo_call_valid(const program_target_t *algo)
+{
+    uint32_t pc = sim.regs[15];
+    uint32_t bkpt = algo->sys_call_s.breakpoint & ~1;
+
+    if ((pc != algo->init) && (pc != algo->uninit) && (pc != algo->erase_chip) &&
+            (pc != algo->erase_sector) && (pc != algo->program_page)) {
+        return false;
+    }
+
+    if ((sim.regs[9] != algo->sys_call_s.static_base) || (sim.regs[13] != algo->sys_call_s.stack_pointer) ||
+            (sim.regs[14] != algo->sys_call_s.breakpoint) || !(sim.regs[CORE_REG_XPSR] & XPSR_T)) {
+        return false;
+    }
+
+    // The algorithm and the breakpoint it returns to must be loaded
+    if (!in_range(algo->algo_start, algo->algo_size, sim.ram_start, sim.ram_size) ||
+            (0 != memcmp(sim.ram + algo->algo_start - sim.ram_start, algo->algo_blob, algo->algo_size))) {
+        return false;
+    }
+
+    return in_range(bkpt, 2, sim.ram_start, sim.ram_size) && (0xBE == sim.ram[bkpt - sim.ram_start + 1]);
+}
+
+static uint32_t algo_erase_sector(uint32_t addr, uint32_t *duration_us)
+{
+    const target_cfg_t *target = sim.config.target;
+    uint32_t sector, start, size;
+
+    if (!in_range(addr, 1, sim.flash_start, sim.flash_size)) {
+        return 1;
+    }
+
+    sector = target->get_sector_number(addr);
+    start = target->get_sector_address(sector);
+    size = target->get_sector_length(sector);
+
+    if (!in_range(start, size, sim.flash_start, sim.flash_size)) {
+        return 1;
+    }
+
+    memset(sim.flash + start - sim.flash_start, 0xFF, size);
+    sim.stats.sector_erases++;
+    *duration_us = sim.config.erase_sector_us;
+    return 0;
+}
+
+static uint32_t algo_program_page(uint32_t addr, uint32_t size, uint32_t buf, uint32_t *duration_us)
+{
+    uint8_t *dest;
+    const uint8_t *src;
+    uint32_t i;
+
+    if (!in_range(addr, size, sim.flash_start, sim.flash_size) || !in_range(buf, size, sim.ram_start, sim.ram_size)) {
+        return 1;
+    }
+
+    dest = sim.flash + addr - sim.flash_start;
+    src = sim.ram + buf - sim.ram_start;
+
+    // Programming can only clear bits
+    for (i = 0; i < size; i++) {
+        if ((dest[i] & src[i]) != src[i]) {
+            sim.stats.program_errors++;
+            return 1;
+        }
+
+        dest[i] = src[i];
+    }
+
+    sim.stats.page_programs++;
+    sim.stats.bytes_programmed += size;
+    *duration_us = (size + 3) / 4 * sim.config.program_word_us;
+    return 0;
+}
+
+// Resume the core.  Calls of the flash algorithm are carried out and
+// halt on the breakpoint once they would have finished, anything else is
+// the application which keeps running.
+static void core_run(void)
+{
+    const program_target_t *algo = sim.config.target->flash_algo;
+    uint32_t pc = sim.regs[15];
+    uint32_t duration_us = 0;
+    uint32_t result = 0;
+    sim.halted = false;
+    sim.regrdy = false;
+    sim.halt_at_ns = NEVER;
+
+    if (!algo_call_valid(algo)) {
+        return;
+    }
+
+    sim.stats.algo_calls++;
+
+    if (pc == algo->init) {
+        sim.algo_initialized = true;
+    } else if (pc == algo->uninit) {
+        sim.algo_initialized = false;
+    } else if (!sim.algo_initialized) {
+        sim.stats.program_errors++;
+        result = 1;
+    } else if (pc == algo->erase_chip) {
+        memset(sim.flash, 0xFF, sim.flash_size);
+        sim.stats.chip_erases++;
+        duration_us = sim.config.erase_chip_us;
+    } else if (pc == algo->erase_sector) {
+        result = algo_erase_sector(sim.regs[0], &duration_us);
+    } else {
+        result = algo_program_page(sim.regs[0], sim.regs[1], sim.regs[2], &duration_us);
+    }
+
+    sim.stats.busy_us += duration_us;
+    sim.regs[0] = result;
+    sim.regs[15] = algo->sys_call_s.breakpoint & ~1;
+    sim.halt_at_ns = sim.now_ns + (uint64_t)duration_us * 1000;
+}
+
+static void write_dhcsr(uint32_t value)
+{
+    if ((value & 0xFFFF0000) != DBGKEY) {
+        return;
+    }
+
+    sim.dhcsr = value & DHCSR_CTRL_MASK;
+
+    if (!(sim.dhcsr & C_DEBUGEN)) {
+        if (sim.halted) {
+            sim.halted = false;
+            sim.halt_at_ns = NEVER;
+        }
+    } else if (sim.dhcsr & C_HALT) {
+        if (!sim.nreset_low) {
+            sim.halted = true;
+            sim.halt_at_ns = NEVER;
+        }
+    } else if (sim.halted) {
+        core_run();
+    }
+}
+
+static uint32_t read_dhcsr(void)
+{
+    uint32_t value = sim.dhcsr;
+    core_update();
+    value |= sim.halted ? S_HALT : 0;
+    value |= sim.regrdy ? S_REGRDY : 0;
+    value |= sim.reset_st ? S_RESET_ST : 0;
+    sim.reset_st = false;
+    return value;
+}
+
+static void write_dcrsr(uint32_t value)
+{
+    uint32_t reg = value & DCRSR_REGSEL;
+    core_update();
+    sim.regrdy = sim.halted;
+
+    if (!sim.halted) {
+        return;
+    }
+
+    if (value & DCRSR_REGWnR) {
+        if (reg < CORE_REG_COUNT) {
+            sim.regs[reg] = sim.dcrdr;
+        }
+    } else {
+        sim.dcrdr = (reg < CORE_REG_COUNT) ? sim.regs[reg] : 0;
+    }
+}
+
+static bool mem_read(uint32_t addr, uint32_t *value)
+{
+    uint32_t i;
+    addr &= ~3;
+
+    if (in_range(addr, 4, sim.flash_start, sim.flash_size)) {
+        *value = get32(sim.flash + addr - sim.flash_start);
+        return true;
+    }
+
+    if (in_range(addr, 4, sim.ram_start, sim.ram_size)) {
+        *value = get32(sim.ram + addr - sim.ram_start);
+        return true;
+    }
+
+    for (i = 0; i < sim.config.id_word_count; i++) {
+        if (sim.config.id_words[i].addr == addr) {
+            *value = sim.config.id_words[i].value;
+            return true;
+        }
+    }
+
+    switch (addr) {
+        case DBG_HCSR:
+            *value = read_dhcsr();
+            return true;
+
+        case DBG_CRSR:
+            *value = 0;
+            return true;
+
+        case DBG_CRDR:
+            *value = sim.dcrdr;
+            return true;
+
+        case DBG_EMCR:
+            *value = sim.demcr;
+            return true;
+
+        case NVIC_AIRCR:
+            *value = AIRCR_VECTKEYSTAT;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Write the byte lanes of value selected by the access size
+static bool mem_write(uint32_t addr, uint32_t value, uint32_t csw_size)
+{
+    uint32_t size = (CSW_SIZE8 == csw_size) ? 1 : (CSW_SIZE16 == csw_size) ? 2 : 4;
+    uint32_t shift = (addr & 3) * 8;
+    uint32_t i;
+    addr &= ~(size - 1);
+
+    if (in_range(addr, size, sim.ram_start, sim.ram_size)) {
+        for (i = 0; i < size; i++) {
+            sim.ram[addr - sim.ram_start + i] = (value >> (shift + 8 * i)) & 0xFF;
+        }
+
+        return true;
+    }
+
+    // Flash and the rest of the memory map are only written as words
+    if (4 != size) {
+        return false;
+    }
+
+    switch (addr) {
+        case DBG_HCSR:
+            write_dhcsr(value);
+            return true;
+
+        case DBG_CRSR:
+            write_dcrsr(value);
+            return true;
+
+        case DBG_CRDR:
+            sim.dcrdr = value;
+            return true;
+
+        case DBG_EMCR:
+            sim.demcr = value;
+            return true;
+
+        case NVIC_AIRCR:
+            if (((value & 0xFFFF0000) == VECTKEY) && (value & (SYSRESETREQ | VECTRESET))) {
+                core_reset();
+            }
+
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Data read and write through TAR, which wraps within a 1KB block
+static bool mem_ap_drw(bool read, uint32_t *value)
+{
+    uint32_t size = 1 << (sim.csw & CSW_SIZE);
+    bool ok = read ? mem_read(sim.tar, value) : mem_write(sim.tar, *value, sim.csw & CSW_SIZE);
+
+    if (ok && ((sim.csw & CSW_ADDRINC) == CSW_SADDRINC)) {
+        sim.tar = (sim.tar & ~(TAR_WRAP - 1)) | ((sim.tar + size) & (TAR_WRAP - 1));
+    }
+
+    return ok;
+}
+
+static uint8_t ap_transfer(uint32_t request, uint32_t *data)
+{
+    uint32_t addr = (sim.select & APBANKSEL) | REQ_ADDR(request);
+    uint32_t value = 0;
+
+    // Bus errors are sticky and fault every AP access until ABORT
+    if (((sim.ctrl_stat & (CDBGPWRUPREQ | CSYSPWRUPREQ)) != (CDBGPWRUPREQ | CSYSPWRUPREQ)) ||
+            (sim.ctrl_stat & STICKYERR) || (sim.select & APSEL)) {
+        sim.ctrl_stat |= STICKYERR;
+        return DAP_TRANSFER_FAULT;
+    }
+
+    if (request & REQ_RnW) {
+        sim.stats.ap_reads++;
+
+        if (AP_CSW == addr) {
+            value = sim.csw;
+        } else if (AP_TAR == addr) {
+            value = sim.tar;
+        } else if (AP_DRW == addr) {
+            if (!mem_ap_drw(true, &value)) {
+                sim.ctrl_stat |= STICKYERR;
+                return DAP_TRANSFER_FAULT;
+            }
+        } else if (AP_IDR == addr) {
+            value = MEM_AP_IDR;
+        }
+
+        // AP reads are posted, the data is that of the previous read
+        if (data) {
+            *data = sim.rdbuff;
+        }
+
+        sim.rdbuff = value;
+        return DAP_TRANSFER_OK;
+    }
+
+    sim.stats.ap_writes++;
+
+    if (AP_CSW == addr) {
+        sim.csw = *data;
+    } else if (AP_TAR == addr) {
+        sim.tar = *data;
+    } else if (AP_DRW == addr) {
+        if (!mem_ap_drw(false, data)) {
+            sim.ctrl_stat |= STICKYERR;
+            return DAP_TRANSFER_FAULT;
+        }
+    }
+
+    return DAP_TRANSFER_OK;
+}
+
+static uint8_t dp_transfer(uint32_t request, uint32_t *data)
+{
+    uint32_t value = 0;
+
+    if (request & REQ_RnW) {
+        sim.stats.dp_reads++;
+
+        switch (REQ_ADDR(request)) {
+            case DP_IDCODE:
+                value = sim.config.idcode;
+                sim.line_reset = false;
+                break;
+
+            case DP_CTRL_STAT:
+                value = sim.ctrl_stat | READOK;
+                value |= (sim.ctrl_stat & CDBGPWRUPREQ) ? CDBGPWRUPACK : 0;
+                value |= (sim.ctrl_stat & CSYSPWRUPREQ) ? CSYSPWRUPACK : 0;
+                break;
+
+            case DP_RDBUFF:
+                value = sim.rdbuff;
+                break;
+
+            default:
+                break;
+        }
+
+        if (data) {
+            *data = value;
+        }
+
+        return DAP_TRANSFER_OK;
+    }
+
+    sim.stats.dp_writes++;
+
+    switch (REQ_ADDR(request)) {
+        case DP_ABORT:
+            if (*data & STKERRCLR) {
+                sim.ctrl_stat &= ~STICKYERR;
+            }
+
+            if (*data & WDERRCLR) {
+                sim.ctrl_stat &= ~WDATAERR;
+            }
+
+            if (*data & STKCMPCLR) {
+                sim.ctrl_stat &= ~STICKYCMP;
+            }
+
+            if (*data & ORUNERRCLR) {
+                sim.ctrl_stat &= ~STICKYORUN;
+            }
+
+            break;
+
+        case DP_CTRL_STAT:
+            sim.ctrl_stat = (sim.ctrl_stat & (STICKYERR | WDATAERR | STICKYCMP | STICKYORUN)) |
+                            (*data & (CDBGPWRUPREQ | CSYSPWRUPREQ | MASKLANE | TRNMODE | ORUNDETECT));
+            break;
+
+        case DP_SELECT:
+            sim.select = *data;
+            break;
+
+        default:
+            break;
+    }
+
+    return DAP_TRANSFER_OK;
+}
+
+static uint8_t transfer(uint32_t request, uint32_t *data)
+{
+    // After a line reset the DP only answers a read of IDCODE
+    if (!sim.swd_selected || (sim.line_reset && (request != (REQ_RnW | DP_IDCODE)))) {
+        return ACK_NONE;
+    }
+
+    return (request & REQ_APnDP) ? ap_transfer(request, data) : dp_transfer(request, data);
+}
+
+void swd_sim_reset(const swd_sim_config_t *config)
+{
+    const target_cfg_t *target = config->target;
+    free(sim.flash);
+    free(sim.ram);
+    memset(&sim, 0, sizeof(sim));
+    sim.config = *config;
+    sim.flash_start = target->flash_start;
+    sim.flash_size = target->sector_cnt * target->sector_size;
+    sim.ram_start = target->ram_start;
+    sim.ram_size = target->ram_end - target->ram_start;
+    sim.flash = malloc(sim.flash_size);
+    sim.ram = calloc(sim.ram_size, 1);
+
+    if ((0 == sim.flash) || (0 == sim.ram)) {
+        abort();
+    }
+
+    memset(sim.flash, 0xFF, sim.flash_size);
+    sim.halt_at_ns = NEVER;
+    sim.reset_st = true;
+}
+
+uint8_t *swd_sim_flash(void)
+{
+    return sim.flash;
+}
+
+void swd_sim_set_swclk(uint32_t swclk_hz)
+{
+    sim.config.swclk_hz = swclk_hz;
+}
+
+const swd_sim_stats_t *swd_sim_get_stats(void)
+{
+    return &sim.stats;
+}
+
+void swd_sim_clear_stats(void)
+{
+    memset(&sim.stats, 0, sizeof(sim.stats));
+}
+
+void swd_sim_set_nreset(uint32_t level)
+{
+    bool low = (0 == level);
+
+    if (low && !sim.nreset_low) {
+        sim.nreset_low = true;
+        sim.halted = false;
+        sim.halt_at_ns = NEVER;
+    } else if (!low && sim.nreset_low) {
+        sim.nreset_low = false;
+        core_reset();
+    }
+}
+
+// Replacements for SW_DP.c, counted the same way
+
+void DAP_Setup(void)
+{
+}
+
+void SWJ_Sequence(uint32_t count, uint8_t *data)
+{
+    uint32_t i;
+    uint8_t bit;
+    perf_count_n(PERF_EVENT_SWJ_CLOCKS, count);
+    wire(count);
+
+    for (i = 0; i < count; i++) {
+        bit = (data[i / 8] >> (i % 8)) & 1;
+        sim.swj_shift = (sim.swj_shift >> 1) | (bit << 15);
+        sim.swj_ones = bit ? sim.swj_ones + 1 : 0;
+        sim.swj_bits++;
+
+        if (sim.swj_ones >= 50) {
+            if (50 == sim.swj_ones) {
+                sim.stats.line_resets++;
+            }
+
+            sim.line_reset = true;
+            sim.swj_bits = 0;
+        } else if ((16 == sim.swj_bits) && (0xE79E == sim.swj_shift)) {
+            // JTAG to SWD switch right after a line reset
+            sim.swd_selected = true;
+        }
+    }
+}
+
+uint8_t SWD_Transfer(uint32_t request, uint32_t *data)
+{
+    uint8_t ack = transfer(request, data);
+    // Request, turnaround and acknowledge are always clocked
+    uint32_t clocks = 8 + TURNAROUND + 3;
+    perf_count(PERF_EVENT_SWD_TRANSFER);
+    sim.stats.transfers++;
+
+    if (ack == DAP_TRANSFER_OK) {
+        clocks += 32 + 1 + TURNAROUND + IDLE_CYCLES;
+    } else if ((ack == DAP_TRANSFER_WAIT) || (ack == DAP_TRANSFER_FAULT)) {
+        clocks += TURNAROUND;
+        perf_count((ack == DAP_TRANSFER_WAIT) ? PERF_EVENT_SWD_WAIT : PERF_EVENT_SWD_FAULT);
+        sim.stats.faults++;
+    } else {
+        clocks += TURNAROUND + 32 + 1;
+        perf_count(PERF_EVENT_SWD_ERROR);
+        sim.stats.faults++;
+    }
+
+    perf_count_n(PERF_EVENT_SWJ_CLOCKS, clocks);
+    wire(clocks);
+    return ack;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file    swd_sim.h
+ * @brief   Simulated SWD target behind SWD_Transfer and SWJ_Sequence
+ *
+ * DAPLink Interface Firmware
+ * Copyright (c) 2009-2016, ARM Limited, All Rights Reserved
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SWD_SIM_H
+#define SWD_SIM_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+#include "target_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The target has a DP, a MEM-AP which wraps TAR at 1KB, the Cortex-M
+// debug registers, RAM and flash.  Flash is only changed by the flash
+// algorithm of the target, which is modelled by its entry points rather
+// than executed.  Time on the target advances with the SWCLK cycles put
+// on the wire so the number of status polls matches a real probe.
+
+typedef struct {
+    uint32_t addr;
+    uint32_t value;
+} swd_sim_word_t;
+
+typedef struct {
+    const target_cfg_t *target;     // Memory map, sectors and flash algorithm
+    uint32_t idcode;                // DP IDCODE
+    const swd_sim_word_t *id_words; // Read only words identifying the device
+    uint32_t id_word_count;
+    uint32_t swclk_hz;              // Converts wire cycles to target time
+    uint32_t erase_sector_us;       // Time to erase one sector
+    uint32_t erase_chip_us;         // Time to erase the whole flash
+    uint32_t program_word_us;       // Time to program 4 bytes
+} swd_sim_config_t;
+
+typedef struct {
+    uint32_t transfers;             // SWD packets
+    uint32_t dp_reads;
+    uint32_t dp_writes;
+    uint32_t ap_reads;
+    uint32_t ap_writes;
+    uint32_t faults;                // Packets answered with FAULT or not at all
+    uint32_t line_resets;           // 50 or more SWDIO high cycles
+    uint64_t clocks;                // SWCLK cycles of packets and sequences
+    uint32_t algo_calls;            // Flash algorithm functions run
+    uint32_t sector_erases;
+    uint32_t chip_erases;
+    uint32_t page_programs;         // ProgramPage calls
+    uint32_t bytes_programmed;
+    uint32_t program_errors;        // Bits programmed from 0 to 1 or calls before Init
+    uint64_t busy_us;               // Time the flash algorithm ran
+} swd_sim_stats_t;
+
+// Power the target on with config.  Flash is erased and the core runs.
+void swd_sim_reset(const swd_sim_config_t *config);
+
+// Flash contents, sector_cnt * sector_size bytes from flash_start
+uint8_t *swd_sim_flash(void);
+
+// Change the SWCLK frequency used from now on
+void swd_sim_set_swclk(uint32_t swclk_hz);
+
+const swd_sim_stats_t *swd_sim_get_stats(void);
+void swd_sim_clear_stats(void);
+
+// Level of the nRESET pin, 0 holds the target in reset
+void swd_sim_set_nreset(uint32_t level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
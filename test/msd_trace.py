@@ -0,0 +1,309 @@
+#
+# DAPLink Interface Firmware
+# Copyright (c) 2016-2016, ARM Limited, All Rights Reserved
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License"); you may
+# not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+# WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+""" Record and replay MSD write sequences
+
+A trace is the ordered list of SCSI WRITE (10) commands a host sends
+while copying a file onto the drive.  Replaying a trace through the raw
+USB interface reproduces the exact order of directory, FAT and data
+writes, so changes to the drag-n-drop pipeline can be compared in MB/s
+with the same input every time.
+"""
+
+from __future__ import print_function
+
+import argparse
+import struct
+import time
+import usb.core
+from usb_msd import USBMsd, Fat, Directory
+from usb_test import _daplink_match
+
+
+class MsdTrace(object):
+    """Ordered list of sector writes sent to a MSD"""
+
+    # Magic
+    # Version
+    # Record count
+    FMT_HEADER = "<4sII"
+    MAGIC = b"MSDT"
+    VERSION = 1
+
+    # Starting LBA
+    # Sector count
+    # Delay before the command in microseconds
+    FMT_RECORD = "<III"
+
+    SECTOR_SIZE = 512
+
+    def __init__(self):
+        self.records = []
+
+    def append(self, lba, data, delay=0.0):
+        """Add a write of data starting at lba after delay seconds"""
+        assert len(data) > 0
+        assert len(data) % self.SECTOR_SIZE == 0
+        self.records.append((lba, bytearray(data), delay))
+
+    def save(self, path):
+        """Write this trace to a file"""
+        with open(path, "wb") as trace_file:
+            trace_file.write(struct.pack(self.FMT_HEADER, self.MAGIC,
+                                         self.VERSION, len(self.records)))
+            for lba, data, delay in self.records:
+                count = len(data) // self.SECTOR_SIZE
+                delay_us = int(delay * 1000000)
+                trace_file.write(struct.pack(self.FMT_RECORD, lba, count,
+                                             delay_us))
+                trace_file.write(data)
+
+    @staticmethod
+    def load(path):
+        """Read a trace from a file"""
+        trace = MsdTrace()
+        with open(path, "rb") as trace_file:
+            header_size = struct.calcsize(MsdTrace.FMT_HEADER)
+            record_size = struct.calcsize(MsdTrace.FMT_RECORD)
+            magic, version, record_count = struct.unpack(
+                MsdTrace.FMT_HEADER, trace_file.read(header_size))
+            if magic != MsdTrace.MAGIC or version != MsdTrace.VERSION:
+                raise Exception("Unsupported trace file %s" % path)
+            for _ in range(record_count):
+                lba, count, delay_us = struct.unpack(
+                    MsdTrace.FMT_RECORD, trace_file.read(record_size))
+                data = trace_file.read(count * MsdTrace.SECTOR_SIZE)
+                if len(data) != count * MsdTrace.SECTOR_SIZE:
+                    raise Exception("Truncated trace file %s" % path)
+                trace.append(lba, data, delay_us / 1000000.0)
+        return trace
+
+    def get_size(self):
+        """Return the number of bytes written by this trace"""
+        return sum(len(data) for _, data, _ in self.records)
+
+    def replay(self, msd, use_delays=True):
+        """Send this trace to a locked USBMsd and return the elapsed time"""
+        start = time.time()
+        for lba, data, delay in self.records:
+            if use_delays and delay > 0:
+                time.sleep(delay)
+            msd.scsi_write10(lba, data)
+        return time.time() - start
+
+
+class RecordingMsd(object):
+    """USBMsd wrapper which records every write into a trace"""
+
+    def __init__(self, msd):
+        self.msd = msd
+        self.trace = MsdTrace()
+        self._last_time = None
+
+    def __getattr__(self, name):
+        return getattr(self.msd, name)
+
+    def scsi_write10(self, lba, data):
+        """Record then perform the SCSI write 10 command"""
+        now = time.time()
+        delay = 0.0 if self._last_time is None else now - self._last_time
+        self.trace.append(lba, data, delay)
+        self.msd.scsi_write10(lba, data)
+        self._last_time = time.time()
+
+
+def build_copy_trace(fat, name, data, order, chunk_sectors=64):
+    """Return a trace which copies data to the file name
+
+    The order argument selects the write ordering to model:
+        "data_first" - file data, then the FAT, then the directory entry
+        "dir_first" - directory entry with size zero, FAT, file data,
+                      then the directory entry again with the final size
+        "fat_first" - FAT, file data, then the directory entry
+        "progressive" - directory entry with size zero, then for each
+                      chunk of data the FAT chained up to it, the data and
+                      the directory entry with the size written so far
+    These are synthesized orderings, not captures of a particular host.
+    """
+    assert len(name) == 11
+    mbr = fat.mbr
+    sector_size = mbr["BPB_BytsPerSec"]
+    cluster_size = sector_size * mbr["BPB_SecPerClus"]
+    fat_start = mbr["BPB_RsvdSecCnt"]
+    fat_sectors = mbr["BPB_FATSz16"]
+    root_dir = fat.root_dir
+    root_sectors = (mbr["BPB_RootEntCnt"] * Directory.ENTRY_SIZE +
+                    sector_size - 1) // sector_size
+    data_start = root_dir.sector + root_sectors
+
+    # Pad the file to a whole number of sectors
+    file_data = bytearray(data)
+    if len(file_data) % sector_size:
+        file_data.extend(bytearray(sector_size - len(file_data) % sector_size))
+    cluster_count = max(1, (len(file_data) + cluster_size - 1) // cluster_size)
+
+    # Find a free run of clusters in the first FAT
+    fat_data = bytearray(fat.msd.scsi_read10(fat_start, fat_sectors))
+    entry_count = len(fat_data) // 2
+    first_cluster = None
+    run = 0
+    for cluster in range(2, entry_count):
+        free = struct.unpack_from("<H", fat_data, cluster * 2)[0] == 0
+        run = run + 1 if free else 0
+        if run == cluster_count:
+            first_cluster = cluster - cluster_count + 1
+            break
+    if first_cluster is None:
+        raise Exception("No room for %i clusters" % cluster_count)
+
+    def chain(fat_copy, count):
+        """Chain count clusters from first_cluster, the last ending it"""
+        for idx in range(count):
+            cluster = first_cluster + idx
+            next_cluster = 0xFFFF if idx == count - 1 else cluster + 1
+            struct.pack_into("<H", fat_copy, cluster * 2, next_cluster)
+
+    # The free FAT is kept for the chains of a progressive copy
+    fat_free = bytearray(fat_data)
+    chain(fat_data, cluster_count)
+
+    # Directory entries with and without the final size
+    dir_idx = root_dir.find_free_entry_index()
+    if dir_idx is None:
+        raise Exception("Root directory is full")
+    entry = root_dir[dir_idx]
+    entry["DIR_Name"] = name
+    entry["DIR_Attr"] = 0x20
+    entry["DIR_FstClusLO"] = first_cluster
+    entry["DIR_FileSize"] = 0
+    dir_empty = root_dir.pack()
+    entry["DIR_FileSize"] = len(data)
+    dir_final = root_dir.pack()
+
+    trace = MsdTrace()
+
+    def add_fat(fat_copy=fat_data):
+        """Write every copy of the FAT"""
+        for copy in range(mbr["BPB_NumFATs"]):
+            trace.append(fat_start + copy * fat_sectors, fat_copy)
+
+    def add_dir(dir_data):
+        """Write the root directory"""
+        trace.append(root_dir.sector, dir_data)
+
+    def add_data():
+        """Write the file data in host sized chunks"""
+        chunk_size = chunk_sectors * sector_size
+        lba = data_start + (first_cluster - 2) * mbr["BPB_SecPerClus"]
+        for offset in range(0, len(file_data), chunk_size):
+            chunk = file_data[offset:offset + chunk_size]
+            trace.append(lba + offset // sector_size, chunk)
+
+    if order == "data_first":
+        add_data()
+        add_fat()
+        add_dir(dir_final)
+    elif order == "dir_first":
+        add_dir(dir_empty)
+        add_fat()
+        add_data()
+        add_dir(dir_final)
+    elif order == "fat_first":
+        add_fat()
+        add_data()
+        add_dir(dir_final)
+    elif order == "progressive":
+        # Like a host which writes the metadata after every chunk, so the
+        # directory entry and FAT agree on a size before the end of the file
+        add_dir(dir_empty)
+        chunk_size = chunk_sectors * sector_size
+        lba = data_start + (first_cluster - 2) * mbr["BPB_SecPerClus"]
+        for offset in range(0, len(file_data), chunk_size):
+            chunk = file_data[offset:offset + chunk_size]
+            end = offset + len(chunk)
+            chain(fat_free, (end + cluster_size - 1) // cluster_size)
+            add_fat(fat_free)
+            trace.append(lba + offset // sector_size, chunk)
+            entry["DIR_FileSize"] = min(len(data), end)
+            add_dir(root_dir.pack())
+    else:
+        raise Exception("Unknown write order %s" % order)
+    return trace
+
+ORDERS = ("data_first", "dir_first", "fat_first", "progressive")
+
+
+def _find_device(serial_number):
+    """Return the first DAPLink device or the one with serial_number"""
+    dev_list = usb.core.find(find_all=True, custom_match=_daplink_match)
+    for dev in dev_list:
+        if serial_number is None or dev.serial_number == serial_number:
+            return dev
+    return None
+
+
+def main():
+    """Build, save or replay a MSD trace on a board"""
+    parser = argparse.ArgumentParser(description='MSD trace replay')
+    parser.add_argument('--serial', help='Board serial number',
+                        default=None)
+    parser.add_argument('--build', help='Firmware file to copy into a new '
+                        'trace', default=None)
+    parser.add_argument('--order', help='Write order of a new trace',
+                        choices=ORDERS, default=ORDERS[0])
+    parser.add_argument('--name', help='8.3 name of the copied file',
+                        default='IMAGE   BIN')
+    parser.add_argument('--save', help='Save the trace to this file',
+                        default=None)
+    parser.add_argument('--replay', help='Trace file to replay',
+                        default=None)
+    parser.add_argument('--no-delays', help='Ignore recorded delays',
+                        action='store_true', default=False)
+    args = parser.parse_args()
+
+    dev = _find_device(args.serial)
+    if dev is None:
+        print("Could not find a board")
+        exit(-1)
+    msd = USBMsd(dev)
+    msd.lock()
+    try:
+        if args.build is not None:
+            with open(args.build, "rb") as file_handle:
+                data = file_handle.read()
+            trace = build_copy_trace(Fat(msd), args.name.encode(), data,
+                                     args.order)
+        elif args.replay is not None:
+            trace = MsdTrace.load(args.replay)
+        else:
+            print("Nothing to replay")
+            exit(-1)
+
+        if args.save is not None:
+            trace.save(args.save)
+
+        elapsed = trace.replay(msd, not args.no_delays)
+        size = trace.get_size()
+        print("Wrote %i bytes in %i commands in %.3fs - %.3f MB/s" %
+              (size, len(trace.records), elapsed,
+               size / elapsed / 1000000.0 if elapsed > 0 else 0))
+    finally:
+        msd.unlock()
+
+
+if __name__ == "__main__":
+    main()
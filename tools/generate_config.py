@@ -28,18 +28,20 @@ CFG_KEY = 0x6b766c64
 # 8  - auto_rst
 # 8  - automation_allowed
 # 8  - overflow_detect
+# 8  - full_remount
 # 0  - 'end' member omitted
-FORMAT = '<LHBBB'
+FORMAT = '<LHBBBB'
 FORMAT_LENGTH = struct.calcsize(FORMAT)
 MINIMUM_ALIGN = 1 << 10  # 1k aligned
 
 
 def create_hex(filename, addr, auto_rst, automation_allowed,
-               overflow_detect, pad_size):
+               overflow_detect, full_remount, pad_size):
     file_format = 'hex'
     intel_hex = IntelHex()
     intel_hex.puts(addr, struct.pack(FORMAT, CFG_KEY, FORMAT_LENGTH, auto_rst,
-                                     automation_allowed, overflow_detect))
+                                     automation_allowed, overflow_detect,
+                                     full_remount))
     pad_addr = addr + FORMAT_LENGTH
     pad_byte_count = pad_size - (FORMAT_LENGTH % pad_size)
     pad_data = '\xFF' * pad_byte_count
@@ -58,6 +60,7 @@ parser.add_argument("--addr", type=str_to_int, required=True, help="Address of c
 parser.add_argument("--auto_rst", type=int, required=True, choices=[0, 1], help="Auto reset configuration value")
 parser.add_argument("--automation_allowed", type=int, required=True, choices=[0,1], help="Allow automation from filesystem interaction")
 parser.add_argument("--overflow_detect", type=int, required=True, choices=[0,1], help="Enable detection of UART overflow")
+parser.add_argument("--full_remount", type=int, default=0, choices=[0,1], help="Report the drive as removed after a transfer instead of changed")
 parser.add_argument("--pad", type=int, default=16, choices=POWERS_OF_TWO, metavar="{1, 2, 4,...}", help="Byte aligned boundary to pad region to")
 parser.add_argument("--output_file", type=str, default='settings.hex', help="Name of output file")
 
@@ -74,9 +77,11 @@ def main():
     print "  auto_rst: %i" % args.auto_rst
     print "  automation_allowed: %i" % args.automation_allowed
     print "  overflow_detect: %i" % args.overflow_detect
+    print "  full_remount: %i" % args.full_remount
     print ""
     create_hex(args.output_file, args.addr, args.auto_rst,
-               args.automation_allowed, args.overflow_detect, args.pad)
+               args.automation_allowed, args.overflow_detect,
+               args.full_remount, args.pad)
 
 if __name__ == '__main__':
     main()